@@ -0,0 +1,183 @@
+/*
+ * async_log.c - Background log writer
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "async_log.h"
+
+static void wake_writer(AsyncLog *l) {
+    pthread_mutex_lock(&l->lock);
+    pthread_cond_signal(&l->wake);
+    pthread_mutex_unlock(&l->lock);
+}
+
+static void write_all(int fd, const char *p, size_t len) {
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;             /* nowhere left to report it */
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+/* Write the queued bytes, at most two runs when they wrap the ring */
+static void drain(AsyncLog *l) {
+    size_t tail = atomic_load_explicit(&l->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&l->head, memory_order_acquire);
+    if (head == tail) return;
+
+    size_t off = tail & (l->cap - 1), len = head - tail;
+    size_t first = len < l->cap - off ? len : l->cap - off;
+    write_all(l->fd, l->ring + off, first);
+    if (len > first) write_all(l->fd, l->ring, len - first);
+    atomic_store_explicit(&l->tail, head, memory_order_release);
+}
+
+static void *writer_main(void *arg) {
+    AsyncLog *l = arg;
+    for (;;) {
+        pthread_mutex_lock(&l->lock);
+        if (!atomic_load(&l->stop)) {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += (long)ALOG_FLUSH_MS * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&l->wake, &l->lock, &ts);
+        }
+        pthread_mutex_unlock(&l->lock);
+
+        /* Read stop before draining so nothing queued before it is lost */
+        bool stop = atomic_load(&l->stop);
+        drain(l);
+        if (stop) return NULL;
+    }
+}
+
+bool alog_open(AsyncLog *l, const char *path) {
+    memset(l, 0, sizeof(*l));
+    l->fd = -1;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    l->cap = ALOG_RING_BYTES;
+    l->ring = malloc(l->cap);
+    if (!l->ring) { close(fd); return false; }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&l->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_mutex_init(&l->produce, NULL);
+
+    l->fd = fd;
+    if (pthread_create(&l->thread, NULL, writer_main, l) != 0) {
+        pthread_cond_destroy(&l->wake);
+        pthread_mutex_destroy(&l->lock);
+        pthread_mutex_destroy(&l->produce);
+        free(l->ring);
+        close(fd);
+        l->ring = NULL;
+        l->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool alog_is_open(const AsyncLog *l) {
+    return l->fd >= 0;
+}
+
+const char *alog_timestamp(AsyncLog *l) {
+    time_t now = time(NULL);
+    if (now != l->ts_sec || !l->ts[0]) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(l->ts, sizeof(l->ts), "%Y-%m-%d %H:%M:%S", &tm);
+        l->ts_sec = now;
+    }
+    return l->ts;
+}
+
+/* Copy into the ring, waiting for the writer only when it is full */
+static void push(AsyncLog *l, const char *p, size_t len) {
+    size_t head = atomic_load_explicit(&l->head, memory_order_relaxed);
+    while (len) {
+        size_t tail = atomic_load_explicit(&l->tail, memory_order_acquire);
+        size_t room = l->cap - (head - tail);
+        if (!room) {
+            l->stalls++;
+            wake_writer(l);
+            struct timespec nap = { 0, 1000000L };
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        size_t off = head & (l->cap - 1);
+        size_t n = len < room ? len : room;
+        if (n > l->cap - off) n = l->cap - off;
+        memcpy(l->ring + off, p, n);
+        head += n;
+        p += n;
+        len -= n;
+        atomic_store_explicit(&l->head, head, memory_order_release);
+    }
+
+    size_t queued = head - atomic_load_explicit(&l->tail, memory_order_relaxed);
+    if (queued >= ALOG_FLUSH_BYTES) wake_writer(l);
+}
+
+void alog_vline(AsyncLog *l, const char *tag, const char *fmt, va_list args) {
+    if (l->fd < 0) return;
+    pthread_mutex_lock(&l->produce);
+    buf_reset(&l->line);
+    buf_printf(&l->line, tag ? "[%s] [%s] " : "[%s] ", alog_timestamp(l), tag);
+    buf_vprintf(&l->line, fmt, args);
+    buf_append(&l->line, "\n", 1);
+    push(l, l->line.data, l->line.size);
+    l->lines++;
+    pthread_mutex_unlock(&l->produce);
+}
+
+void alog_line(AsyncLog *l, const char *tag, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    alog_vline(l, tag, fmt, args);
+    va_end(args);
+}
+
+void alog_printf(AsyncLog *l, const char *fmt, ...) {
+    if (l->fd < 0) return;
+    va_list args;
+    va_start(args, fmt);
+    pthread_mutex_lock(&l->produce);
+    buf_reset(&l->line);
+    buf_vprintf(&l->line, fmt, args);
+    va_end(args);
+    push(l, l->line.data, l->line.size);
+    pthread_mutex_unlock(&l->produce);
+}
+
+void alog_close(AsyncLog *l) {
+    if (l->fd < 0) return;
+    atomic_store(&l->stop, true);
+    wake_writer(l);
+    pthread_join(l->thread, NULL);
+
+    pthread_cond_destroy(&l->wake);
+    pthread_mutex_destroy(&l->lock);
+    pthread_mutex_destroy(&l->produce);
+    close(l->fd);
+    free(l->ring);
+    buf_free(&l->line);
+    l->ring = NULL;
+    l->fd = -1;
+}
@@ -0,0 +1,75 @@
+/*
+ * async_log.h - Background log writer
+ *
+ * Log calls format into a scratch buffer and copy the finished line into
+ * a lock-free ring; a writer thread drains the ring to the file. The
+ * caller never waits on the disk unless the ring is full. The writer
+ * wakes every ALOG_FLUSH_MS, or sooner once ALOG_FLUSH_BYTES are queued,
+ * and writes everything queued in one or two write() calls.
+ *
+ * The ring has one producer at a time: threads logging to the same log
+ * take turns on a mutex, held only while a line is formatted and copied.
+ */
+
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "buffer.h"
+
+#ifndef ALOG_RING_BYTES
+#define ALOG_RING_BYTES  (1 << 20)  /* power of two */
+#endif
+#ifndef ALOG_FLUSH_MS
+#define ALOG_FLUSH_MS    200
+#endif
+#ifndef ALOG_FLUSH_BYTES
+#define ALOG_FLUSH_BYTES (64 << 10)
+#endif
+
+typedef struct {
+    int fd;                     /* -1 when closed */
+    char *ring;
+    size_t cap;
+    _Atomic size_t head;        /* bytes ever queued (producer) */
+    _Atomic size_t tail;        /* bytes ever written (writer) */
+    _Atomic bool stop;
+
+    pthread_t thread;
+    pthread_mutex_t lock;       /* only for sleeping and waking */
+    pthread_mutex_t produce;    /* one producer at a time: guards the fields below and head */
+    pthread_cond_t wake;
+
+    Buffer line;                /* producer scratch */
+    time_t ts_sec;              /* second the cached stamp is for */
+    char ts[32];
+
+    long lines, stalls;         /* stalls: ring full, producer waited */
+} AsyncLog;
+
+/* Open path for appending and start the writer; false leaves l closed
+   and every other call a no-op */
+bool alog_open(AsyncLog *l, const char *path);
+bool alog_is_open(const AsyncLog *l);
+
+/* One line "[YYYY-MM-DD HH:MM:SS] [tag] message\n"; tag may be NULL */
+void alog_line(AsyncLog *l, const char *tag, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+void alog_vline(AsyncLog *l, const char *tag, const char *fmt, va_list args);
+
+/* Text queued as is, for banners and multi-line records */
+void alog_printf(AsyncLog *l, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Current cached timestamp, refreshed at most once per second */
+const char *alog_timestamp(AsyncLog *l);
+
+/* Write out everything queued, stop the writer and close the file */
+void alog_close(AsyncLog *l);
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ * atomic_write.c - Crash-safe file replacement for the sandbox
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include "atomic_write.h"
+
+/* Preallocate big files in one extent instead of growing them write by write */
+#define AW_PREALLOC_MIN (1 << 20)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* Temp file names; shared so writers on different threads never pick the same one */
+static _Atomic unsigned long tmp_seq;
+
+void aw_init(AtomicWriter *w, FsyncPolicy policy) {
+    memset(w, 0, sizeof(*w));
+    w->policy = policy;
+}
+
+/* ---- Directory cache ---- */
+
+static bool dir_known(const AtomicWriter *w, const char *dir, size_t len) {
+    for (int i = 0; i < w->ndirs; i++) {
+        if (strlen(w->dirs[i]) == len && memcmp(w->dirs[i], dir, len) == 0) return true;
+    }
+    return false;
+}
+
+static void dir_remember(AtomicWriter *w, const char *dir, size_t len) {
+    if (w->ndirs == w->dirs_cap) {
+        int cap = w->dirs_cap ? w->dirs_cap * 2 : 16;
+        char **d = realloc(w->dirs, sizeof(*d) * (size_t)cap);
+        if (!d) return;             /* just means another mkdir next time */
+        w->dirs = d;
+        w->dirs_cap = cap;
+    }
+    char *copy = strndup(dir, len);
+    if (copy) w->dirs[w->ndirs++] = copy;
+}
+
+/* Forget path and everything under it */
+static void dir_forget(AtomicWriter *w, const char *path) {
+    size_t len = strlen(path);
+    for (int i = 0; i < w->ndirs; ) {
+        const char *d = w->dirs[i];
+        if (strncmp(d, path, len) == 0 && (d[len] == 0 || d[len] == '/')) {
+            free(w->dirs[i]);
+            w->dirs[i] = w->dirs[--w->ndirs];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void dir_forget_all(AtomicWriter *w) {
+    for (int i = 0; i < w->ndirs; i++) free(w->dirs[i]);
+    w->ndirs = 0;
+}
+
+bool aw_mkdirs(AtomicWriter *w, const char *path) {
+    const char *slash = strrchr(path, '/');
+    if (!slash || slash == path) return true;
+    size_t dlen = (size_t)(slash - path);
+    if (dir_known(w, path, dlen)) return true;
+
+    char tmp[PATH_MAX];
+    if (dlen >= sizeof(tmp)) return false;
+    memcpy(tmp, path, dlen);
+    tmp[dlen] = 0;
+
+    /* Walk every prefix, skipping the ones already seen */
+    for (char *p = tmp + 1; ; p++) {
+        if (*p != '/' && *p != 0) continue;
+        char c = *p;
+        *p = 0;
+        size_t len = (size_t)(p - tmp);
+        if (!dir_known(w, tmp, len)) {
+            if (mkdir(tmp, 0755) == 0) w->mkdirs++;
+            else if (errno != EEXIST) return false;
+            dir_remember(w, tmp, len);
+        }
+        if (!c) break;
+        *p = '/';
+    }
+    return true;
+}
+
+/* ---- Syncing ---- */
+
+static bool sync_dir(AtomicWriter *w, const char *dir) {
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    w->syncs++;
+    return ok;
+}
+
+static void parent_of(const char *path, char *dir, size_t sz) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        snprintf(dir, sz, ".");
+    } else {
+        size_t len = (size_t)(slash - path);
+        if (len == 0) len = 1;
+        snprintf(dir, sz, "%.*s", (int)len, path);
+    }
+}
+
+bool aw_flush(AtomicWriter *w) {
+    bool ok = true;
+    for (int i = 0; i < w->npending; i++) {
+        if (fsync(w->pending_fds[i]) != 0) ok = false;
+        close(w->pending_fds[i]);
+        w->syncs++;
+    }
+    for (int i = 0; i < w->npending_dirs; i++) {
+        if (!sync_dir(w, w->pending_dirs[i])) ok = false;
+        free(w->pending_dirs[i]);
+    }
+    w->npending = w->npending_dirs = 0;
+    return ok;
+}
+
+/* Called with a written file still open; takes ownership of fd */
+static bool finish(AtomicWriter *w, int fd, const char *path, bool renamed) {
+    char dir[PATH_MAX];
+    parent_of(path, dir, sizeof(dir));
+
+    if (w->policy == AW_FSYNC_EACH) {
+        close(fd);
+        return !renamed || sync_dir(w, dir);
+    }
+    if (w->policy != AW_FSYNC_BATCH) {
+        close(fd);
+        return true;
+    }
+
+    /* A replacement's data is already synced; only its directory waits */
+    if (renamed) {
+        close(fd);
+        for (int i = 0; i < w->npending_dirs; i++) {
+            if (strcmp(w->pending_dirs[i], dir) == 0) return true;
+        }
+        if (w->npending_dirs == AW_MAX_PENDING && !aw_flush(w)) return false;
+        char *copy = strdup(dir);
+        if (!copy) return sync_dir(w, dir);
+        w->pending_dirs[w->npending_dirs++] = copy;
+        return true;
+    }
+    if (w->npending == AW_MAX_PENDING && !aw_flush(w)) {
+        close(fd);
+        return false;
+    }
+    w->pending_fds[w->npending++] = fd;
+    return true;
+}
+
+void aw_free(AtomicWriter *w) {
+    aw_flush(w);
+    dir_forget_all(w);
+    free(w->dirs);
+    memset(w, 0, sizeof(*w));
+}
+
+/* ---- Writing ---- */
+
+static bool write_all(int fd, const struct iovec *iov, int count) {
+    struct iovec local[64];
+    while (count > 0) {
+        int n = count < IOV_MAX ? count : IOV_MAX;
+        if (n > 64) n = 64;
+        memcpy(local, iov, sizeof(*iov) * (size_t)n);
+
+        /* Retry until this group is out, resuming inside a piece */
+        struct iovec *v = local;
+        int left = n;
+        while (left > 0) {
+            ssize_t r = writev(fd, v, left);
+            if (r < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            size_t done = (size_t)r;
+            while (left > 0 && done >= v->iov_len) {
+                done -= v->iov_len;
+                v++;
+                left--;
+            }
+            if (left > 0) {
+                v->iov_base = (char *)v->iov_base + done;
+                v->iov_len -= done;
+            }
+        }
+        iov += n;
+        count -= n;
+    }
+    return true;
+}
+
+/* The hidden temp file next to path, created and open for writing */
+static int open_tmp(AtomicWriter *w, const char *path, char *tmp, size_t sz) {
+    const char *slash = strrchr(path, '/');
+    int dlen = slash ? (int)(slash - path) : 0;
+    const char *base = slash ? slash + 1 : path;
+    if (!*base) return -1;
+    if (snprintf(tmp, sz, "%.*s%s.%s.%ld.%lu.tmp", dlen, path, slash ? "/" : "",
+                 base, (long)getpid(), atomic_fetch_add(&tmp_seq, 1) + 1) >= (int)sz)
+        return -1;
+
+    if (!aw_mkdirs(w, path)) return -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == ENOENT) {
+        /* A cached directory was removed behind our back */
+        dir_forget_all(w);
+        if (!aw_mkdirs(w, path)) return -1;
+        fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) return -1;
+
+    /* Keep the permissions of the file being replaced */
+    struct stat st;
+    if (stat(path, &st) == 0) fchmod(fd, st.st_mode & 07777);
+    return fd;
+}
+
+/* Sync as the policy says, rename into place, hand fd on to finish().
+   Under either syncing policy the data is on disk before the rename, so
+   a crash never leaves the target short or empty. */
+static bool commit(AtomicWriter *w, int fd, const char *tmp, const char *path) {
+    bool ok = true;
+    if (w->policy != AW_FSYNC_NONE) {
+        ok = fsync(fd) == 0;
+        w->syncs++;
+    }
+    if (ok && rename(tmp, path) != 0) ok = false;
+    if (!ok) {
+        close(fd);
+        unlink(tmp);
+        return false;
+    }
+    w->writes++;
+    return finish(w, fd, path, true);
+}
+
+bool aw_writev(AtomicWriter *w, const char *path, const struct iovec *iov, int count) {
+    char tmp[PATH_MAX];
+    int fd = open_tmp(w, path, tmp, sizeof(tmp));
+    if (fd < 0) return false;
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) total += iov[i].iov_len;
+    if (total >= AW_PREALLOC_MIN) posix_fallocate(fd, 0, (off_t)total);
+
+    if (!write_all(fd, iov, count)) {
+        close(fd);
+        unlink(tmp);
+        return false;
+    }
+    return commit(w, fd, tmp, path);
+}
+
+bool aw_write(AtomicWriter *w, const char *path, const void *data, size_t len) {
+    struct iovec iov = { (void *)data, len };
+    return aw_writev(w, path, &iov, 1);
+}
+
+/* ---- Streamed replacement ---- */
+
+bool aw_stream_open(AtomicWriter *w, AwStream *s, const char *path) {
+    char tmp[PATH_MAX];
+    memset(s, 0, sizeof(*s));
+    s->fd = open_tmp(w, path, tmp, sizeof(tmp));
+    if (s->fd < 0) return false;
+    s->path = strdup(path);
+    s->tmp = strdup(tmp);
+    if (!s->path || !s->tmp) {
+        close(s->fd);
+        unlink(tmp);
+        free(s->path);
+        free(s->tmp);
+        s->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool aw_stream_writev(AwStream *s, const struct iovec *iov, int count) {
+    if (s->fd < 0 || !write_all(s->fd, iov, count)) return false;
+    for (int i = 0; i < count; i++) s->bytes += iov[i].iov_len;
+    return true;
+}
+
+bool aw_stream_commit(AtomicWriter *w, AwStream *s) {
+    if (s->fd < 0) return false;
+    bool ok = commit(w, s->fd, s->tmp, s->path);
+    s->fd = -1;
+    free(s->path);
+    free(s->tmp);
+    s->path = s->tmp = NULL;
+    return ok;
+}
+
+void aw_stream_abort(AwStream *s) {
+    if (s->fd >= 0) {
+        close(s->fd);
+        unlink(s->tmp);
+    }
+    free(s->path);
+    free(s->tmp);
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+}
+
+bool aw_append(AtomicWriter *w, const char *path, const void *data, size_t len) {
+    if (!aw_mkdirs(w, path)) return false;
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    struct iovec iov = { (void *)data, len };
+    bool ok = write_all(fd, &iov, 1);
+    if (ok && w->policy == AW_FSYNC_EACH) {
+        ok = fsync(fd) == 0;
+        w->syncs++;
+    }
+    if (!ok) {
+        close(fd);
+        return false;
+    }
+    w->writes++;
+    return finish(w, fd, path, false);
+}
+
+bool aw_remove(AtomicWriter *w, const char *path) {
+    if (remove(path) != 0) return false;
+    dir_forget(w, path);
+    if (w->policy == AW_FSYNC_EACH) {
+        char dir[PATH_MAX];
+        parent_of(path, dir, sizeof(dir));
+        sync_dir(w, dir);
+    }
+    return true;
+}
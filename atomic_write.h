@@ -0,0 +1,84 @@
+/*
+ * atomic_write.h - Crash-safe file replacement for the sandbox
+ *
+ * aw_write() writes into a hidden temp file next to the target and
+ * renames it into place, so readers see the old file or the new one,
+ * never a truncated mix. Parent directories are created on demand and
+ * remembered, so repeated writes into the same tree cost no mkdir calls.
+ *
+ * Durability is a policy:
+ *   AW_FSYNC_NONE   leave it to the kernel
+ *   AW_FSYNC_EACH   fsync the data before the rename and the directory after
+ *   AW_FSYNC_BATCH  fsync the data before the rename, as the rename must
+ *                   never reach the disk ahead of it; aw_flush() syncs the
+ *                   directories renamed into and the files appended to
+ *                   since the last flush in one go
+ *
+ * A replacement too big to hold in memory can be streamed: aw_stream_open()
+ * creates the temp file and keeps it open, any number of
+ * aw_stream_writev() calls add to it, and aw_stream_commit() renames it
+ * into place under the writer's policy. Until then the target is
+ * untouched; aw_stream_abort() just removes the temp file.
+ *
+ * A writer is used by one thread at a time; threads each keep their own.
+ */
+
+#ifndef ATOMIC_WRITE_H
+#define ATOMIC_WRITE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifndef AW_MAX_PENDING
+#define AW_MAX_PENDING  64      /* batch: appended files held open until aw_flush() */
+#endif
+
+typedef enum { AW_FSYNC_NONE, AW_FSYNC_EACH, AW_FSYNC_BATCH } FsyncPolicy;
+
+typedef struct {
+    FsyncPolicy policy;
+
+    char **dirs;                /* directories known to exist */
+    int ndirs, dirs_cap;
+
+    int pending_fds[AW_MAX_PENDING];
+    char *pending_dirs[AW_MAX_PENDING];
+    int npending, npending_dirs;
+
+    long writes, mkdirs, syncs;
+} AtomicWriter;
+
+void aw_init(AtomicWriter *w, FsyncPolicy policy);
+void aw_free(AtomicWriter *w);          /* flushes first */
+
+/* Replace path with the concatenation of the pieces */
+bool aw_writev(AtomicWriter *w, const char *path, const struct iovec *iov, int count);
+bool aw_write(AtomicWriter *w, const char *path, const void *data, size_t len);
+
+/* A replacement being streamed; fd is -1 when none is open */
+typedef struct {
+    int fd;
+    char *path, *tmp;
+    size_t bytes;
+} AwStream;
+
+bool aw_stream_open(AtomicWriter *w, AwStream *s, const char *path);
+bool aw_stream_writev(AwStream *s, const struct iovec *iov, int count);
+bool aw_stream_commit(AtomicWriter *w, AwStream *s);
+void aw_stream_abort(AwStream *s);
+
+/* Appends are not atomic, but follow the same fsync policy */
+bool aw_append(AtomicWriter *w, const char *path, const void *data, size_t len);
+
+/* remove() that also forgets a removed directory */
+bool aw_remove(AtomicWriter *w, const char *path);
+
+/* Create every missing directory above path */
+bool aw_mkdirs(AtomicWriter *w, const char *path);
+
+/* AW_FSYNC_BATCH: sync the directories and appended files written since
+   the last flush. A no-op under the other policies. */
+bool aw_flush(AtomicWriter *w);
+
+#endif
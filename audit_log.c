@@ -0,0 +1,224 @@
+/*
+ * audit_log.c - Append-only JSONL audit trail with a backward tail reader
+ */
+
+#define _GNU_SOURCE             /* memrchr, memmem */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "audit_log.h"
+#include "buffer.h"
+
+#define TAIL_BLOCK  65536
+
+static int open_append(const char *path, size_t *size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    *size = fd >= 0 && fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+    return fd;
+}
+
+bool audit_open(AuditLog *a, const char *path) {
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+    a->path = strdup(path);
+    if (!a->path) return false;
+    a->fd = open_append(path, &a->size);
+    return a->fd >= 0;
+}
+
+void audit_close(AuditLog *a) {
+    if (a->fd >= 0) close(a->fd);
+    free(a->path);
+    a->fd = -1;
+    a->path = NULL;
+}
+
+static void rotated_name(char *out, size_t sz, const char *path, int k) {
+    if (k == 0) snprintf(out, sz, "%s", path);
+    else snprintf(out, sz, "%s.%d", path, k);
+}
+
+/* path.(KEEP-1) -> path.KEEP ... path -> path.1, dropping the oldest */
+static void rotate(AuditLog *a) {
+    char from[1024], to[1024];
+    close(a->fd);
+    for (int k = AUDIT_KEEP - 1; k >= 0; k--) {
+        rotated_name(from, sizeof(from), a->path, k);
+        rotated_name(to, sizeof(to), a->path, k + 1);
+        rename(from, to);
+    }
+    a->fd = open_append(a->path, &a->size);
+    a->rotations++;
+}
+
+bool audit_write(AuditLog *a, const AuditRecord *r) {
+    if (a->fd < 0) return false;
+
+    char ts[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm);
+
+    cJSON *rec = cJSON_CreateObject();
+    cJSON_AddStringToObject(rec, "ts", ts);
+    cJSON_AddStringToObject(rec, "action", r->action ? r->action : "");
+    cJSON_AddStringToObject(rec, "path", r->path ? r->path : "");
+    cJSON_AddBoolToObject(rec, "confirmed", r->confirmed);
+    cJSON_AddStringToObject(rec, "result", r->result ? r->result : "");
+    if (r->input) cJSON_AddStringToObject(rec, "input", r->input);
+    if (r->response) {
+        /* Cut on a character boundary so the record stays valid UTF-8 */
+        char cut[AUDIT_RESPONSE_MAX + 1];
+        size_t n = strlen(r->response);
+        if (n > AUDIT_RESPONSE_MAX) {
+            n = AUDIT_RESPONSE_MAX;
+            while (n > 0 && ((unsigned char)r->response[n] & 0xC0) == 0x80) n--;
+        }
+        memcpy(cut, r->response, n);
+        cut[n] = 0;
+        cJSON_AddStringToObject(rec, "response", cut);
+    }
+    char *line = cJSON_PrintUnformatted(rec);
+    cJSON_Delete(rec);
+    if (!line) return false;
+
+    /* Strings are escaped, so the record is a single line */
+    size_t len = strlen(line);
+    line[len] = '\n';
+    if (a->size && a->size + len + 1 > AUDIT_MAX_BYTES) rotate(a);
+
+    bool ok = false;
+    if (a->fd >= 0) {
+        ssize_t n;
+        do n = write(a->fd, line, len + 1); while (n < 0 && errno == EINTR);
+        ok = n == (ssize_t)(len + 1);
+        if (n > 0) a->size += (size_t)n;
+    }
+    line[len] = 0;
+    cJSON_free(line);
+    if (ok) a->records++;
+    return ok;
+}
+
+/* Parse one line and apply the filters; NULL when it does not match */
+static cJSON *match(const char *line, size_t len, const char *action, const char *part) {
+    if (!len) return NULL;
+    /* Cheap rejects on the raw text first; plain strings appear verbatim */
+    if (action && !strpbrk(action, "\"\\") && !memmem(line, len, action, strlen(action)))
+        return NULL;
+    if (part && !strpbrk(part, "\"\\") && !memmem(line, len, part, strlen(part)))
+        return NULL;
+
+    cJSON *rec = cJSON_ParseWithLength(line, len);
+    if (!rec) return NULL;          /* torn last record */
+    const cJSON *a = cJSON_GetObjectItemCaseSensitive(rec, "action");
+    const cJSON *p = cJSON_GetObjectItemCaseSensitive(rec, "path");
+    bool ok = cJSON_IsString(a) && cJSON_IsString(p) &&
+              (!action || strcmp(a->valuestring, action) == 0) &&
+              (!part || strstr(p->valuestring, part));
+    if (!ok) { cJSON_Delete(rec); return NULL; }
+    return rec;
+}
+
+/* Scan one file from the end, adding matches newest first to out[] */
+static int tail_file(const char *name, int need, const char *action, const char *part,
+                     cJSON **out) {
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return 0; }
+
+    /* win holds file[pos .. pos + win.size), everything after is done;
+       it stays terminated, as the parser reads up to the NUL */
+    Buffer win = {0};
+    size_t pos = (size_t)st.st_size;
+    int found = 0;
+    while (found < need) {
+        char *nl = win.size ? memrchr(win.data, '\n', win.size) : NULL;
+        if (nl || (pos == 0 && win.size)) {
+            size_t start = nl ? (size_t)(nl - win.data) + 1 : 0;
+            cJSON *rec = match(win.data + start, win.size - start, action, part);
+            if (rec) out[found++] = rec;
+            win.size = nl ? (size_t)(nl - win.data) : 0;
+            win.data[win.size] = '\0';
+            continue;
+        }
+        if (pos == 0) break;
+
+        /* Prepend the block before the window */
+        size_t chunk = pos < TAIL_BLOCK ? pos : TAIL_BLOCK;
+        if (!buf_reserve(&win, chunk)) break;
+        memmove(win.data + chunk, win.data, win.size);
+        pos -= chunk;
+        if (pread(fd, win.data, chunk, (off_t)pos) != (ssize_t)chunk) break;
+        win.size += chunk;
+        win.data[win.size] = '\0';
+    }
+    buf_free(&win);
+    close(fd);
+    return found;
+}
+
+int audit_tail(const char *path, int count, const char *action, const char *path_part,
+               audit_fn fn, void *userdata) {
+    if (count <= 0) return 0;
+    cJSON **found = calloc((size_t)count, sizeof(*found));
+    if (!found) return 0;
+
+    int n = 0;
+    char name[1024];
+    for (int k = 0; k <= AUDIT_KEEP && n < count; k++) {
+        rotated_name(name, sizeof(name), path, k);
+        n += tail_file(name, count - n, action, path_part, found + n);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        fn(found[i], userdata);
+        cJSON_Delete(found[i]);
+    }
+    free(found);
+    return n;
+}
+
+static const char *str_field(const cJSON *rec, const char *key) {
+    const cJSON *v = cJSON_GetObjectItemCaseSensitive(rec, key);
+    return cJSON_IsString(v) ? v->valuestring : "";
+}
+
+void audit_print(const cJSON *rec, void *userdata) {
+    const cJSON *c = cJSON_GetObjectItemCaseSensitive(rec, "confirmed");
+    fprintf(userdata, "[%s] %-6s %s -> %s%s\n", str_field(rec, "ts"),
+            str_field(rec, "action"), str_field(rec, "path"), str_field(rec, "result"),
+            cJSON_IsTrue(c) ? " (confirmed)" : "");
+}
+
+static bool is_action(const char *s) {
+    static const char *const actions[] = { "list", "read", "write", "append", "delete" };
+    for (size_t i = 0; i < sizeof(actions) / sizeof(actions[0]); i++)
+        if (strcmp(s, actions[i]) == 0) return true;
+    return false;
+}
+
+/* Reads back from the end of the log, so the cost follows the entries
+   shown, not the log size */
+void audit_show(const char *path, char *args, FILE *out) {
+    int count = 50;
+    const char *action = NULL, *part = NULL;
+    char *save = NULL;
+    for (char *t = strtok_r(args, " ", &save); t; t = strtok_r(NULL, " ", &save)) {
+        if (t[0] >= '0' && t[0] <= '9') count = atoi(t);
+        else if (is_action(t)) action = t;
+        else part = t;
+    }
+
+    fprintf(out, "\n═══ Recent Audit Entries ═══\n");
+    if (!audit_tail(path, count, action, part, audit_print, out))
+        fprintf(out, "No matching entries.\n");
+    fprintf(out, "════════════════════════════\n\n");
+}
@@ -0,0 +1,68 @@
+/*
+ * audit_log.h - Append-only JSONL audit trail with a backward tail reader
+ *
+ * One record per line:
+ *   {"ts":"2024-01-01 12:00:00","action":"write","path":"a.txt",
+ *    "confirmed":true,"result":"...","input":"...","response":"..."}
+ * Each record goes out in a single O_APPEND write(), so a crash leaves
+ * at most one torn last line, which the reader skips.
+ *
+ * audit_tail() reads from the end of the file in blocks and stops once
+ * it has enough matching records, so showing the last few entries costs
+ * the same however long the log has grown. Past AUDIT_MAX_BYTES the file
+ * is rotated to .1, .2 ... .AUDIT_KEEP; the tail reader continues into
+ * the rotated files when the current one has too few matches.
+ */
+
+#ifndef AUDIT_LOG_H
+#define AUDIT_LOG_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cJSON.h"
+
+#ifndef AUDIT_MAX_BYTES
+#define AUDIT_MAX_BYTES  (8 << 20)
+#endif
+#ifndef AUDIT_KEEP
+#define AUDIT_KEEP       3          /* rotated files kept */
+#endif
+#define AUDIT_RESPONSE_MAX 200      /* bytes of the model response recorded */
+
+typedef struct {
+    int fd;                         /* -1 when closed */
+    char *path;
+    size_t size;
+    long records, rotations;
+} AuditLog;
+
+typedef struct {
+    const char *action;
+    const char *path;
+    const char *result;
+    const char *input;              /* user input, may be NULL */
+    const char *response;           /* model response, truncated; may be NULL */
+    bool confirmed;
+} AuditRecord;
+
+bool audit_open(AuditLog *a, const char *path);
+void audit_close(AuditLog *a);
+bool audit_write(AuditLog *a, const AuditRecord *r);
+
+/* Called oldest first with each record found */
+typedef void (*audit_fn)(const cJSON *rec, void *userdata);
+
+/* The newest count records whose action equals `action` and whose path
+   contains `path_part` (either may be NULL); returns how many were found */
+int audit_tail(const char *path, int count, const char *action, const char *path_part,
+               audit_fn fn, void *userdata);
+
+/* audit_fn printing "[ts] action path -> result" lines to the FILE * in userdata */
+void audit_print(const cJSON *rec, void *userdata);
+
+/* The agents' "logs [count] [action] [path]" command: args is split in
+   place, and the matching records are printed to out between rules */
+void audit_show(const char *path, char *args, FILE *out);
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ * bench.c - Micro-benchmarks for the agents' hot paths
+ *
+ * Compile: gcc -O2 -DHISTORY_SLOTS=256 bench.c cJSON.c repair.c chat_request.c history.c buffer.c mem_acct.c -o bench
+ * Run:     ./bench [--quick] [name-prefix] > bench.jsonl
+ *
+ * Prints one JSON object per measurement, so runs from two versions can
+ * be compared line by line:
+ *   {"bench":"cjson_parse","case":"response","bytes":65536,"ns_op":..,"mb_s":..}
+ * Each figure is the median of five batches, every batch long enough
+ * (BATCH_NS) to swamp the clock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "cJSON.h"
+#include "repair.h"
+#include "chat_request.h"
+#include "history.h"
+#include "buffer.h"
+
+#define BATCH_NS    20000000ull     /* 20 ms */
+#define BATCHES     5
+
+static bool g_quick;
+static const char *g_only;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Keeps results alive so the compiler cannot drop the work */
+static volatile size_t g_sink;
+
+typedef void (*bench_fn)(void *arg);
+
+/* Total ns for iters calls; setup(arg), if given, runs before every
+   call outside the timed region */
+static uint64_t run_batch(bench_fn fn, bench_fn setup, void *arg, uint64_t iters) {
+    if (!setup) {
+        uint64_t t = now_ns();
+        for (uint64_t i = 0; i < iters; i++) fn(arg);
+        return now_ns() - t;
+    }
+    uint64_t spent = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        setup(arg);
+        uint64_t t = now_ns();
+        fn(arg);
+        spent += now_ns() - t;
+    }
+    return spent;
+}
+
+/* Median ns per call of fn(arg) */
+static double measure(bench_fn fn, bench_fn setup, void *arg) {
+    uint64_t iters = 1, target = g_quick ? BATCH_NS / 10 : BATCH_NS;
+    while (run_batch(fn, setup, arg, iters) < target && iters < (1u << 24)) iters *= 2;
+
+    uint64_t runs[BATCHES];
+    int batches = g_quick ? 1 : BATCHES;
+    for (int b = 0; b < batches; b++) runs[b] = run_batch(fn, setup, arg, iters);
+    qsort(runs, (size_t)batches, sizeof(runs[0]), cmp_u64);
+    return (double)runs[batches / 2] / (double)iters;
+}
+
+static bool wanted(const char *name) {
+    return !g_only || strncmp(name, g_only, strlen(g_only)) == 0;
+}
+
+static void report(const char *bench, const char *cas, const char *param, size_t value,
+                   size_t bytes, double ns) {
+    printf("{\"bench\":\"%s\",\"case\":\"%s\",\"%s\":%zu,\"ns_op\":%.1f", bench, cas, param, value, ns);
+    if (bytes) printf(",\"mb_s\":%.1f", (double)bytes / ns * 1e9 / (1 << 20));
+    printf("}\n");
+    fflush(stdout);
+}
+
+/* ============================================================
+   TEST DATA
+   ============================================================ */
+
+/* Model output as it appears in a write command: HTML with the usual
+   quotes, newlines and indentation, `?` standing in for < and > */
+static void fake_content(Buffer *b, size_t size) {
+    static const char *const lines[] = {
+        "?div class=\"card\"?\n",
+        "  ?h2?Quarterly report?/h2?\n",
+        "  ?p?Revenue grew by 12% while costs stayed flat; see \"notes\".?/p?\n",
+        "  ?a href=\"/x?id=7\"?details?/a?\n",
+        "\tconst x = a ? b : c;\n",
+        "?/div?\n",
+    };
+    buf_reset(b);
+    for (size_t i = 0; b->size < size; i++) buf_puts(b, lines[i % 6]);
+    b->size = size;
+    b->data[size] = 0;
+}
+
+/* A non-streaming /api/chat reply whose content is a command carrying
+   about `size` bytes of file content */
+static char *fake_response(size_t size) {
+    Buffer content = {0};
+    fake_content(&content, size);
+    cJSON *cmd = cJSON_CreateObject();
+    cJSON_AddStringToObject(cmd, "action", "write");
+    cJSON_AddStringToObject(cmd, "path", "report.html");
+    cJSON_AddStringToObject(cmd, "content", content.data);
+    char *cmd_text = cJSON_PrintUnformatted(cmd);
+
+    cJSON *r = cJSON_CreateObject();
+    cJSON_AddStringToObject(r, "model", "qwen2.5-coder:7b");
+    cJSON_AddStringToObject(r, "created_at", "2024-01-01T00:00:00.000000Z");
+    cJSON *msg = cJSON_AddObjectToObject(r, "message");
+    cJSON_AddStringToObject(msg, "role", "assistant");
+    cJSON_AddStringToObject(msg, "content", cmd_text);
+    cJSON_AddStringToObject(r, "done_reason", "stop");
+    cJSON_AddTrueToObject(r, "done");
+    cJSON_AddNumberToObject(r, "total_duration", 5191566416.0);
+    cJSON_AddNumberToObject(r, "load_duration", 2154458.0);
+    cJSON_AddNumberToObject(r, "prompt_eval_count", 383);
+    cJSON_AddNumberToObject(r, "prompt_eval_duration", 383809000.0);
+    cJSON_AddNumberToObject(r, "eval_count", 298);
+    cJSON_AddNumberToObject(r, "eval_duration", 4799921000.0);
+    char *out = cJSON_PrintUnformatted(r);
+
+    cJSON_Delete(r);
+    cJSON_Delete(cmd);
+    cJSON_free(cmd_text);
+    buf_free(&content);
+    return out;
+}
+
+/* A request body with history adding up to about `size` bytes */
+static char *fake_request(size_t size) {
+    Buffer content = {0};
+    cJSON *req = cJSON_CreateObject();
+    cJSON_AddStringToObject(req, "model", "qwen2.5-coder:7b");
+    cJSON_AddFalseToObject(req, "stream");
+    cJSON_AddStringToObject(req, "format", "json");
+    cJSON *msgs = cJSON_AddArrayToObject(req, "messages");
+    size_t total = 0;
+    for (int i = 0; total < size; i++) {
+        size_t n = size - total < 2048 ? size - total : 2048;
+        fake_content(&content, n);
+        cJSON *m = cJSON_CreateObject();
+        cJSON_AddStringToObject(m, "role", i % 2 ? "assistant" : "user");
+        cJSON_AddStringToObject(m, "content", content.data);
+        cJSON_AddItemToArray(msgs, m);
+        total += n + 32;
+    }
+    char *out = cJSON_PrintUnformatted(req);
+    cJSON_Delete(req);
+    buf_free(&content);
+    return out;
+}
+
+/* ============================================================
+   cJSON
+   ============================================================ */
+
+typedef struct {
+    const char *text;
+    size_t len;
+    cJSON *tree;
+    cJSON_Arena arena;
+} JsonArg;
+
+static void do_parse(void *a) {
+    JsonArg *j = a;
+    cJSON *r = cJSON_ParseWithLength(j->text, j->len);
+    g_sink += r != NULL;
+    cJSON_Delete(r);
+}
+
+static void do_parse_arena(void *a) {
+    JsonArg *j = a;
+    g_sink += cJSON_ParseWithLengthInArena(&j->arena, j->text, j->len) != NULL;
+    cJSON_ArenaReset(&j->arena);
+}
+
+static void do_print(void *a) {
+    JsonArg *j = a;
+    char *out = cJSON_PrintUnformatted(j->tree);
+    g_sink += out ? strlen(out) : 0;
+    cJSON_free(out);
+}
+
+static void bench_cjson(void) {
+    static const size_t sizes[] = { 1 << 10, 4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20 };
+    for (int kind = 0; kind < 2; kind++) {
+        const char *cas = kind ? "request" : "response";
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            if (g_quick && sizes[i] > (64 << 10)) break;
+            char *text = kind ? fake_request(sizes[i]) : fake_response(sizes[i]);
+            JsonArg j = { text, strlen(text), cJSON_Parse(text), { 0 } };
+            cJSON_ArenaInit(&j.arena, 0);
+
+            if (wanted("cjson_parse"))
+                report("cjson_parse", cas, "bytes", j.len, j.len, measure(do_parse, NULL, &j));
+            if (wanted("cjson_parse_arena"))
+                report("cjson_parse_arena", cas, "bytes", j.len, j.len,
+                       measure(do_parse_arena, NULL, &j));
+            if (wanted("cjson_print"))
+                report("cjson_print", cas, "bytes", j.len, j.len, measure(do_print, NULL, &j));
+
+            cJSON_ArenaFree(&j.arena);
+            cJSON_Delete(j.tree);
+            cJSON_free(text);
+        }
+    }
+}
+
+/* ============================================================
+   HTML REPAIR
+   ============================================================ */
+
+typedef struct {
+    char *src, *work;
+    size_t len;
+} RepairArg;
+
+static void do_repair(void *a) {
+    RepairArg *r = a;
+    char *out = repair_html(r->src);
+    g_sink += out ? (size_t)out[0] : 0;
+    free(out);
+}
+
+static void reset_work(void *a) {
+    RepairArg *r = a;
+    memcpy(r->work, r->src, r->len + 1);
+}
+
+static void do_repair_inplace(void *a) {
+    RepairArg *r = a;
+    g_sink += repair_html_inplace(r->work, r->len);
+}
+
+static void do_repair_stream(void *a) {
+    RepairArg *r = a;
+    RepairStream rs;
+    repair_stream_init(&rs);
+    size_t j = 0;
+    /* Deltas the size Ollama streams: a few bytes each */
+    for (size_t i = 0; i < r->len; i += 16) {
+        size_t n = r->len - i < 16 ? r->len - i : 16;
+        j += repair_stream(&rs, r->src + i, n, r->work + j);
+    }
+    j += repair_stream_end(&rs, r->work + j);
+    g_sink += j;
+}
+
+static void bench_repair(void) {
+    /* ? per 10000 bytes */
+    static const int densities[] = { 0, 10, 100, 500, 2000 };
+    size_t len = g_quick ? (256 << 10) : (1 << 20);
+    RepairArg r = { malloc(len + 1), malloc(len + 2), len };
+    if (!r.src || !r.work) { free(r.src); free(r.work); return; }
+
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        /* Prose with tags spread evenly, from a fixed seed */
+        static const char prose[] = "the quick brown fox jumps over the lazy dog 0123456789 \"x\"\n";
+        unsigned seed = 12345;
+        for (size_t i = 0; i < len; i++) {
+            seed = seed * 1103515245u + 12345u;
+            r.src[i] = (int)((seed >> 8) % 10000) < densities[d] ? '?' : prose[i % (sizeof(prose) - 1)];
+        }
+        r.src[len] = 0;
+
+        if (wanted("repair_copy"))
+            report("repair_copy", "prose", "per_10k", (size_t)densities[d], len,
+                   measure(do_repair, NULL, &r));
+        if (wanted("repair_inplace"))
+            report("repair_inplace", "prose", "per_10k", (size_t)densities[d], len,
+                   measure(do_repair_inplace, reset_work, &r));
+        if (wanted("repair_stream"))
+            report("repair_stream", "16b_chunks", "per_10k", (size_t)densities[d], len,
+                   measure(do_repair_stream, NULL, &r));
+    }
+    free(r.src);
+    free(r.work);
+}
+
+/* ============================================================
+   REQUEST BUILD
+   ============================================================ */
+
+typedef struct {
+    History hist;
+    ChatRequest req;
+    char *prefix;
+    size_t prefix_len;
+    char *sys;
+    size_t sys_len;
+} BuildArg;
+
+/* What call_ollama does every turn */
+static void do_build_iov(void *a) {
+    BuildArg *b = a;
+    bool ok = chat_req_begin(&b->req, b->prefix, b->prefix_len) &&
+              chat_req_add(&b->req, b->sys, b->sys_len);
+    for (int i = 0; ok && i < b->hist.count; i++) {
+        Message *m = hist_at(&b->hist, i);
+        ok = chat_req_add(&b->req, m->json, m->json_len);
+    }
+    if (ok) chat_req_end(&b->req);
+    g_sink += b->req.total;
+}
+
+/* The old way, for comparison: a cJSON tree printed to one string */
+static void do_build_tree(void *a) {
+    BuildArg *b = a;
+    cJSON *req = cJSON_CreateObject();
+    cJSON_AddStringToObject(req, "model", "qwen2.5-coder:7b");
+    cJSON_AddFalseToObject(req, "stream");
+    cJSON_AddStringToObject(req, "format", "json");
+    cJSON *msgs = cJSON_AddArrayToObject(req, "messages");
+    for (int i = 0; i < b->hist.count; i++) {
+        Message *m = hist_at(&b->hist, i);
+        cJSON *o = cJSON_CreateObject();
+        cJSON_AddStringToObject(o, "role", m->role);
+        cJSON_AddStringToObject(o, "content", m->content);
+        cJSON_AddItemToArray(msgs, o);
+    }
+    char *out = cJSON_PrintUnformatted(req);
+    g_sink += out ? strlen(out) : 0;
+    cJSON_free(out);
+    cJSON_Delete(req);
+}
+
+static void bench_build(void) {
+    static const int counts[] = { 1, 10, 50, 100, 200 };
+    Buffer content = {0};
+    fake_content(&content, 600);
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        int n = counts[c] < HISTORY_SLOTS ? counts[c] : HISTORY_SLOTS;
+        BuildArg b = {0};
+        hist_init(&b.hist, n, 0);
+        b.prefix = chat_prefix_json("qwen2.5-coder:7b", false, "json", NULL);
+        b.prefix_len = strlen(b.prefix);
+        b.sys = chat_message_json("system", "You are a file assistant.", &b.sys_len);
+
+        uint64_t t = now_ns();
+        for (int i = 0; i < n; i++) hist_add(&b.hist, i % 2 ? "assistant" : "user", content.data);
+        double add_ns = (double)(now_ns() - t) / n;
+
+        if (wanted("hist_add"))
+            report("hist_add", "600b", "messages", (size_t)n, 0, add_ns);
+        if (wanted("request_build_iov"))
+            report("request_build_iov", "600b", "messages", (size_t)n, 0,
+                   measure(do_build_iov, NULL, &b));
+        if (wanted("request_build_tree"))
+            report("request_build_tree", "600b", "messages", (size_t)n, 0,
+                   measure(do_build_tree, NULL, &b));
+
+        hist_clear(&b.hist);
+        chat_req_free(&b.req);
+        cJSON_free(b.prefix);
+        cJSON_free(b.sys);
+    }
+    buf_free(&content);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) g_quick = true;
+        else g_only = argv[i];
+    }
+
+    printf("{\"bench\":\"meta\",\"compiler\":\"%s\",\"quick\":%s,\"history_slots\":%d}\n",
+           __VERSION__, g_quick ? "true" : "false", HISTORY_SLOTS);
+    bench_cjson();
+    bench_repair();
+    bench_build();
+    return 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * buffer.c - Growable byte buffer shared by the agents
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include "buffer.h"
+#include "mem_acct.h"
+
+#define BUF_MIN_CAP  256
+
+bool buf_reserve(Buffer *b, size_t extra) {
+    size_t need = b->size + extra + 1;
+    if (need < extra) return false;             /* overflow */
+    if (need <= b->cap) return true;
+
+    size_t cap = b->cap ? b->cap : BUF_MIN_CAP;
+    while (cap < need) {
+        if (cap > (size_t)-1 / 2) { cap = need; break; }
+        cap *= 2;
+    }
+
+    /* Keep the old block on failure so the caller still owns it */
+    char *d = realloc(b->data, cap);
+    if (!d) return false;
+    mem_add(MEM_IO, (long)cap - (long)b->cap);
+    b->data = d;
+    b->cap = cap;
+    return true;
+}
+
+bool buf_append(Buffer *b, const void *p, size_t len) {
+    if (!buf_reserve(b, len)) return false;
+    memcpy(b->data + b->size, p, len);
+    b->size += len;
+    b->data[b->size] = 0;
+    return true;
+}
+
+bool buf_puts(Buffer *b, const char *s) {
+    return buf_append(b, s, strlen(s));
+}
+
+bool buf_printf(Buffer *b, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    bool ok = buf_vprintf(b, fmt, args);
+    va_end(args);
+    return ok;
+}
+
+bool buf_vprintf(Buffer *b, const char *fmt, va_list args) {
+    va_list again;
+    if (!buf_reserve(b, 0)) return false;
+
+    va_copy(again, args);
+    int n = vsnprintf(b->data + b->size, b->cap - b->size, fmt, args);
+    if (n >= 0 && (size_t)n >= b->cap - b->size) {
+        if (buf_reserve(b, (size_t)n))
+            vsnprintf(b->data + b->size, b->cap - b->size, fmt, again);
+        else
+            n = -1;
+    }
+    va_end(again);
+    if (n < 0) {
+        b->data[b->size] = 0;
+        return false;
+    }
+    b->size += (size_t)n;
+    return true;
+}
+
+void buf_reset(Buffer *b) {
+    b->size = 0;
+    if (b->data) b->data[0] = 0;
+}
+
+void buf_free(Buffer *b) {
+    mem_add(MEM_IO, -(long)b->cap);
+    free(b->data);
+    b->data = NULL;
+    b->size = b->cap = 0;
+}
+
+char *buf_take(Buffer *b) {
+    char *d = b->data;
+    mem_add(MEM_IO, -(long)b->cap);
+    memset(b, 0, sizeof(*b));
+    return d;
+}
+
+size_t buf_curl_write(void *p, size_t sz, size_t n, void *userdata) {
+    size_t len = sz * n;
+    return buf_append(userdata, p, len) ? len : 0;
+}
+
+size_t buf_curl_header(char *p, size_t sz, size_t n, void *userdata) {
+    size_t len = sz * n;
+    static const char key[] = "Content-Length:";
+
+    if (len > sizeof(key) - 1 && strncasecmp(p, key, sizeof(key) - 1) == 0) {
+        char tmp[32];
+        size_t vlen = len - (sizeof(key) - 1);
+        if (vlen >= sizeof(tmp)) vlen = sizeof(tmp) - 1;
+        memcpy(tmp, p + sizeof(key) - 1, vlen);
+        tmp[vlen] = 0;
+
+        char *end;
+        unsigned long long cl = strtoull(tmp, &end, 10);
+        /* Advisory only: a failed reserve just means growing later */
+        if (end != tmp && cl > 0 && cl < ((size_t)-1 >> 1))
+            buf_reserve(userdata, (size_t)cl);
+    }
+    return len;
+}
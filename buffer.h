@@ -0,0 +1,43 @@
+/*
+ * buffer.h - Growable byte buffer shared by the agents
+ *
+ * Capacity grows geometrically, so appending n bytes in small chunks
+ * costs O(log n) reallocations. The data is always NUL-terminated.
+ * buf_reset() rewinds to empty but keeps the allocation, so a static
+ * Buffer can be reused every turn without touching malloc.
+ */
+
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+typedef struct {
+    char *data;
+    size_t size;        /* bytes in use, excluding the terminator */
+    size_t cap;         /* bytes allocated */
+} Buffer;
+
+/* Make room for `extra` more bytes plus the terminator */
+bool buf_reserve(Buffer *b, size_t extra);
+bool buf_append(Buffer *b, const void *p, size_t len);
+bool buf_puts(Buffer *b, const char *s);
+bool buf_printf(Buffer *b, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+bool buf_vprintf(Buffer *b, const char *fmt, va_list args);
+
+void buf_reset(Buffer *b);
+void buf_free(Buffer *b);
+
+/* The data, for the caller to free(); the buffer is left empty. Its
+   bytes stop counting as MEM_IO (see mem_acct.h) from here on. */
+char *buf_take(Buffer *b);
+
+/* libcurl callbacks: append the body to the Buffer in userdata, and
+   pre-size it from the Content-Length header when the server sends one */
+size_t buf_curl_write(void *p, size_t sz, size_t n, void *userdata);
+size_t buf_curl_header(char *p, size_t sz, size_t n, void *userdata);
+
+#endif
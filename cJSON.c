@@ -6,6 +6,7 @@
 */
 
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
@@ -15,10 +16,27 @@
 
 #include "cJSON.h"
 
+/* Vector string scanning; build with -DCJSON_NO_SIMD for the plain loops */
+#if !defined(CJSON_NO_SIMD) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#define CJSON_SIMD_X86 1
+#elif !defined(CJSON_NO_SIMD) && defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CJSON_SIMD_NEON 1
+#endif
+
 /* ---- Memory management ---- */
 static void *(*global_malloc)(size_t sz) = malloc;
 static void (*global_free)(void *ptr) = free;
 
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define CJSON_TLS _Thread_local
+#elif defined(__GNUC__)
+#define CJSON_TLS __thread
+#else
+#define CJSON_TLS
+#endif
+
 void cJSON_InitHooks(cJSON_Hooks* hooks) {
     if (!hooks) {
         global_malloc = malloc;
@@ -29,9 +47,100 @@ void cJSON_InitHooks(cJSON_Hooks* hooks) {
     global_free = hooks->free_fn ? hooks->free_fn : free;
 }
 
+/* ---- Arena ---- */
+#define ARENA_ALIGN         8
+#define ARENA_DEFAULT_BLOCK 16384
+
+struct cJSON_ArenaBlock {
+    struct cJSON_ArenaBlock *next;
+    size_t used;
+    size_t cap;
+    double data[];              /* aligned for any cJSON field */
+};
+
+static CJSON_TLS cJSON_Arena *active_arena = NULL;
+
+void cJSON_ArenaInit(cJSON_Arena *arena, size_t block_size) {
+    arena->head = arena->current = NULL;
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+}
+
+void cJSON_ArenaReset(cJSON_Arena *arena) {
+    for (cJSON_ArenaBlock *b = arena->head; b; b = b->next) b->used = 0;
+    arena->current = arena->head;
+}
+
+void cJSON_ArenaFree(cJSON_Arena *arena) {
+    cJSON_ArenaBlock *b = arena->head;
+    while (b) {
+        cJSON_ArenaBlock *next = b->next;
+        global_free(b);
+        b = next;
+    }
+    arena->head = arena->current = NULL;
+    if (active_arena == arena) active_arena = NULL;
+}
+
+cJSON_Arena *cJSON_SetArena(cJSON_Arena *arena) {
+    cJSON_Arena *prev = active_arena;
+    active_arena = arena;
+    return prev;
+}
+
+static void *arena_alloc(cJSON_Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    
+    /* After a reset the chain is reused front to back */
+    cJSON_ArenaBlock *b = arena->current;
+    while (b && b->cap - b->used < size) b = b->next;
+    
+    if (!b) {
+        size_t cap = size > arena->block_size ? size : arena->block_size;
+        b = (cJSON_ArenaBlock *)global_malloc(sizeof(cJSON_ArenaBlock) + cap);
+        if (!b) return NULL;
+        b->used = 0;
+        b->cap = cap;
+        b->next = NULL;
+        /* Append at the tail so blocks keep their order across resets */
+        if (!arena->head) {
+            arena->head = b;
+        } else {
+            cJSON_ArenaBlock *t = arena->current ? arena->current : arena->head;
+            while (t->next) t = t->next;
+            t->next = b;
+        }
+    }
+    
+    arena->current = b;
+    void *p = (char *)b->data + b->used;
+    b->used += size;
+    return p;
+}
+
+/* Allocation for nodes and strings: the active arena, else the heap */
+static void *cjson_alloc(size_t size) {
+    return active_arena ? arena_alloc(active_arena, size) : global_malloc(size);
+}
+
+static char *cjson_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)cjson_alloc(len);
+    if (copy) memcpy(copy, str, len);
+    return copy;
+}
+
+/* Change the value type, keeping the allocation flag */
+#define set_type(item, t) ((item)->type = ((item)->type & cJSON_InArena) | (t))
+
 static cJSON *cJSON_New_Item(void) {
-    cJSON *node = (cJSON *)global_malloc(sizeof(cJSON));
-    if (node) memset(node, 0, sizeof(cJSON));
+    cJSON *node = (cJSON *)cjson_alloc(sizeof(cJSON));
+    if (node) {
+        memset(node, 0, sizeof(cJSON));
+        if (active_arena) {
+            node->type = cJSON_InArena;
+            node->arena = active_arena;
+        }
+    }
     return node;
 }
 
@@ -42,23 +151,31 @@ void cJSON_Delete(cJSON *item) {
         if (!(item->type & cJSON_IsReference) && item->child) {
             cJSON_Delete(item->child);
         }
-        if (!(item->type & cJSON_IsReference) && item->valuestring) {
-            global_free(item->valuestring);
-        }
-        if (!(item->type & cJSON_StringIsConst) && item->string) {
-            global_free(item->string);
+        if (!(item->type & cJSON_InArena)) {
+            if (!(item->type & cJSON_IsReference) && item->valuestring) {
+                global_free(item->valuestring);
+            }
+            if (!(item->type & cJSON_StringIsConst) && item->string) {
+                global_free(item->string);
+            }
+            global_free(item->index);
+            global_free(item);
         }
-        global_free(item);
         item = next;
     }
 }
 
+void *cJSON_malloc(size_t size) {
+    return global_malloc(size);
+}
+
 void cJSON_free(void *object) {
     global_free(object);
 }
 
 /* ---- Error handling ---- */
-static const char *global_error = NULL;
+/* Per thread, like the active arena, so parsers on other threads do not race */
+static CJSON_TLS const char *global_error = NULL;
 
 const char *cJSON_GetErrorPtr(void) {
     return global_error;
@@ -115,6 +232,55 @@ static unsigned char *ensure(char **buffer, size_t needed, size_t *length) {
     return (unsigned char *)*buffer;
 }
 
+/* ---- String scanning ---- */
+static int is_special(unsigned char c) {
+    return c == '\"' || c == '\\' || c < 32;
+}
+
+/* Length of the leading run of p[0..n) that has no quote, backslash or
+   control byte. Strings are mostly such runs, so they are located 16-32
+   bytes at a time and copied in bulk. Never loads past p + n. */
+static size_t plain_run(const unsigned char *p, size_t n) {
+    size_t i = 0;
+#if defined(CJSON_SIMD_X86) && defined(__AVX2__)
+    const __m256i q32 = _mm256_set1_epi8('\"');
+    const __m256i b32 = _mm256_set1_epi8('\\');
+    const __m256i c32 = _mm256_set1_epi8(31);
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, q32), _mm256_cmpeq_epi8(v, b32)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(v, c32), v));
+        unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+    }
+#endif
+#if defined(CJSON_SIMD_X86)
+    const __m128i q = _mm_set1_epi8('\"');
+    const __m128i b = _mm_set1_epi8('\\');
+    const __m128i c = _mm_set1_epi8(31);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, q), _mm_cmpeq_epi8(v, b)),
+            _mm_cmpeq_epi8(_mm_min_epu8(v, c), v));
+        unsigned bits = (unsigned)_mm_movemask_epi8(m);
+        if (bits) return i + (size_t)__builtin_ctz(bits);
+    }
+#elif defined(CJSON_SIMD_NEON)
+    const uint8x16_t q = vdupq_n_u8('\"');
+    const uint8x16_t b = vdupq_n_u8('\\');
+    const uint8x16_t c = vdupq_n_u8(32);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, q), vceqq_u8(v, b)), vcltq_u8(v, c));
+        if (vmaxvq_u8(m)) break;        /* the scalar loop pins it down */
+    }
+#endif
+    while (i < n && !is_special(p[i])) i++;
+    return i;
+}
+
 /* ---- Parse string ---- */
 static int parse_string(cJSON *item, parse_buffer *buffer) {
     const unsigned char *input = buffer_at_offset(buffer);
@@ -132,6 +298,13 @@ static int parse_string(cJSON *item, parse_buffer *buffer) {
     
     /* Find end of string and count length */
     while (*input != '\"') {
+        size_t avail = buffer->offset < buffer->length ? buffer->length - buffer->offset : 0;
+        size_t run = plain_run(input, avail);
+        input += run;
+        buffer->offset += run;
+        len += run;
+        if (*input == '\"') break;
+        
         if (*input == '\0') {
             global_error = "Unterminated string";
             return 0;
@@ -144,36 +317,40 @@ static int parse_string(cJSON *item, parse_buffer *buffer) {
         buffer->offset++;
         len++;
     }
+    const unsigned char *end = input;
     
     /* Allocate output */
-    char *output = (char *)global_malloc(len + 1);
+    char *output = (char *)cjson_alloc(len + 1);
     if (!output) return 0;
     
-    /* Copy and unescape */
+    /* Copy and unescape; everything between escapes is copied as is */
     input = start;
     size_t out_idx = 0;
-    while (*input != '\"') {
-        if (*input == '\\') {
-            input++;
-            switch (*input) {
-                case 'b': output[out_idx++] = '\b'; break;
-                case 'f': output[out_idx++] = '\f'; break;
-                case 'n': output[out_idx++] = '\n'; break;
-                case 'r': output[out_idx++] = '\r'; break;
-                case 't': output[out_idx++] = '\t'; break;
-                case '\"': case '\\': case '/':
-                    output[out_idx++] = *input;
-                    break;
-                case 'u':
-                    /* Skip unicode escapes for simplicity */
-                    output[out_idx++] = '?';
-                    input += 4;
-                    break;
-                default:
-                    output[out_idx++] = *input;
-            }
-        } else {
-            output[out_idx++] = *input;
+    while (input < end) {
+        const unsigned char *esc = memchr(input, '\\', (size_t)(end - input));
+        size_t run = (size_t)((esc ? esc : end) - input);
+        memcpy(output + out_idx, input, run);
+        out_idx += run;
+        input += run;
+        if (input == end) break;
+        
+        input++;
+        switch (*input) {
+            case 'b': output[out_idx++] = '\b'; break;
+            case 'f': output[out_idx++] = '\f'; break;
+            case 'n': output[out_idx++] = '\n'; break;
+            case 'r': output[out_idx++] = '\r'; break;
+            case 't': output[out_idx++] = '\t'; break;
+            case '\"': case '\\': case '/':
+                output[out_idx++] = *input;
+                break;
+            case 'u':
+                /* Skip unicode escapes for simplicity */
+                output[out_idx++] = '?';
+                input += 4;
+                break;
+            default:
+                output[out_idx++] = *input;
         }
         input++;
     }
@@ -181,7 +358,7 @@ static int parse_string(cJSON *item, parse_buffer *buffer) {
     
     buffer->offset++;  /* Skip closing quote */
     
-    item->type = cJSON_String;
+    set_type(item, cJSON_String);
     item->valuestring = output;
     
     return 1;
@@ -202,7 +379,7 @@ static int parse_number(cJSON *item, parse_buffer *buffer) {
     
     item->valuedouble = number;
     item->valueint = (int)number;
-    item->type = cJSON_Number;
+    set_type(item, cJSON_Number);
     
     buffer->offset += (size_t)(end - start);
     return 1;
@@ -226,7 +403,7 @@ static int parse_object(cJSON *item, parse_buffer *buffer) {
     
     if (can_access_at_index(buffer, 0) && *buffer_at_offset(buffer) == '}') {
         buffer->offset++;
-        item->type = cJSON_Object;
+        set_type(item, cJSON_Object);
         return 1;
     }
     
@@ -249,7 +426,7 @@ static int parse_object(cJSON *item, parse_buffer *buffer) {
         if (!parse_string(new_item, buffer)) goto fail;
         new_item->string = new_item->valuestring;
         new_item->valuestring = NULL;
-        new_item->type = cJSON_Invalid;
+        set_type(new_item, cJSON_Invalid);
         
         skip_whitespace(buffer);
         
@@ -275,7 +452,8 @@ static int parse_object(cJSON *item, parse_buffer *buffer) {
     }
     buffer->offset++;
     
-    item->type = cJSON_Object;
+    set_type(item, cJSON_Object);
+    head->prev = current;
     item->child = head;
     return 1;
     
@@ -298,7 +476,7 @@ static int parse_array(cJSON *item, parse_buffer *buffer) {
     
     if (can_access_at_index(buffer, 0) && *buffer_at_offset(buffer) == ']') {
         buffer->offset++;
-        item->type = cJSON_Array;
+        set_type(item, cJSON_Array);
         return 1;
     }
     
@@ -330,7 +508,8 @@ static int parse_array(cJSON *item, parse_buffer *buffer) {
     }
     buffer->offset++;
     
-    item->type = cJSON_Array;
+    set_type(item, cJSON_Array);
+    head->prev = current;
     item->child = head;
     return 1;
     
@@ -355,17 +534,17 @@ static int parse_value(cJSON *item, parse_buffer *buffer) {
     
     /* Check value type */
     if (can_read(buffer, 4) && strncmp((const char *)buffer_at_offset(buffer), "null", 4) == 0) {
-        item->type = cJSON_NULL;
+        set_type(item, cJSON_NULL);
         buffer->offset += 4;
         return 1;
     }
     if (can_read(buffer, 5) && strncmp((const char *)buffer_at_offset(buffer), "false", 5) == 0) {
-        item->type = cJSON_False;
+        set_type(item, cJSON_False);
         buffer->offset += 5;
         return 1;
     }
     if (can_read(buffer, 4) && strncmp((const char *)buffer_at_offset(buffer), "true", 4) == 0) {
-        item->type = cJSON_True;
+        set_type(item, cJSON_True);
         buffer->offset += 4;
         return 1;
     }
@@ -421,11 +600,98 @@ cJSON *cJSON_Parse(const char *value) {
     return cJSON_ParseWithLength(value, value ? strlen(value) : 0);
 }
 
+cJSON *cJSON_ParseWithLengthInArena(cJSON_Arena *arena, const char *value, size_t length) {
+    cJSON_Arena *prev = cJSON_SetArena(arena);
+    cJSON *item = cJSON_ParseWithLength(value, length);
+    cJSON_SetArena(prev);
+    return item;
+}
+
+cJSON *cJSON_ParseInArena(cJSON_Arena *arena, const char *value) {
+    return cJSON_ParseWithLengthInArena(arena, value, value ? strlen(value) : 0);
+}
+
 /* ---- Object/Array access ---- */
+
+/* Below this many children a linear scan is as fast as hashing */
+#define INDEX_MIN_CHILDREN 16
+
+struct cJSON_Index {
+    int count;
+    unsigned mask;              /* slots - 1, or 0 for arrays */
+    cJSON **items;              /* children in order */
+    cJSON **slots;              /* open addressing, NULL when free */
+    unsigned *hashes;
+};
+
+/* FNV-1a over ASCII-folded bytes, so it serves either kind of compare */
+unsigned cJSON_HashKey(const char *string) {
+    unsigned h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)string; *p; p++) {
+        unsigned char c = *p;
+        if (c >= 'A' && c <= 'Z') c |= 0x20;
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+static void free_index(cJSON *item) {
+    if (item->index && !(item->type & cJSON_InArena)) global_free(item->index);
+    item->index = NULL;
+}
+
+void cJSON_InvalidateIndex(cJSON *item) {
+    if (item) free_index(item);
+}
+
+/* An arena container's index comes from its own arena, so it is reset
+   with the tree whichever arena is active when the lookup runs */
+static cJSON_Index *build_index(cJSON *item) {
+    int count = 0;
+    for (cJSON *c = item->child; c; c = c->next) count++;
+    
+    /* Keys use a table at most half full */
+    size_t nslots = 0;
+    if ((item->type & 0xFF) == cJSON_Object) {
+        nslots = 16;
+        while (nslots < (size_t)count * 2) nslots *= 2;
+    }
+    
+    size_t size = sizeof(cJSON_Index) + sizeof(cJSON *) * ((size_t)count + nslots) +
+                  sizeof(unsigned) * nslots;
+    cJSON_Index *ix = (item->type & cJSON_InArena) ? arena_alloc(item->arena, size)
+                                                   : global_malloc(size);
+    if (!ix) return NULL;
+    
+    ix->count = count;
+    ix->mask = nslots ? (unsigned)(nslots - 1) : 0;
+    ix->items = (cJSON **)(ix + 1);
+    ix->slots = ix->items + count;
+    ix->hashes = (unsigned *)(ix->slots + nslots);
+    memset(ix->slots, 0, sizeof(cJSON *) * nslots);
+    
+    int i = 0;
+    for (cJSON *c = item->child; c; c = c->next) {
+        ix->items[i++] = c;
+        if (!nslots || !c->string) continue;
+        /* Linear probing keeps duplicates in insertion order, so the
+           first matching key still wins as with the plain scan */
+        unsigned h = cJSON_HashKey(c->string);
+        unsigned slot = h & ix->mask;
+        while (ix->slots[slot]) slot = (slot + 1) & ix->mask;
+        ix->slots[slot] = c;
+        ix->hashes[slot] = h;
+    }
+    
+    item->index = ix;
+    return ix;
+}
+
 int cJSON_GetArraySize(const cJSON *array) {
     cJSON *child;
     int size = 0;
     if (!array) return 0;
+    if (array->index) return array->index->count;
     child = array->child;
     while (child) {
         size++;
@@ -437,6 +703,11 @@ int cJSON_GetArraySize(const cJSON *array) {
 cJSON *cJSON_GetArrayItem(const cJSON *array, int index) {
     cJSON *child;
     if (!array || index < 0) return NULL;
+    
+    cJSON_Index *ix = array->index;
+    if (!ix && index >= INDEX_MIN_CHILDREN) ix = build_index((cJSON *)array);
+    if (ix) return index < ix->count ? ix->items[index] : NULL;
+    
     child = array->child;
     while (child && index > 0) {
         child = child->next;
@@ -445,30 +716,56 @@ cJSON *cJSON_GetArrayItem(const cJSON *array, int index) {
     return child;
 }
 
-cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
-    cJSON *child;
-    if (!object || !string) return NULL;
-    child = object->child;
-    while (child) {
-        if (child->string && strcasecmp(child->string, string) == 0) {
-            return child;
+static int key_equal(const char *a, const char *b, int case_sensitive) {
+    return case_sensitive ? strcmp(a, b) == 0 : strcasecmp(a, b) == 0;
+}
+
+/* hash is only needed once the object has an index; pass NULL to have it
+   computed on demand */
+static cJSON *find_key(const cJSON *object, const char *string, const unsigned *hash,
+                       int case_sensitive) {
+    cJSON_Index *ix = object->index;
+    
+    if (!ix) {
+        /* Scan the first few children; only bigger objects get an index */
+        cJSON *child = object->child;
+        int n = 0;
+        for (; child && n < INDEX_MIN_CHILDREN; child = child->next, n++) {
+            if (child->string && key_equal(child->string, string, case_sensitive)) return child;
+        }
+        if (!child) return NULL;
+        
+        ix = build_index((cJSON *)object);
+        if (!ix) {
+            for (; child; child = child->next) {
+                if (child->string && key_equal(child->string, string, case_sensitive)) return child;
+            }
+            return NULL;
         }
-        child = child->next;
+    }
+    
+    if (!ix->mask) return NULL;     /* an array has no keys */
+    unsigned h = hash ? *hash : cJSON_HashKey(string);
+    for (unsigned slot = h & ix->mask; ix->slots[slot]; slot = (slot + 1) & ix->mask) {
+        if (ix->hashes[slot] == h && key_equal(ix->slots[slot]->string, string, case_sensitive))
+            return ix->slots[slot];
     }
     return NULL;
 }
 
+cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string) {
+    if (!object || !string) return NULL;
+    return find_key(object, string, NULL, 0);
+}
+
+cJSON *cJSON_GetObjectItemWithHash(const cJSON *object, const char *string, unsigned hash) {
+    if (!object || !string) return NULL;
+    return find_key(object, string, &hash, 0);
+}
+
 cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string) {
-    cJSON *child;
     if (!object || !string) return NULL;
-    child = object->child;
-    while (child) {
-        if (child->string && strcmp(child->string, string) == 0) {
-            return child;
-        }
-        child = child->next;
-    }
-    return NULL;
+    return find_key(object, string, NULL, 1);
 }
 
 int cJSON_HasObjectItem(const cJSON *object, const char *string) {
@@ -478,32 +775,32 @@ int cJSON_HasObjectItem(const cJSON *object, const char *string) {
 /* ---- Create items ---- */
 cJSON *cJSON_CreateNull(void) {
     cJSON *item = cJSON_New_Item();
-    if (item) item->type = cJSON_NULL;
+    if (item) set_type(item, cJSON_NULL);
     return item;
 }
 
 cJSON *cJSON_CreateTrue(void) {
     cJSON *item = cJSON_New_Item();
-    if (item) item->type = cJSON_True;
+    if (item) set_type(item, cJSON_True);
     return item;
 }
 
 cJSON *cJSON_CreateFalse(void) {
     cJSON *item = cJSON_New_Item();
-    if (item) item->type = cJSON_False;
+    if (item) set_type(item, cJSON_False);
     return item;
 }
 
 cJSON *cJSON_CreateBool(int boolean) {
     cJSON *item = cJSON_New_Item();
-    if (item) item->type = boolean ? cJSON_True : cJSON_False;
+    if (item) set_type(item, boolean ? cJSON_True : cJSON_False);
     return item;
 }
 
 cJSON *cJSON_CreateNumber(double num) {
     cJSON *item = cJSON_New_Item();
     if (item) {
-        item->type = cJSON_Number;
+        set_type(item, cJSON_Number);
         item->valuedouble = num;
         item->valueint = (int)num;
     }
@@ -513,8 +810,8 @@ cJSON *cJSON_CreateNumber(double num) {
 cJSON *cJSON_CreateString(const char *string) {
     cJSON *item = cJSON_New_Item();
     if (item) {
-        item->type = cJSON_String;
-        item->valuestring = string ? strdup(string) : NULL;
+        set_type(item, cJSON_String);
+        item->valuestring = string ? cjson_strdup(string) : NULL;
         if (string && !item->valuestring) {
             cJSON_Delete(item);
             return NULL;
@@ -526,36 +823,62 @@ cJSON *cJSON_CreateString(const char *string) {
 cJSON *cJSON_CreateRaw(const char *raw) {
     cJSON *item = cJSON_New_Item();
     if (item) {
-        item->type = cJSON_Raw;
-        item->valuestring = raw ? strdup(raw) : NULL;
+        set_type(item, cJSON_Raw);
+        item->valuestring = raw ? cjson_strdup(raw) : NULL;
     }
     return item;
 }
 
 cJSON *cJSON_CreateArray(void) {
     cJSON *item = cJSON_New_Item();
-    if (item) item->type = cJSON_Array;
+    if (item) set_type(item, cJSON_Array);
     return item;
 }
 
 cJSON *cJSON_CreateObject(void) {
     cJSON *item = cJSON_New_Item();
-    if (item) item->type = cJSON_Object;
+    if (item) set_type(item, cJSON_Object);
+    return item;
+}
+
+cJSON *cJSON_CreateObjectInArena(cJSON_Arena *arena) {
+    cJSON_Arena *prev = cJSON_SetArena(arena);
+    cJSON *item = cJSON_CreateObject();
+    cJSON_SetArena(prev);
+    return item;
+}
+
+cJSON *cJSON_CreateArrayInArena(cJSON_Arena *arena) {
+    cJSON_Arena *prev = cJSON_SetArena(arena);
+    cJSON *item = cJSON_CreateArray();
+    cJSON_SetArena(prev);
+    return item;
+}
+
+cJSON *cJSON_CreateStringInArena(cJSON_Arena *arena, const char *string) {
+    cJSON_Arena *prev = cJSON_SetArena(arena);
+    cJSON *item = cJSON_CreateString(string);
+    cJSON_SetArena(prev);
     return item;
 }
 
 /* ---- Add to array/object ---- */
+/* The first child's prev points at the last one, so appends are O(1) */
 static int add_item_to_array(cJSON *array, cJSON *item) {
     if (!array || !item) return 0;
     
+    free_index(array);
     cJSON *child = array->child;
     if (!child) {
         array->child = item;
+        item->prev = item;
     } else {
-        while (child->next) child = child->next;
-        child->next = item;
-        item->prev = child;
+        cJSON *last = child->prev;
+        last->next = item;
+        item->prev = last;
+        child->prev = item;
     }
+    item->next = NULL;
     return 1;
 }
 
@@ -563,6 +886,32 @@ int cJSON_AddItemToArray(cJSON *array, cJSON *item) {
     return add_item_to_array(array, item);
 }
 
+int cJSON_AddItemsToArray(cJSON *array, cJSON *const *items, int count) {
+    if (!array || (count > 0 && !items)) return 0;
+    for (int i = 0; i < count; i++) {
+        if (!items[i]) return 0;
+    }
+    if (count <= 0) return 1;
+    
+    /* Link the new run first, then splice it on after the current tail */
+    for (int i = 0; i < count; i++) {
+        items[i]->prev = i ? items[i - 1] : NULL;
+        items[i]->next = i + 1 < count ? items[i + 1] : NULL;
+    }
+    
+    free_index(array);
+    cJSON *first = array->child;
+    if (!first) {
+        array->child = items[0];
+    } else {
+        cJSON *last = first->prev;
+        last->next = items[0];
+        items[0]->prev = last;
+    }
+    array->child->prev = items[count - 1];
+    return 1;
+}
+
 static int add_item_to_object(cJSON *object, const char *string, cJSON *item, int constant_key) {
     if (!object || !string || !item) return 0;
     
@@ -570,7 +919,12 @@ static int add_item_to_object(cJSON *object, const char *string, cJSON *item, in
         item->string = (char *)string;
         item->type |= cJSON_StringIsConst;
     } else {
-        item->string = strdup(string);
+        /* The key is freed along with the item, so it comes from the
+           same place: the item's arena, else the heap */
+        size_t len = strlen(string) + 1;
+        item->string = (item->type & cJSON_InArena) ? arena_alloc(item->arena, len)
+                                                    : global_malloc(len);
+        if (item->string) memcpy(item->string, string, len);
         if (!item->string) return 0;
     }
     
@@ -678,29 +1032,63 @@ static int ensure_buffer(printbuffer *p, size_t needed) {
     return 1;
 }
 
+/* Bytes str takes once escaped, without the quotes */
+static size_t escaped_len(const unsigned char *p, size_t len) {
+    const unsigned char *end = p + len;
+    size_t out = 0;
+    while (p < end) {
+        size_t run = plain_run(p, (size_t)(end - p));
+        out += run;
+        p += run;
+        if (p == end) break;
+        unsigned char c = *p++;
+        out += (c == '\"' || c == '\\' || c == '\b' || c == '\f' || c == '\n' || c == '\r' ||
+                c == '\t') ? 2 : 6;
+    }
+    return out;
+}
+
+/* Past this a string is measured first instead of reserving six bytes
+   for each of its bytes, which would keep a file as twelve times itself */
+#define PRINT_MEASURE_LEN 4096
+
 static int print_string_ptr(const char *str, printbuffer *buffer) {
+    static const char hex[] = "0123456789abcdef";
     if (!str) str = "";
     
     size_t len = strlen(str);
-    if (!ensure_buffer(buffer, len * 6 + 3)) return 0;
+    size_t room = len < PRINT_MEASURE_LEN ? len * 6 : escaped_len((const unsigned char *)str, len);
+    if (!ensure_buffer(buffer, room + 3)) return 0;
     
     char *output = buffer->buffer + buffer->offset;
     *output++ = '\"';
     
-    for (const char *p = str; *p; p++) {
-        unsigned char c = *p;
-        if (c == '\"') { *output++ = '\\'; *output++ = '\"'; }
-        else if (c == '\\') { *output++ = '\\'; *output++ = '\\'; }
-        else if (c == '\b') { *output++ = '\\'; *output++ = 'b'; }
-        else if (c == '\f') { *output++ = '\\'; *output++ = 'f'; }
-        else if (c == '\n') { *output++ = '\\'; *output++ = 'n'; }
-        else if (c == '\r') { *output++ = '\\'; *output++ = 'r'; }
-        else if (c == '\t') { *output++ = '\\'; *output++ = 't'; }
-        else if (c < 32) {
-            sprintf(output, "\\u%04x", c);
-            output += 6;
+    const unsigned char *p = (const unsigned char *)str;
+    const unsigned char *end = p + len;
+    while (p < end) {
+        size_t run = plain_run(p, (size_t)(end - p));
+        memcpy(output, p, run);
+        output += run;
+        p += run;
+        if (p == end) break;
+        
+        unsigned char c = *p++;
+        *output++ = '\\';
+        switch (c) {
+            case '\"': *output++ = '\"'; break;
+            case '\\': *output++ = '\\'; break;
+            case '\b': *output++ = 'b'; break;
+            case '\f': *output++ = 'f'; break;
+            case '\n': *output++ = 'n'; break;
+            case '\r': *output++ = 'r'; break;
+            case '\t': *output++ = 't'; break;
+            default:
+                *output++ = 'u';
+                *output++ = '0';
+                *output++ = '0';
+                *output++ = hex[c >> 4];
+                *output++ = hex[c & 15];
         }
-        else { *output++ = c; }
     }
     
     *output++ = '\"';
@@ -832,6 +1220,19 @@ char *cJSON_PrintUnformatted(const cJSON *item) {
         return NULL;
     }
     
+    /* The buffer grows by doubling; a large result that left a quarter
+       or more unused is handed back as a tight copy, since callers such
+       as the history keep it */
+    if (buffer.length > PRINT_MEASURE_LEN && buffer.length - buffer.offset > buffer.length / 4) {
+        char *tight = (char *)global_malloc(buffer.offset + 1);
+        if (tight) {
+            memcpy(tight, buffer.buffer, buffer.offset);
+            tight[buffer.offset] = '\0';
+            global_free(buffer.buffer);
+            buffer.buffer = tight;
+        }
+    }
+    
     return buffer.buffer;
 }
 
@@ -858,7 +1259,7 @@ cJSON *cJSON_Duplicate(const cJSON *item, int recurse) {
 int cJSON_Compare(const cJSON *a, const cJSON *b, int case_sensitive) {
     (void)case_sensitive;
     if (!a || !b) return 0;
-    if (a->type != b->type) return 0;
+    if ((a->type & 0xFF) != (b->type & 0xFF)) return 0;
     return 1;  /* Simplified comparison */
 }
 
@@ -34,6 +34,10 @@ extern "C" {
 
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+#define cJSON_InArena 1024          /* node, key and value live in a cJSON_Arena */
+
+/* Lookup index for large arrays and objects, see cJSON_GetObjectItem */
+typedef struct cJSON_Index cJSON_Index;
 
 /* The cJSON structure */
 typedef struct cJSON {
@@ -45,6 +49,8 @@ typedef struct cJSON {
     int valueint;
     double valuedouble;
     char *string;
+    cJSON_Index *index;     /* lazily built by lookups, NULL when stale */
+    struct cJSON_Arena *arena;  /* owner of a cJSON_InArena node */
 } cJSON;
 
 typedef struct cJSON_Hooks {
@@ -55,6 +61,33 @@ typedef struct cJSON_Hooks {
 /* Supply malloc/free functions */
 extern void cJSON_InitHooks(cJSON_Hooks* hooks);
 
+/* Arena allocation: nodes, keys and value strings are bump-allocated from
+   a chain of blocks and released all at once by cJSON_ArenaReset().
+   cJSON_Delete() on an arena tree frees nothing; just reset the arena.
+   Each arena node records its arena, so the keys and lookup indexes
+   added to it later come from the same arena whichever is active. */
+typedef struct cJSON_ArenaBlock cJSON_ArenaBlock;
+
+typedef struct cJSON_Arena {
+    cJSON_ArenaBlock *head;
+    cJSON_ArenaBlock *current;
+    size_t block_size;
+} cJSON_Arena;
+
+extern void cJSON_ArenaInit(cJSON_Arena *arena, size_t block_size);
+/* Rewind every block; keeps the memory for the next round */
+extern void cJSON_ArenaReset(cJSON_Arena *arena);
+extern void cJSON_ArenaFree(cJSON_Arena *arena);
+/* Route all following cJSON allocations on this thread to arena (NULL
+   for the heap). Returns the previously active arena. */
+extern cJSON_Arena *cJSON_SetArena(cJSON_Arena *arena);
+
+extern cJSON *cJSON_ParseInArena(cJSON_Arena *arena, const char *value);
+extern cJSON *cJSON_ParseWithLengthInArena(cJSON_Arena *arena, const char *value, size_t buffer_length);
+extern cJSON *cJSON_CreateObjectInArena(cJSON_Arena *arena);
+extern cJSON *cJSON_CreateArrayInArena(cJSON_Arena *arena);
+extern cJSON *cJSON_CreateStringInArena(cJSON_Arena *arena, const char *string);
+
 /* Parse JSON */
 extern cJSON *cJSON_Parse(const char *value);
 extern cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length);
@@ -75,6 +108,18 @@ extern cJSON *cJSON_GetObjectItem(const cJSON *object, const char *string);
 extern cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *object, const char *string);
 extern int cJSON_HasObjectItem(const cJSON *object, const char *string);
 
+/* Containers with more than a handful of children get a hash index on
+   their first lookup, making key and index access O(1). Adding items
+   drops it; code that relinks child lists by hand must call
+   cJSON_InvalidateIndex. Lookups build the index, so concurrent readers
+   of one tree need a lock. */
+extern void cJSON_InvalidateIndex(cJSON *item);
+
+/* Key lookup with the hash precomputed by cJSON_HashKey(), for keys that
+   are looked up over and over. Case-insensitive like GetObjectItem. */
+extern unsigned cJSON_HashKey(const char *string);
+extern cJSON *cJSON_GetObjectItemWithHash(const cJSON *object, const char *string, unsigned hash);
+
 /* Type checking */
 extern int cJSON_IsInvalid(const cJSON *item);
 extern int cJSON_IsFalse(const cJSON *item);
@@ -105,7 +150,10 @@ extern cJSON *cJSON_CreateDoubleArray(const double *numbers, int count);
 extern cJSON *cJSON_CreateStringArray(const char *const *strings, int count);
 
 /* Append to arrays/objects */
+/* Appends are O(1): the first child's prev points at the last child */
 extern int cJSON_AddItemToArray(cJSON *array, cJSON *item);
+/* Append count unlinked items in one pass; fails without changes if any is NULL */
+extern int cJSON_AddItemsToArray(cJSON *array, cJSON *const *items, int count);
 extern int cJSON_AddItemToObject(cJSON *object, const char *string, cJSON *item);
 extern int cJSON_AddItemToObjectCS(cJSON *object, const char *string, cJSON *item);
 
@@ -127,6 +175,7 @@ extern cJSON *cJSON_Duplicate(const cJSON *item, int recurse);
 extern int cJSON_Compare(const cJSON *a, const cJSON *b, int case_sensitive);
 
 /* Memory */
+extern void *cJSON_malloc(size_t size);
 extern void cJSON_free(void *object);
 
 #ifdef __cplusplus
@@ -0,0 +1,81 @@
+/*
+ * chat_request.c - /api/chat request body as a scatter list
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "chat_request.h"
+
+static const char MESSAGES_OPEN[] = ",\"messages\":[";
+
+char *chat_prefix_json(const char *model, bool stream, const char *format,
+                       const char *keep_alive) {
+    cJSON *req = cJSON_CreateObject();
+    if (!req) return NULL;
+    cJSON_AddStringToObject(req, "model", model);
+    cJSON_AddBoolToObject(req, "stream", stream);
+    if (format) cJSON_AddStringToObject(req, "format", format);
+    if (keep_alive) cJSON_AddStringToObject(req, "keep_alive", keep_alive);
+
+    char *head = cJSON_PrintUnformatted(req);
+    cJSON_Delete(req);
+    if (!head) return NULL;
+
+    /* Swap the closing brace for the opening of the messages array */
+    size_t len = strlen(head);
+    char *out = cJSON_malloc(len + sizeof(MESSAGES_OPEN));
+    if (out) {
+        memcpy(out, head, len - 1);
+        memcpy(out + len - 1, MESSAGES_OPEN, sizeof(MESSAGES_OPEN));
+    }
+    cJSON_free(head);
+    return out;
+}
+
+char *chat_message_json(const char *role, const char *content, size_t *len_out) {
+    cJSON *m = cJSON_CreateObject();
+    if (!m) return NULL;
+    cJSON_AddStringToObject(m, "role", role);
+    cJSON_AddStringToObject(m, "content", content);
+    char *json = cJSON_PrintUnformatted(m);
+    cJSON_Delete(m);
+    if (json && len_out) *len_out = strlen(json);
+    return json;
+}
+
+static bool push(ChatRequest *r, const char *p, size_t len) {
+    if (r->count == r->cap) {
+        int cap = r->cap ? r->cap * 2 : 32;
+        struct iovec *iov = realloc(r->iov, sizeof(*iov) * (size_t)cap);
+        if (!iov) return false;
+        r->iov = iov;
+        r->cap = cap;
+    }
+    r->iov[r->count].iov_base = (void *)p;
+    r->iov[r->count].iov_len = len;
+    r->count++;
+    r->total += len;
+    return true;
+}
+
+bool chat_req_begin(ChatRequest *r, const char *prefix, size_t len) {
+    r->count = 0;
+    r->messages = 0;
+    r->total = 0;
+    return push(r, prefix, len);
+}
+
+bool chat_req_add(ChatRequest *r, const char *msg_json, size_t len) {
+    if (r->messages++ && !push(r, ",", 1)) return false;
+    return push(r, msg_json, len);
+}
+
+bool chat_req_end(ChatRequest *r) {
+    return push(r, "]}", 2);
+}
+
+void chat_req_free(ChatRequest *r) {
+    free(r->iov);
+    memset(r, 0, sizeof(*r));
+}
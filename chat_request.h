@@ -0,0 +1,39 @@
+/*
+ * chat_request.h - /api/chat request body as a scatter list
+ *
+ * Each history message is serialized to {"role":..,"content":..} once,
+ * when it is added to the conversation, and that text is reused on every
+ * later turn. A request is then an iovec list of the fixed prefix, the
+ * cached messages and the suffix, sent by libcurl without being joined.
+ */
+
+#ifndef CHAT_REQUEST_H
+#define CHAT_REQUEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+typedef struct {
+    struct iovec *iov;
+    int count, cap;
+    int messages;
+    size_t total;           /* body length in bytes */
+} ChatRequest;
+
+/* {"model":..,"stream":..,"format":..,"keep_alive":..,"messages":[
+   format and keep_alive are left out when NULL (free with cJSON_free) */
+char *chat_prefix_json(const char *model, bool stream, const char *format,
+                       const char *keep_alive);
+
+/* {"role":..,"content":..} escaped exactly as cJSON prints it
+   (free with cJSON_free) */
+char *chat_message_json(const char *role, const char *content, size_t *len_out);
+
+/* The pieces are referenced, not copied, and must outlive the request */
+bool chat_req_begin(ChatRequest *r, const char *prefix, size_t len);
+bool chat_req_add(ChatRequest *r, const char *msg_json, size_t len);
+bool chat_req_end(ChatRequest *r);
+void chat_req_free(ChatRequest *r);
+
+#endif
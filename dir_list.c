@@ -0,0 +1,161 @@
+/*
+ * dir_list.c - Directory listings as structured entries
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "dir_list.h"
+
+/* While walking, names are offsets into l->names (it may move) */
+#define NAME_OFF(e) ((size_t)(e)->name)
+
+static bool push(DirList *l, const char *prefix, const char *name, const struct stat *st,
+                 unsigned char type, int depth) {
+    if (l->count == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 64;
+        DirEntry *items = realloc(l->items, sizeof(*items) * (size_t)cap);
+        if (!items) return false;
+        l->items = items;
+        l->cap = cap;
+    }
+    size_t off = l->names.size;
+    if (prefix[0] && (!buf_puts(&l->names, prefix) || !buf_append(&l->names, "/", 1)))
+        return false;
+    if (!buf_append(&l->names, name, strlen(name) + 1)) return false;
+
+    DirEntry *e = &l->items[l->count++];
+    e->name = (const char *)off;
+    e->type = type;
+    e->depth = depth;
+    e->size = st ? st->st_size : 0;
+    e->mtime = st ? st->st_mtime : 0;
+    return true;
+}
+
+static unsigned char mode_type(mode_t m) {
+    if (S_ISDIR(m)) return DT_DIR;
+    if (S_ISREG(m)) return DT_REG;
+    if (S_ISLNK(m)) return DT_LNK;
+    return DT_UNKNOWN;
+}
+
+/* Takes ownership of fd. prefix is the path of this directory relative
+   to the root ("" at the top). */
+static bool walk(DirList *l, int fd, const char *prefix, int depth, const DirListOpts *o) {
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return false;
+    }
+
+    struct dirent *de;
+    bool ok = true;
+    while (ok && (de = readdir(d))) {
+        const char *n = de->d_name;
+        if (n[0] == '.' && (!o->hidden || n[1] == 0 || (n[1] == '.' && n[2] == 0))) continue;
+        if (o->max_entries && l->count >= o->max_entries) {
+            l->truncated = true;
+            break;
+        }
+
+        /* Symlinks are listed, never followed */
+        struct stat st;
+        bool have = fstatat(dirfd(d), n, &st, AT_SYMLINK_NOFOLLOW) == 0;
+        unsigned char type = have ? mode_type(st.st_mode) : de->d_type;
+        ok = push(l, prefix, n, have ? &st : NULL, type, depth);
+
+        if (ok && type == DT_DIR && depth < o->max_depth) {
+            int sub = openat(dirfd(d), n, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (sub >= 0) {
+                char path[4096];
+                snprintf(path, sizeof(path), "%s%s%s", prefix, prefix[0] ? "/" : "", n);
+                /* An unreadable subdirectory is listed but not entered */
+                walk(l, sub, path, depth + 1, o);
+            }
+        }
+    }
+    closedir(d);
+    return ok;
+}
+
+static int by_name(const void *a, const void *b) {
+    return strcmp(((const DirEntry *)a)->name, ((const DirEntry *)b)->name);
+}
+
+static int by_mtime(const void *a, const void *b) {
+    const DirEntry *x = a, *y = b;
+    if (x->mtime != y->mtime) return x->mtime < y->mtime ? 1 : -1;     /* newest first */
+    return by_name(a, b);
+}
+
+static int by_size(const void *a, const void *b) {
+    const DirEntry *x = a, *y = b;
+    if (x->size != y->size) return x->size < y->size ? 1 : -1;         /* largest first */
+    return by_name(a, b);
+}
+
+bool dl_read(DirList *l, const char *path, const DirListOpts *opts) {
+    DirListOpts o = opts ? *opts : DL_OPTS_DEFAULT;
+    memset(l, 0, sizeof(*l));
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = walk(l, fd, "", 0, &o);
+
+    /* The name pool is final now: turn offsets into pointers */
+    for (int i = 0; i < l->count; i++)
+        l->items[i].name = l->names.data + NAME_OFF(&l->items[i]);
+
+    if (!ok) {
+        dl_free(l);
+        return false;
+    }
+    if (o.sort == DL_SORT_NAME) qsort(l->items, (size_t)l->count, sizeof(DirEntry), by_name);
+    else if (o.sort == DL_SORT_MTIME) qsort(l->items, (size_t)l->count, sizeof(DirEntry), by_mtime);
+    else if (o.sort == DL_SORT_SIZE) qsort(l->items, (size_t)l->count, sizeof(DirEntry), by_size);
+    return true;
+}
+
+void dl_free(DirList *l) {
+    free(l->items);
+    buf_free(&l->names);
+    memset(l, 0, sizeof(*l));
+}
+
+static void human_size(off_t n, char *out, size_t sz) {
+    if (n < 1024) snprintf(out, sz, "%lld B", (long long)n);
+    else if (n < 1024 * 1024) snprintf(out, sz, "%.1f KB", n / 1024.0);
+    else if (n < 1024LL * 1024 * 1024) snprintf(out, sz, "%.1f MB", n / (1024.0 * 1024));
+    else snprintf(out, sz, "%.1f GB", n / (1024.0 * 1024 * 1024));
+}
+
+int dl_format(const DirList *l, int first, int limit, Buffer *out) {
+    if (first < 0) first = 0;
+    int last = limit > 0 && first + limit < l->count ? first + limit : l->count;
+
+    int n = 0;
+    for (int i = first; i < last; i++, n++) {
+        const DirEntry *e = &l->items[i];
+        char when[32] = "", size[32] = "";
+        struct tm tm;
+        if (e->mtime && localtime_r(&e->mtime, &tm)) strftime(when, sizeof(when), "%Y-%m-%d %H:%M", &tm);
+
+        if (e->type == DT_DIR) {
+            snprintf(size, sizeof(size), "dir");
+        } else if (e->type == DT_LNK) {
+            snprintf(size, sizeof(size), "link");
+        } else {
+            human_size(e->size, size, sizeof(size));
+        }
+        int pad = 40 - (int)strlen(e->name) - (e->type == DT_DIR);
+        if (!buf_printf(out, "  %s%s%*s %9s  %s\n", e->name, e->type == DT_DIR ? "/" : "",
+                        pad > 0 ? pad : 0, "", size, when))
+            break;
+    }
+    return n;
+}
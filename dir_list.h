@@ -0,0 +1,55 @@
+/*
+ * dir_list.h - Directory listings as structured entries
+ *
+ * Walks a directory (optionally recursively, to a depth limit) with
+ * readdir + fstatat relative to the open directory, collecting name,
+ * type, size and mtime for every entry. Storage grows as needed, so a
+ * directory of any size is listed whole; dl_format() renders one page
+ * of it for the prompt.
+ */
+
+#ifndef DIR_LIST_H
+#define DIR_LIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include "buffer.h"
+
+typedef enum { DL_SORT_NONE, DL_SORT_NAME, DL_SORT_MTIME, DL_SORT_SIZE } DirSort;
+
+typedef struct {
+    int max_depth;          /* 0 lists only the directory itself */
+    int max_entries;        /* stop the walk here, 0 for no limit */
+    DirSort sort;
+    bool hidden;            /* include dot files */
+} DirListOpts;
+
+typedef struct {
+    const char *name;       /* relative to the listed directory */
+    unsigned char type;     /* DT_REG, DT_DIR, DT_LNK, ... */
+    int depth;
+    off_t size;
+    time_t mtime;
+} DirEntry;
+
+typedef struct {
+    DirEntry *items;
+    int count, cap;
+    Buffer names;           /* NUL-separated names backing items[].name */
+    bool truncated;         /* max_entries was reached */
+} DirList;
+
+/* Defaults: this directory only, sorted by name, no dot files */
+#define DL_OPTS_DEFAULT ((DirListOpts){ 0, 0, DL_SORT_NAME, false })
+
+bool dl_read(DirList *l, const char *path, const DirListOpts *opts);
+void dl_free(DirList *l);
+
+/* Appends entries [first, first + limit) as aligned text lines, one per
+   entry with a trailing / on directories. limit 0 means all. Returns
+   how many were written. */
+int dl_format(const DirList *l, int first, int limit, Buffer *out);
+
+#endif
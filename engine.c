@@ -0,0 +1,190 @@
+/*
+ * engine.c - Many sessions' model requests over one curl_multi handle
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+
+static void push(EngineReq **head, EngineReq **tail, EngineReq *r) {
+    r->next = NULL;
+    if (*tail) (*tail)->next = r;
+    else *head = r;
+    *tail = r;
+}
+
+static EngineReq *pop(EngineReq **head, EngineReq **tail) {
+    EngineReq *r = *head;
+    if (r) {
+        *head = r->next;
+        if (!*head) *tail = NULL;
+        r->next = NULL;
+    }
+    return r;
+}
+
+/* Transfer over: hand the request to a worker */
+static void finish(Engine *e, EngineReq *r, CURLcode res) {
+    r->result = http_conn_done(r->conn, res);
+    pthread_mutex_lock(&e->lock);
+    e->in_flight--;
+    e->completed++;
+    if (res != CURLE_OK) e->failed++;
+    push(&e->ready, &e->ready_tail, r);
+    pthread_cond_signal(&e->work);
+    pthread_mutex_unlock(&e->lock);
+}
+
+/* Only this thread touches the multi handle, apart from curl_multi_wakeup() */
+static void *io_main(void *arg) {
+    Engine *e = arg;
+    for (;;) {
+        /* Free slots go to the oldest waiting requests */
+        EngineReq *start = NULL, *start_tail = NULL;
+        pthread_mutex_lock(&e->lock);
+        if (e->stop) { pthread_mutex_unlock(&e->lock); break; }
+        uint64_t now = lat_now_us();
+        while (e->waiting && e->in_flight < e->max_in_flight) {
+            EngineReq *r = pop(&e->waiting, &e->waiting_tail);
+            e->nwaiting--;
+            e->in_flight++;
+            lat_record(&e->queue_wait, now - r->queued_us);
+            push(&start, &start_tail, r);
+        }
+        if (e->in_flight > e->peak_in_flight) e->peak_in_flight = e->in_flight;
+        pthread_mutex_unlock(&e->lock);
+
+        while (start) {
+            EngineReq *r = pop(&start, &start_tail);
+            if (curl_multi_add_handle(e->multi, r->conn->curl) != CURLM_OK)
+                finish(e, r, CURLE_FAILED_INIT);
+        }
+
+        int running, left;
+        curl_multi_perform(e->multi, &running);
+        CURLMsg *m;
+        while ((m = curl_multi_info_read(e->multi, &left))) {
+            if (m->msg != CURLMSG_DONE) continue;
+            /* Copy out before the message is invalidated by the removal */
+            CURL *h = m->easy_handle;
+            CURLcode res = m->data.result;
+            EngineReq *r = NULL;
+            curl_easy_getinfo(h, CURLINFO_PRIVATE, (char **)&r);
+            curl_multi_remove_handle(e->multi, h);
+            if (r) finish(e, r, res);
+        }
+        curl_multi_poll(e->multi, NULL, 0, 1000, NULL);
+    }
+    return NULL;
+}
+
+static void *worker_main(void *arg) {
+    Engine *e = arg;
+    pthread_mutex_lock(&e->lock);
+    for (;;) {
+        while (!e->ready && !e->stop) pthread_cond_wait(&e->work, &e->lock);
+        if (e->stop) break;
+        EngineReq *r = pop(&e->ready, &e->ready_tail);
+        pthread_mutex_unlock(&e->lock);
+
+        r->done(r);
+
+        pthread_mutex_lock(&e->lock);
+        if (--e->active == 0) pthread_cond_broadcast(&e->idle);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return NULL;
+}
+
+bool engine_start(Engine *e, int workers, int max_in_flight) {
+    memset(e, 0, sizeof(*e));
+    e->max_in_flight = max_in_flight > 0 ? max_in_flight : 1;
+    e->multi = curl_multi_init();
+    if (!e->multi) return false;
+    /* Keep an idle connection per slot so every session's next turn reuses one */
+    curl_multi_setopt(e->multi, CURLMOPT_MAXCONNECTS, (long)e->max_in_flight);
+
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->work, NULL);
+    pthread_cond_init(&e->idle, NULL);
+
+    if (workers < 1) workers = 1;
+    e->workers = calloc((size_t)workers, sizeof(*e->workers));
+    if (!e->workers || pthread_create(&e->io, NULL, io_main, e) != 0) {
+        free(e->workers);
+        curl_multi_cleanup(e->multi);
+        e->multi = NULL;
+        return false;
+    }
+    for (; e->nworkers < workers; e->nworkers++)
+        if (pthread_create(&e->workers[e->nworkers], NULL, worker_main, e) != 0) break;
+    if (!e->nworkers) { engine_stop(e); return false; }
+    return true;
+}
+
+void engine_submit(Engine *e, EngineReq *r) {
+    curl_easy_setopt(r->conn->curl, CURLOPT_PRIVATE, (char *)r);
+    r->queued_us = lat_now_us();
+    pthread_mutex_lock(&e->lock);
+    push(&e->waiting, &e->waiting_tail, r);
+    if (++e->nwaiting > e->peak_waiting) e->peak_waiting = e->nwaiting;
+    e->active++;
+    e->submitted++;
+    pthread_mutex_unlock(&e->lock);
+    curl_multi_wakeup(e->multi);
+}
+
+void engine_post(Engine *e, EngineReq *r) {
+    r->result = CURLE_OK;
+    r->queued_us = lat_now_us();
+    pthread_mutex_lock(&e->lock);
+    push(&e->ready, &e->ready_tail, r);
+    e->active++;
+    e->posted++;
+    pthread_cond_signal(&e->work);
+    pthread_mutex_unlock(&e->lock);
+}
+
+void engine_wait(Engine *e) {
+    pthread_mutex_lock(&e->lock);
+    while (e->active > 0) pthread_cond_wait(&e->idle, &e->lock);
+    pthread_mutex_unlock(&e->lock);
+}
+
+void engine_stop(Engine *e) {
+    if (!e->multi) return;
+    pthread_mutex_lock(&e->lock);
+    e->stop = true;
+    pthread_cond_broadcast(&e->work);
+    pthread_mutex_unlock(&e->lock);
+    curl_multi_wakeup(e->multi);
+
+    pthread_join(e->io, NULL);
+    for (int i = 0; i < e->nworkers; i++) pthread_join(e->workers[i], NULL);
+
+#if LIBCURL_VERSION_NUM >= 0x080400
+    /* Transfers cut off mid-flight; their sessions still own the handles */
+    CURL **left = curl_multi_get_handles(e->multi);
+    for (CURL **h = left; h && *h; h++) curl_multi_remove_handle(e->multi, *h);
+    curl_free(left);
+#endif
+    curl_multi_cleanup(e->multi);
+    pthread_cond_destroy(&e->work);
+    pthread_cond_destroy(&e->idle);
+    pthread_mutex_destroy(&e->lock);
+    free(e->workers);
+    e->multi = NULL;
+    e->workers = NULL;
+}
+
+void engine_print(Engine *e, FILE *f) {
+    pthread_mutex_lock(&e->lock);
+    fprintf(f, "Engine: %lu requests (%lu done, %lu failed), %lu posted, %d workers, "
+               "peak %d in flight (cap %d), peak %d waiting\n",
+            e->submitted, e->completed, e->failed, e->posted, e->nworkers, e->peak_in_flight,
+            e->max_in_flight, e->peak_waiting);
+    lat_print_header(f);
+    lat_print(f, "slot_wait", &e->queue_wait, 1000.0);
+    pthread_mutex_unlock(&e->lock);
+}
@@ -0,0 +1,89 @@
+/*
+ * engine.h - Many sessions' model requests over one curl_multi handle
+ *
+ * Each session keeps its own HttpConn (easy handle, headers, body
+ * cursor). The engine's I/O thread adds those handles to a single multi
+ * handle, which shares one connection pool, and drives every transfer
+ * with curl_multi_poll(). When a reply is complete its callback runs on
+ * one of a pool of worker threads, so parsing and file work never hold
+ * up the bytes of other sessions.
+ *
+ * Fairness: a session has one request at a time (the EngineReq lives in
+ * the session), and requests wait for an in-flight slot in FIFO order,
+ * so a session that turns replies around quickly can not starve the
+ * others. max_in_flight caps the transfers open against the backend at
+ * once; the rest queue in the engine, not in curl.
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "http_conn.h"
+#include "latency.h"
+
+#ifndef ENGINE_WORKERS
+#define ENGINE_WORKERS       4
+#endif
+#ifndef ENGINE_MAX_IN_FLIGHT
+#define ENGINE_MAX_IN_FLIGHT 8
+#endif
+
+typedef struct EngineReq EngineReq;
+
+/* Runs on a worker thread once the transfer is over; r->result is set.
+   It may submit the next request for the same session. */
+typedef void (*engine_fn)(EngineReq *r);
+
+struct EngineReq {
+    HttpConn *conn;             /* prepared with http_conn_prepare_iov() */
+    engine_fn done;
+    void *userdata;
+    CURLcode result;
+    uint64_t queued_us;
+    EngineReq *next;
+};
+
+typedef struct {
+    CURLM *multi;
+    int max_in_flight, in_flight;
+    int nworkers;
+    pthread_t io, *workers;
+
+    pthread_mutex_t lock;       /* guards everything below */
+    pthread_cond_t work;        /* replies ready for a worker */
+    pthread_cond_t idle;        /* active dropped to 0 */
+    EngineReq *waiting, *waiting_tail;      /* submitted, no slot yet */
+    EngineReq *ready, *ready_tail;          /* finished, callback pending */
+    int active;                 /* submitted and callback not yet returned */
+    bool stop;
+
+    unsigned long submitted, completed, failed, posted;
+    int peak_in_flight, peak_waiting, nwaiting;
+    LatHist queue_wait;         /* submit to slot, microseconds */
+} Engine;
+
+/* Start the I/O thread and `workers` callback threads */
+bool engine_start(Engine *e, int workers, int max_in_flight);
+
+/* Queue a prepared request; safe from any thread, callbacks included */
+void engine_submit(Engine *e, EngineReq *r);
+
+/* Run r's callback on a worker with nothing sent, as if its transfer had
+   just finished; for replies that are already known (a cache hit) */
+void engine_post(Engine *e, EngineReq *r);
+
+/* Block until nothing is waiting, in flight or in a callback */
+void engine_wait(Engine *e);
+
+/* Cancel whatever is still queued (callbacks are not run), join the
+   threads and free the multi handle */
+void engine_stop(Engine *e);
+
+/* Counters and the slot wait, one block of lines */
+void engine_print(Engine *e, FILE *f);
+
+#endif
@@ -6,7 +6,7 @@
  *   - Confirmation prompts for destructive operations
  *   - Comprehensive audit logging
  *
- * Compile: gcc file_agent.c cJSON.c -o file_agent -lcurl
+ * Compile: gcc file_agent.c cJSON.c buffer.c mem_acct.c audit_log.c sandbox.c -o file_agent -lcurl
  * Run:     ./file_agent
  */
 
@@ -19,23 +19,47 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <curl/curl.h>
+#include <stdarg.h>
 #include "cJSON.h"
+#include "audit_log.h"
+#include "sandbox.h"
 
 /* ============================================================
    CONFIGURATION
    ============================================================ */
 
+#ifndef ALLOWED_DIR
 #define ALLOWED_DIR     "./sandbox"
+#endif
+#ifndef MODEL_NAME
 #define MODEL_NAME      "qwen2.5-coder:7b"
+#endif
+#ifndef OLLAMA_URL
 #define OLLAMA_URL      "http://localhost:11434/api/generate"
+#endif
+#ifndef LOG_FILE
 #define LOG_FILE        "./file_agent.log"
+#endif
+#ifndef AUDIT_FILE
+#define AUDIT_FILE      "./file_agent.audit.jsonl"  /* one JSON record per action */
+#endif
+#ifndef MAX_CONTENT
 #define MAX_CONTENT     65536
+#endif
+#ifndef MAX_PATH_LEN
 #define MAX_PATH_LEN    1024
+#endif
 
 /* Operations that require confirmation */
+#ifndef CONFIRM_WRITE
 #define CONFIRM_WRITE   1
+#endif
+#ifndef CONFIRM_DELETE
 #define CONFIRM_DELETE  1
+#endif
+#ifndef CONFIRM_APPEND
 #define CONFIRM_APPEND  0  /* Set to 1 if you want append confirmation too */
+#endif
 
 /* ============================================================
    LOGGING SYSTEM
@@ -49,6 +73,7 @@ typedef enum {
 } LogLevel;
 
 static FILE *g_log_file = NULL;
+static AuditLog g_audit = { .fd = -1 };
 
 static const char *log_level_str(LogLevel level) {
     switch (level) {
@@ -67,6 +92,9 @@ static void get_timestamp(char *buf, size_t size) {
 }
 
 static void log_init(void) {
+    if (!audit_open(&g_audit, AUDIT_FILE))
+        fprintf(stderr, "Warning: Could not open audit log %s: %s\n",
+                AUDIT_FILE, strerror(errno));
     g_log_file = fopen(LOG_FILE, "a");
     if (!g_log_file) {
         fprintf(stderr, "Warning: Could not open log file %s: %s\n", 
@@ -91,6 +119,7 @@ static void log_close(void) {
         fclose(g_log_file);
         g_log_file = NULL;
     }
+    audit_close(&g_audit);
 }
 
 static void log_write(LogLevel level, const char *format, ...) {
@@ -119,30 +148,16 @@ static void log_write(LogLevel level, const char *format, ...) {
     }
 }
 
-/* Structured audit log entry */
+/* Structured audit log entry, one JSON line in AUDIT_FILE */
 static void log_audit(const char *user_input, const char *model_response,
                       const char *action, const char *path, 
                       const char *result, bool confirmed) {
-    if (!g_log_file) return;
-    
-    char timestamp[64];
-    get_timestamp(timestamp, sizeof(timestamp));
-    
-    fprintf(g_log_file, "\n--- AUDIT ENTRY ---\n");
-    fprintf(g_log_file, "Timestamp: %s\n", timestamp);
-    fprintf(g_log_file, "User Input: %s\n", user_input);
-    fprintf(g_log_file, "Model Response: %s\n", model_response);
-    fprintf(g_log_file, "Action: %s\n", action);
-    fprintf(g_log_file, "Path: %s\n", path);
-    fprintf(g_log_file, "Confirmed: %s\n", confirmed ? "YES" : "NO/N/A");
-    fprintf(g_log_file, "Result: %s\n", result);
-    fprintf(g_log_file, "-------------------\n");
-    fflush(g_log_file);
+    AuditRecord r = { action, path, result, user_input, model_response, confirmed };
+    if (g_audit.fd >= 0 && !audit_write(&g_audit, &r))
+        log_write(LOG_WARN, "Could not write audit record to %s", AUDIT_FILE);
+    log_write(LOG_AUDIT, "%s %s -> %s%s", action, path, result, confirmed ? " (confirmed)" : "");
 }
 
-/* Need va_list for variable arguments */
-#include <stdarg.h>
-
 /* ============================================================
    CURL RESPONSE BUFFER
    ============================================================ */
@@ -192,70 +207,10 @@ static char *json_escape_string(const char *src) {
    ============================================================ */
 
 static bool safe_path(const char *relative, char *out, size_t out_size) {
-    /* Block empty paths */
-    if (!relative || relative[0] == '\0') {
-        log_write(LOG_WARN, "Security: Empty path rejected");
-        return false;
-    }
-    
-    /* Block absolute paths */
-    if (relative[0] == '/') {
-        log_write(LOG_WARN, "Security: Absolute path rejected: %s", relative);
-        return false;
-    }
-    
-    /* Block path traversal */
-    if (strstr(relative, "..")) {
-        log_write(LOG_WARN, "Security: Path traversal blocked: %s", relative);
-        return false;
-    }
-    
-    /* Build full path */
-    char full[MAX_PATH_LEN];
-    int written = snprintf(full, sizeof(full), "%s/%s", ALLOWED_DIR, relative);
-    if (written >= (int)sizeof(full)) {
-        log_write(LOG_WARN, "Security: Path too long: %s", relative);
-        return false;
-    }
-    
-    /* Additional check: resolve and verify containment */
-    char sandbox_real[MAX_PATH_LEN];
-    char *resolved_sandbox = realpath(ALLOWED_DIR, sandbox_real);
-    
-    if (resolved_sandbox) {
-        /* For existing files, check real path */
-        char full_real[MAX_PATH_LEN];
-        char *resolved_full = realpath(full, full_real);
-        
-        if (resolved_full) {
-            /* File exists - verify it's under sandbox */
-            if (strncmp(full_real, sandbox_real, strlen(sandbox_real)) != 0) {
-                log_write(LOG_WARN, "Security: Resolved path escapes sandbox: %s -> %s", 
-                          relative, full_real);
-                return false;
-            }
-        }
-        /* If file doesn't exist yet, we rely on the .. check above */
-    }
-    
-    strncpy(out, full, out_size - 1);
-    out[out_size - 1] = '\0';
-    
-    return true;
-}
-
-static void ensure_parent_dirs(const char *path) {
-    char tmp[MAX_PATH_LEN];
-    strncpy(tmp, path, sizeof(tmp) - 1);
-    tmp[sizeof(tmp) - 1] = '\0';
-    
-    for (char *p = tmp + strlen(ALLOWED_DIR) + 1; *p; p++) {
-        if (*p == '/') {
-            *p = '\0';
-            mkdir(tmp, 0755);
-            *p = '/';
-        }
-    }
+    SbStatus st = sb_path(ALLOWED_DIR, relative, out, out_size, true);
+    if (st == SB_EMPTY) log_write(LOG_WARN, "Security: %s", sb_reason(st));
+    else if (st != SB_OK) log_write(LOG_WARN, "Security: %s: %s", sb_reason(st), relative);
+    return st == SB_OK;
 }
 
 /* ============================================================
@@ -420,7 +375,7 @@ static OpResult do_write(const char *rel_path, const char *content, bool append,
         }
     }
     
-    ensure_parent_dirs(full);
+    sb_mkdirs(ALLOWED_DIR, full);
     
     FILE *f = fopen(full, append ? "a" : "w");
     if (!f) {
@@ -702,38 +657,11 @@ static void print_banner(void) {
     printf("╠═══════════════════════════════════════════════════════════════╣\n");
     printf("║  Commands: Natural language file operations                   ║\n");
     printf("║  Type 'quit' or 'exit' to stop                                ║\n");
-    printf("║  Type 'log' to view recent log entries                        ║\n");
+    printf("║  Type 'logs [n] [action] [path]' to view audit entries        ║\n");
     printf("╚═══════════════════════════════════════════════════════════════╝\n");
     printf("\n");
 }
 
-static void show_recent_logs(void) {
-    FILE *f = fopen(LOG_FILE, "r");
-    if (!f) {
-        printf("No log file found.\n");
-        return;
-    }
-    
-    /* Read last 50 lines */
-    char lines[50][512];
-    int line_count = 0;
-    int current_line = 0;
-    
-    while (fgets(lines[current_line], sizeof(lines[0]), f)) {
-        current_line = (current_line + 1) % 50;
-        if (line_count < 50) line_count++;
-    }
-    fclose(f);
-    
-    printf("\n═══ Recent Log Entries ═══\n");
-    int start = (line_count < 50) ? 0 : current_line;
-    for (int i = 0; i < line_count; i++) {
-        int idx = (start + i) % 50;
-        printf("%s", lines[idx]);
-    }
-    printf("══════════════════════════\n\n");
-}
-
 int main(void) {
     /* Create sandbox if needed */
     mkdir(ALLOWED_DIR, 0755);
@@ -777,8 +705,9 @@ int main(void) {
             break;
         }
         
-        if (strcmp(user_input, "log") == 0 || strcmp(user_input, "logs") == 0) {
-            show_recent_logs();
+        if (strcmp(user_input, "log") == 0 || strcmp(user_input, "logs") == 0 ||
+            strncmp(user_input, "logs ", 5) == 0) {
+            audit_show(AUDIT_FILE, user_input + (user_input[3] == 's' ? 4 : 3), stdout);
             continue;
         }
         
@@ -7,7 +7,7 @@
  *   - Proper HTML/special character handling
  *   - Multi-turn context
  *
- * Compile: gcc file_agent_v2.c cJSON.c -o file_agent -lcurl
+ * Compile: gcc file_agent_v2.c cJSON.c http_conn.c buffer.c mem_acct.c chat_request.c history.c dir_list.c async_log.c audit_log.c sandbox.c -o file_agent -lcurl -lpthread
  */
 
 #include <stdio.h>
@@ -21,76 +21,67 @@
 #include <curl/curl.h>
 #include <stdarg.h>
 #include "cJSON.h"
+#include "audit_log.h"
+#include "sandbox.h"
+#include "http_conn.h"
+#include "buffer.h"
+#include "chat_request.h"
+#include "history.h"
+#include "dir_list.h"
+#include "async_log.h"
 
 /* ============================================================
    CONFIGURATION
    ============================================================ */
 
+#ifndef ALLOWED_DIR
 #define ALLOWED_DIR     "./sandbox"
+#endif
+#ifndef MODEL_NAME
 #define MODEL_NAME      "qwen2.5-coder:7b"
+#endif
+#ifndef OLLAMA_URL
 #define OLLAMA_URL      "http://localhost:11434/api/chat"  /* Using chat endpoint for context */
+#endif
+#ifndef LOG_FILE
 #define LOG_FILE        "./file_agent.log"
+#endif
+#ifndef AUDIT_FILE
+#define AUDIT_FILE      "./file_agent.audit.jsonl"  /* one JSON record per action */
+#endif
+#ifndef MAX_CONTENT
 #define MAX_CONTENT     65536
+#endif
+#ifndef MAX_PATH_LEN
 #define MAX_PATH_LEN    1024
+#endif
+#ifndef MAX_HISTORY
 #define MAX_HISTORY     20  /* Keep last N messages for context */
-
+#endif
+#ifndef LIST_PAGE
+#define LIST_PAGE       200 /* Listing entries shown and sent to the model */
+#endif
+#ifndef HISTORY_TOKENS
+#define HISTORY_TOKENS  8000  /* ...and at most about this many tokens of them */
+#endif
+
+#ifndef CONFIRM_WRITE
 #define CONFIRM_WRITE   1
+#endif
+#ifndef CONFIRM_DELETE
 #define CONFIRM_DELETE  1
+#endif
+#ifndef CONFIRM_APPEND
 #define CONFIRM_APPEND  0
+#endif
 
 /* ============================================================
    CONVERSATION HISTORY
    ============================================================ */
 
-typedef struct {
-    char role[16];      /* "user", "assistant", or "system" */
-    char *content;      /* Message content (heap allocated) */
-} Message;
-
-typedef struct {
-    Message messages[MAX_HISTORY];
-    int count;
-} Conversation;
-
-static Conversation g_conversation = {0};
-
-static void conversation_clear(void) {
-    for (int i = 0; i < g_conversation.count; i++) {
-        if (g_conversation.messages[i].content) {
-            free(g_conversation.messages[i].content);
-            g_conversation.messages[i].content = NULL;
-        }
-    }
-    g_conversation.count = 0;
-}
-
-static void conversation_add(const char *role, const char *content) {
-    /* If at capacity, remove oldest non-system message */
-    if (g_conversation.count >= MAX_HISTORY) {
-        /* Find first non-system message to remove */
-        int remove_idx = 0;
-        for (int i = 0; i < g_conversation.count; i++) {
-            if (strcmp(g_conversation.messages[i].role, "system") != 0) {
-                remove_idx = i;
-                break;
-            }
-        }
-        
-        free(g_conversation.messages[remove_idx].content);
-        
-        /* Shift remaining messages */
-        for (int i = remove_idx; i < g_conversation.count - 1; i++) {
-            g_conversation.messages[i] = g_conversation.messages[i + 1];
-        }
-        g_conversation.count--;
-    }
-    
-    /* Add new message */
-    int idx = g_conversation.count;
-    strncpy(g_conversation.messages[idx].role, role, sizeof(g_conversation.messages[idx].role) - 1);
-    g_conversation.messages[idx].content = strdup(content);
-    g_conversation.count++;
-}
+/* Ring of past messages, trimmed by count and by estimated tokens so a
+   large file read cannot crowd out the rest of the prompt */
+static History g_conversation;
 
 /* ============================================================
    LOGGING SYSTEM
@@ -103,7 +94,10 @@ typedef enum {
     LOG_AUDIT
 } LogLevel;
 
-static FILE *g_log_file = NULL;
+/* Queued and written by a background thread; see async_log.h */
+static AsyncLog g_log = { .fd = -1 };
+static Buffer g_log_msg;    /* formatted once for stderr and the file */
+static AuditLog g_audit = { .fd = -1 };
 
 static const char *log_level_str(LogLevel level) {
     switch (level) {
@@ -115,172 +109,72 @@ static const char *log_level_str(LogLevel level) {
     }
 }
 
-static void get_timestamp(char *buf, size_t size) {
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    strftime(buf, size, "%Y-%m-%d %H:%M:%S", tm_info);
-}
-
 static void log_init(void) {
-    g_log_file = fopen(LOG_FILE, "a");
-    if (!g_log_file) {
+    if (!audit_open(&g_audit, AUDIT_FILE))
+        fprintf(stderr, "Warning: Could not open audit log %s: %s\n",
+                AUDIT_FILE, strerror(errno));
+    if (!alog_open(&g_log, LOG_FILE)) {
         fprintf(stderr, "Warning: Could not open log file %s: %s\n", 
                 LOG_FILE, strerror(errno));
         return;
     }
     
-    char timestamp[64];
-    get_timestamp(timestamp, sizeof(timestamp));
-    fprintf(g_log_file, "\n========================================\n");
-    fprintf(g_log_file, "[%s] [INFO] File Agent v2 Started\n", timestamp);
-    fprintf(g_log_file, "========================================\n");
-    fflush(g_log_file);
+    alog_printf(&g_log, "\n========================================\n"
+                "[%s] [INFO] File Agent v2 Started\n"
+                "========================================\n",
+                alog_timestamp(&g_log));
 }
 
+/* Everything still queued is written before the file is closed */
 static void log_close(void) {
-    if (g_log_file) {
-        char timestamp[64];
-        get_timestamp(timestamp, sizeof(timestamp));
-        fprintf(g_log_file, "[%s] [INFO] File Agent Shutdown\n", timestamp);
-        fprintf(g_log_file, "========================================\n\n");
-        fclose(g_log_file);
-        g_log_file = NULL;
-    }
+    if (alog_is_open(&g_log)) {
+        alog_printf(&g_log, "[%s] [INFO] File Agent Shutdown\n"
+                    "========================================\n\n",
+                    alog_timestamp(&g_log));
+        alog_close(&g_log);
+    }
+    audit_close(&g_audit);
+    buf_free(&g_log_msg);
 }
 
 static void log_write(LogLevel level, const char *format, ...) {
-    char timestamp[64];
-    get_timestamp(timestamp, sizeof(timestamp));
-    
-    if (level == LOG_ERROR || level == LOG_WARN) {
-        va_list args;
-        va_start(args, format);
-        fprintf(stderr, "[%s] ", log_level_str(level));
-        vfprintf(stderr, format, args);
-        fprintf(stderr, "\n");
-        va_end(args);
-    }
-    
-    if (g_log_file) {
-        va_list args;
-        va_start(args, format);
-        fprintf(g_log_file, "[%s] [%s] ", timestamp, log_level_str(level));
-        vfprintf(g_log_file, format, args);
-        fprintf(g_log_file, "\n");
-        fflush(g_log_file);
-        va_end(args);
-    }
+    va_list args;
+    va_start(args, format);
+    buf_reset(&g_log_msg);
+    buf_vprintf(&g_log_msg, format, args);
+    va_end(args);
+    
+    const char *msg = g_log_msg.data ? g_log_msg.data : "";
+    if (level == LOG_ERROR || level == LOG_WARN)
+        fprintf(stderr, "[%s] %s\n", log_level_str(level), msg);
+    alog_line(&g_log, log_level_str(level), "%s", msg);
 }
 
 static void log_audit(const char *user_input, const char *model_response,
                       const char *action, const char *path, 
                       const char *result, bool confirmed) {
-    if (!g_log_file) return;
-    
-    char timestamp[64];
-    get_timestamp(timestamp, sizeof(timestamp));
-    
-    fprintf(g_log_file, "\n--- AUDIT ENTRY ---\n");
-    fprintf(g_log_file, "Timestamp: %s\n", timestamp);
-    fprintf(g_log_file, "User Input: %s\n", user_input);
-    fprintf(g_log_file, "Model Response: %.200s%s\n", model_response, 
-            strlen(model_response) > 200 ? "..." : "");
-    fprintf(g_log_file, "Action: %s\n", action);
-    fprintf(g_log_file, "Path: %s\n", path);
-    fprintf(g_log_file, "Confirmed: %s\n", confirmed ? "YES" : "NO/N/A");
-    fprintf(g_log_file, "Result: %s\n", result);
-    fprintf(g_log_file, "-------------------\n");
-    fflush(g_log_file);
+    AuditRecord r = { action, path, result, user_input, model_response, confirmed };
+    if (g_audit.fd >= 0 && !audit_write(&g_audit, &r))
+        log_write(LOG_WARN, "Could not write audit record to %s", AUDIT_FILE);
+    log_write(LOG_AUDIT, "%s %s -> %s%s", action, path, result, confirmed ? " (confirmed)" : "");
 }
 
 /* ============================================================
    CURL RESPONSE BUFFER
    ============================================================ */
 
-typedef struct {
-    char *data;
-    size_t size;
-} ResponseBuffer;
-
-static size_t write_callback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    ResponseBuffer *buf = (ResponseBuffer *)userp;
-
-    char *ptr = realloc(buf->data, buf->size + realsize + 1);
-    if (!ptr) {
-        log_write(LOG_ERROR, "Out of memory in curl callback");
-        return 0;
-    }
-
-    buf->data = ptr;
-    memcpy(&buf->data[buf->size], contents, realsize);
-    buf->size += realsize;
-    buf->data[buf->size] = '\0';
-
-    return realsize;
-}
+/* Reused across turns: rewound before each request, never shrunk */
+static Buffer g_response;
 
 /* ============================================================
    PATH SAFETY
    ============================================================ */
 
 static bool safe_path(const char *relative, char *out, size_t out_size) {
-    if (!relative || relative[0] == '\0') {
-        log_write(LOG_WARN, "Security: Empty path rejected");
-        return false;
-    }
-    
-    if (relative[0] == '/') {
-        log_write(LOG_WARN, "Security: Absolute path rejected: %s", relative);
-        return false;
-    }
-    
-    if (strstr(relative, "..")) {
-        log_write(LOG_WARN, "Security: Path traversal blocked: %s", relative);
-        return false;
-    }
-    
-    char full[MAX_PATH_LEN];
-    int written = snprintf(full, sizeof(full), "%s/%s", ALLOWED_DIR, relative);
-    if (written >= (int)sizeof(full)) {
-        log_write(LOG_WARN, "Security: Path too long: %s", relative);
-        return false;
-    }
-    
-    char sandbox_real[MAX_PATH_LEN];
-    char *resolved_sandbox = realpath(ALLOWED_DIR, sandbox_real);
-    
-    if (resolved_sandbox) {
-        char full_real[MAX_PATH_LEN];
-        char *resolved_full = realpath(full, full_real);
-        
-        if (resolved_full) {
-            if (strncmp(full_real, sandbox_real, strlen(sandbox_real)) != 0) {
-                log_write(LOG_WARN, "Security: Resolved path escapes sandbox: %s -> %s", 
-                          relative, full_real);
-                return false;
-            }
-        }
-    }
-    
-    strncpy(out, full, out_size - 1);
-    out[out_size - 1] = '\0';
-    
-    return true;
-}
-
-static void ensure_parent_dirs(const char *path) {
-    char tmp[MAX_PATH_LEN];
-    strncpy(tmp, path, sizeof(tmp) - 1);
-    tmp[sizeof(tmp) - 1] = '\0';
-    
-    for (char *p = tmp + strlen(ALLOWED_DIR) + 1; *p; p++) {
-        if (*p == '/') {
-            *p = '\0';
-            mkdir(tmp, 0755);
-            *p = '/';
-        }
-    }
+    SbStatus st = sb_path(ALLOWED_DIR, relative, out, out_size, true);
+    if (st == SB_EMPTY) log_write(LOG_WARN, "Security: %s", sb_reason(st));
+    else if (st != SB_OK) log_write(LOG_WARN, "Security: %s: %s", sb_reason(st), relative);
+    return st == SB_OK;
 }
 
 /* ============================================================
@@ -348,52 +242,29 @@ static OpResult do_list(const char *rel_path) {
         return result;
     }
     
-    DIR *dir = opendir(full);
-    if (!dir) {
+    DirList l;
+    if (!dl_read(&l, full, NULL)) {
         snprintf(result.message, sizeof(result.message), 
                  "Cannot open directory: %s", strerror(errno));
         return result;
     }
     
-    /* Build listing string for context */
-    char listing[4096] = "";
-    size_t listing_len = 0;
+    /* Build listing string for context; big directories are cut at a page */
+    Buffer listing = {0};
+    int shown = dl_format(&l, 0, LIST_PAGE, &listing);
+    if (shown < l.count) buf_printf(&listing, "  ... and %d more\n", l.count - shown);
+    if (l.count == 0) buf_puts(&listing, "(empty directory)");
     
     printf("\nContents of %s:\n", full);
     printf("────────────────────────────────────────\n");
-    
-    struct dirent *entry;
-    int count = 0;
-    while ((entry = readdir(dir))) {
-        if (entry->d_name[0] != '.') {
-            const char *type_indicator = "";
-            if (entry->d_type == DT_DIR) type_indicator = "/";
-            else if (entry->d_type == DT_LNK) type_indicator = "@";
-            
-            printf("  %s%s\n", entry->d_name, type_indicator);
-            
-            /* Add to listing string */
-            int written = snprintf(listing + listing_len, sizeof(listing) - listing_len,
-                                   "%s%s\n", entry->d_name, type_indicator);
-            if (written > 0 && listing_len + written < sizeof(listing)) {
-                listing_len += written;
-            }
-            count++;
-        }
-    }
-    
-    if (count == 0) {
-        printf("  (empty)\n");
-        strcpy(listing, "(empty directory)");
-    }
+    printf("%s", l.count ? listing.data : "  (empty)\n");
     printf("────────────────────────────────────────\n");
-    printf("Total: %d items\n", count);
-    
-    closedir(dir);
+    printf("Total: %d items\n", l.count);
     
-    result.success = true;
-    result.file_content = strdup(listing);
-    snprintf(result.message, sizeof(result.message), "Listed %d items", count);
+    result.success = listing.data != NULL;
+    result.file_content = buf_take(&listing);
+    snprintf(result.message, sizeof(result.message), "Listed %d items", l.count);
+    dl_free(&l);
     return result;
 }
 
@@ -460,7 +331,7 @@ static OpResult do_write(const char *rel_path, const char *content, bool append,
         }
     }
     
-    ensure_parent_dirs(full);
+    sb_mkdirs(ALLOWED_DIR, full);
     
     FILE *f = fopen(full, append ? "a" : "w");
     if (!f) {
@@ -554,83 +425,65 @@ static const char *SYSTEM_PROMPT =
     "- Always include all three fields: action, path, content\n"
     "- For read/list/delete, set content to empty string\n";
 
+static HttpConn g_http;
+static ChatRequest g_request;
+
 static bool call_ollama(char *response_out, size_t response_size) {
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        log_write(LOG_ERROR, "Failed to initialize curl");
-        return false;
-    }
-    
-    ResponseBuffer chunk = {0};
-    
-    /* Build the messages array using cJSON */
-    cJSON *request = cJSON_CreateObject();
-    cJSON_AddStringToObject(request, "model", MODEL_NAME);
-    cJSON_AddBoolToObject(request, "stream", false);
-    
-    cJSON *messages = cJSON_CreateArray();
-    
-    /* Add system message */
-    cJSON *sys_msg = cJSON_CreateObject();
-    cJSON_AddStringToObject(sys_msg, "role", "system");
-    cJSON_AddStringToObject(sys_msg, "content", SYSTEM_PROMPT);
-    cJSON_AddItemToArray(messages, sys_msg);
-    
-    /* Add conversation history */
-    for (int i = 0; i < g_conversation.count; i++) {
-        cJSON *msg = cJSON_CreateObject();
-        cJSON_AddStringToObject(msg, "role", g_conversation.messages[i].role);
-        cJSON_AddStringToObject(msg, "content", g_conversation.messages[i].content);
-        cJSON_AddItemToArray(messages, msg);
-    }
-    
-    cJSON_AddItemToObject(request, "messages", messages);
-    
-    char *post_data = cJSON_PrintUnformatted(request);
-    cJSON_Delete(request);
-    
-    if (!post_data) {
+    Buffer *chunk = &g_response;
+    buf_reset(chunk);
+    
+    /* The prefix and system message are serialized once, the history
+       messages when they were added */
+    static char *prefix, *sys_json;
+    static size_t prefix_len, sys_len;
+    if (!prefix) {
+        prefix = chat_prefix_json(MODEL_NAME, false, NULL, NULL);
+        if (prefix) prefix_len = strlen(prefix);
+    }
+    if (!sys_json) sys_json = chat_message_json("system", SYSTEM_PROMPT, &sys_len);
+    
+    ChatRequest *req = &g_request;
+    bool built = prefix && sys_json && chat_req_begin(req, prefix, prefix_len) &&
+                 chat_req_add(req, sys_json, sys_len);
+    for (int i = 0; built && i < g_conversation.count; i++) {
+        Message *m = hist_at(&g_conversation, i);
+        built = chat_req_add(req, m->json, m->json_len);
+    }
+    if (!built || !chat_req_end(req)) {
         log_write(LOG_ERROR, "Failed to create request JSON");
-        curl_easy_cleanup(curl);
         return false;
     }
     
-    curl_easy_setopt(curl, CURLOPT_URL, OLLAMA_URL);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &chunk);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 120L);
-    
-    struct curl_slist *headers = NULL;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    
+    log_write(LOG_INFO, "Prompt: %d messages, %zu bytes, ~%zu history tokens",
+              g_conversation.count, req->total, hist_tokens(&g_conversation));
     log_write(LOG_INFO, "Sending request to Ollama (chat endpoint)...");
     
-    CURLcode res = curl_easy_perform(curl);
+    CURLcode res = http_conn_post_iov(&g_http, req->iov, req->count, buf_curl_write, chunk);
     
-    free(post_data);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+    log_write(LOG_INFO, "HTTP %s connection: connect %.1f ms, first byte %.1f ms, total %.1f ms",
+              g_http.reused ? "reused" : "new", g_http.connect_time * 1000.0,
+              g_http.ttfb * 1000.0, g_http.total_time * 1000.0);
     
+    if (res == CURLE_WRITE_ERROR) {
+        log_write(LOG_ERROR, "Out of memory in curl callback");
+        return false;
+    }
     if (res != CURLE_OK) {
-        log_write(LOG_ERROR, "Curl error: %s", curl_easy_strerror(res));
-        free(chunk.data);
+        log_write(LOG_ERROR, "Curl error: %s", 
+                  g_http.errbuf[0] ? g_http.errbuf : curl_easy_strerror(res));
         return false;
     }
     
-    if (!chunk.data) {
+    if (!chunk->size) {
         log_write(LOG_ERROR, "No response from Ollama");
         return false;
     }
     
     /* Parse Ollama's chat response */
-    cJSON *ollama_response = cJSON_Parse(chunk.data);
+    cJSON *ollama_response = cJSON_ParseWithLength(chunk->data, chunk->size);
     if (!ollama_response) {
         log_write(LOG_ERROR, "Failed to parse Ollama response as JSON");
-        log_write(LOG_ERROR, "Raw response: %.500s", chunk.data);
-        free(chunk.data);
+        log_write(LOG_ERROR, "Raw response: %.500s", chunk->data);
         return false;
     }
     
@@ -639,7 +492,6 @@ static bool call_ollama(char *response_out, size_t response_size) {
     if (!message) {
         log_write(LOG_ERROR, "No 'message' field in Ollama output");
         cJSON_Delete(ollama_response);
-        free(chunk.data);
         return false;
     }
     
@@ -647,7 +499,6 @@ static bool call_ollama(char *response_out, size_t response_size) {
     if (!cJSON_IsString(content) || !content->valuestring) {
         log_write(LOG_ERROR, "No 'content' in message");
         cJSON_Delete(ollama_response);
-        free(chunk.data);
         return false;
     }
     
@@ -655,7 +506,6 @@ static bool call_ollama(char *response_out, size_t response_size) {
     response_out[response_size - 1] = '\0';
     
     cJSON_Delete(ollama_response);
-    free(chunk.data);
     
     return true;
 }
@@ -738,11 +588,11 @@ static void execute_command(Command *cmd, const char *user_input,
         
         /* Add result to conversation context */
         if (result.success && result.file_content) {
-            char context_msg[4096];
-            snprintf(context_msg, sizeof(context_msg),
-                     "Directory listing for '%s':\n%s", 
-                     cmd->path[0] ? cmd->path : ".", result.file_content);
-            conversation_add("user", context_msg);
+            Buffer context_msg = {0};
+            if (buf_printf(&context_msg, "Directory listing for '%s':\n%s", 
+                           cmd->path[0] ? cmd->path : ".", result.file_content))
+                hist_add(&g_conversation, "user", context_msg.data);
+            buf_free(&context_msg);
         }
     } 
     else if (strcmp(cmd->action, "read") == 0) {
@@ -754,7 +604,7 @@ static void execute_command(Command *cmd, const char *user_input,
             snprintf(context_msg, sizeof(context_msg),
                      "Contents of '%s':\n```\n%s\n```\n\nYou can now modify this file using the 'write' action with the complete new content.",
                      cmd->path, result.file_content);
-            conversation_add("user", context_msg);
+            hist_add(&g_conversation, "user", context_msg);
             
             printf("\n[File contents added to conversation context]\n");
         }
@@ -789,39 +639,12 @@ static void execute_command(Command *cmd, const char *user_input,
    UTILITY FUNCTIONS
    ============================================================ */
 
-static void show_recent_logs(void) {
-    FILE *f = fopen(LOG_FILE, "r");
-    if (!f) {
-        printf("No log file found.\n");
-        return;
-    }
-    
-    char lines[50][512];
-    int line_count = 0;
-    int current_line = 0;
-    
-    while (fgets(lines[current_line], sizeof(lines[0]), f)) {
-        current_line = (current_line + 1) % 50;
-        if (line_count < 50) line_count++;
-    }
-    fclose(f);
-    
-    printf("\n═══ Recent Log Entries ═══\n");
-    int start = (line_count < 50) ? 0 : current_line;
-    for (int i = 0; i < line_count; i++) {
-        int idx = (start + i) % 50;
-        printf("%s", lines[idx]);
-    }
-    printf("══════════════════════════\n\n");
-}
-
 static void show_context(void) {
     printf("\n═══ Conversation Context (%d messages) ═══\n", g_conversation.count);
     for (int i = 0; i < g_conversation.count; i++) {
-        printf("[%d] %s: %.100s%s\n", i, 
-               g_conversation.messages[i].role,
-               g_conversation.messages[i].content,
-               strlen(g_conversation.messages[i].content) > 100 ? "..." : "");
+        Message *m = hist_at(&g_conversation, i);
+        printf("[%d] %s: %.100s%s\n", i, m->role, m->content,
+               strlen(m->content) > 100 ? "..." : "");
     }
     printf("═══════════════════════════════════════════\n\n");
 }
@@ -845,7 +668,7 @@ static void print_banner(void) {
     printf("╠═══════════════════════════════════════════════════════════════╣\n");
     printf("║  Commands:                                                    ║\n");
     printf("║    - Natural language file operations                         ║\n");
-    printf("║    - 'log' or 'logs' - view recent log entries                ║\n");
+    printf("║    - 'logs [n] [action] [path]' - view recent audit entries   ║\n");
     printf("║    - 'context' - view conversation history                    ║\n");
     printf("║    - 'clear' - reset conversation context                     ║\n");
     printf("║    - 'quit' or 'exit' - stop                                  ║\n");
@@ -864,6 +687,13 @@ int main(void) {
     mkdir(ALLOWED_DIR, 0755);
     log_init();
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    hist_init(&g_conversation, MAX_HISTORY, HISTORY_TOKENS);
+    if (!http_conn_init(&g_http, OLLAMA_URL, 120L)) {
+        log_write(LOG_ERROR, "Failed to initialize curl");
+        curl_global_cleanup();
+        log_close();
+        return 1;
+    }
     
     print_banner();
     
@@ -896,8 +726,9 @@ int main(void) {
             break;
         }
         
-        if (strcmp(user_input, "log") == 0 || strcmp(user_input, "logs") == 0) {
-            show_recent_logs();
+        if (strcmp(user_input, "log") == 0 || strcmp(user_input, "logs") == 0 ||
+            strncmp(user_input, "logs ", 5) == 0) {
+            audit_show(AUDIT_FILE, user_input + (user_input[3] == 's' ? 4 : 3), stdout);
             continue;
         }
         
@@ -907,7 +738,7 @@ int main(void) {
         }
         
         if (strcmp(user_input, "clear") == 0) {
-            conversation_clear();
+            hist_clear(&g_conversation);
             printf("Conversation context cleared.\n\n");
             continue;
         }
@@ -915,7 +746,7 @@ int main(void) {
         log_write(LOG_INFO, "User input: %s", user_input);
         
         /* Add user message to conversation */
-        conversation_add("user", user_input);
+        hist_add(&g_conversation, "user", user_input);
         
         /* Call Ollama */
         printf("Thinking...\n");
@@ -928,7 +759,7 @@ int main(void) {
         log_write(LOG_INFO, "Model response: %s", model_response);
         
         /* Add assistant response to conversation */
-        conversation_add("assistant", model_response);
+        hist_add(&g_conversation, "assistant", model_response);
         
         /* Parse the command */
         Command cmd = parse_command(model_response);
@@ -943,7 +774,10 @@ int main(void) {
         printf("\n");
     }
     
-    conversation_clear();
+    hist_clear(&g_conversation);
+    buf_free(&g_response);
+    chat_req_free(&g_request);
+    http_conn_close(&g_http);
     curl_global_cleanup();
     log_close();
     
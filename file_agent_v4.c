@@ -6,7 +6,7 @@
  *   - Server-side content handling (no base64 from model)
  *   - Robust HTML repair
  *
- * Compile: gcc file_agent_v4.c cJSON.c -o file_agent -lcurl
+ * Compile: gcc file_agent_v4.c cJSON.c http_conn.c buffer.c mem_acct.c dir_list.c repair.c sandbox.c -o file_agent -lcurl
  */
 
 #include <stdio.h>
@@ -20,21 +20,47 @@
 #include <curl/curl.h>
 #include <stdarg.h>
 #include "cJSON.h"
+#include "http_conn.h"
+#include "buffer.h"
+#include "dir_list.h"
+#include "repair.h"
+#include "sandbox.h"
 
 /* ============================================================
    CONFIGURATION
    ============================================================ */
 
+#ifndef ALLOWED_DIR
 #define ALLOWED_DIR     "./sandbox"
+#endif
+#ifndef MODEL_NAME
 #define MODEL_NAME      "qwen2.5-coder:7b"
+#endif
+#ifndef OLLAMA_URL
 #define OLLAMA_URL      "http://localhost:11434/api/chat"
+#endif
+#ifndef LOG_FILE
 #define LOG_FILE        "./file_agent.log"
+#endif
+#ifndef MAX_CONTENT
 #define MAX_CONTENT     131072
+#endif
+#ifndef MAX_PATH_LEN
 #define MAX_PATH_LEN    1024
+#endif
+#ifndef MAX_HISTORY
 #define MAX_HISTORY     20
+#endif
+#ifndef LIST_PAGE
+#define LIST_PAGE       200
+#endif
 
+#ifndef CONFIRM_WRITE
 #define CONFIRM_WRITE   1
+#endif
+#ifndef CONFIRM_DELETE
 #define CONFIRM_DELETE  1
+#endif
 
 /* ============================================================
    CONVERSATION HISTORY
@@ -131,88 +157,15 @@ static void log_audit(const char *action, const char *path, const char *result)
    CURL
    ============================================================ */
 
-typedef struct { char *data; size_t size; } Buffer;
-
-static size_t curl_write(void *p, size_t size, size_t n, void *userp) {
-    size_t realsize = size * n;
-    Buffer *buf = userp;
-    char *ptr = realloc(buf->data, buf->size + realsize + 1);
-    if (!ptr) return 0;
-    buf->data = ptr;
-    memcpy(buf->data + buf->size, p, realsize);
-    buf->size += realsize;
-    buf->data[buf->size] = 0;
-    return realsize;
-}
-
-/* ============================================================
-   HTML REPAIR - Convert ? back to < and >
-   ============================================================ */
-
-static char *repair_html(const char *input) {
-    if (!input) return NULL;
-    
-    size_t len = strlen(input);
-    char *output = malloc(len + 1);
-    if (!output) return NULL;
-    
-    size_t j = 0;
-    for (size_t i = 0; i < len; i++) {
-        if (input[i] == '?') {
-            /* Look at context to decide if < or > */
-            
-            /* Check for opening tag patterns: ?tagname, ?!, ?/ */
-            if (i + 1 < len) {
-                char next = input[i + 1];
-                if (next == '!' || next == '/' || 
-                    (next >= 'a' && next <= 'z') ||
-                    (next >= 'A' && next <= 'Z')) {
-                    output[j++] = '<';
-                    continue;
-                }
-            }
-            
-            /* Check for closing: after tagname, after ", after ', after / */
-            if (i > 0) {
-                char prev = input[i - 1];
-                if ((prev >= 'a' && prev <= 'z') ||
-                    (prev >= 'A' && prev <= 'Z') ||
-                    (prev >= '0' && prev <= '9') ||
-                    prev == '"' || prev == '\'' || 
-                    prev == '/' || prev == '-') {
-                    output[j++] = '>';
-                    continue;
-                }
-            }
-            
-            /* Default: keep as ? */
-            output[j++] = '?';
-        } else {
-            output[j++] = input[i];
-        }
-    }
-    output[j] = '\0';
-    return output;
-}
+/* Reused across turns: rewound before each request, never shrunk */
+static Buffer g_response;
 
 /* ============================================================
    PATH SAFETY
    ============================================================ */
 
 static bool safe_path(const char *rel, char *out, size_t out_size) {
-    if (!rel || !rel[0] || rel[0] == '/' || strstr(rel, "..")) {
-        return false;
-    }
-    snprintf(out, out_size, "%s/%s", ALLOWED_DIR, rel);
-    return true;
-}
-
-static void ensure_dirs(const char *path) {
-    char tmp[MAX_PATH_LEN];
-    strncpy(tmp, path, sizeof(tmp) - 1);
-    for (char *p = tmp + strlen(ALLOWED_DIR) + 1; *p; p++) {
-        if (*p == '/') { *p = 0; mkdir(tmp, 0755); *p = '/'; }
-    }
+    return sb_path(ALLOWED_DIR, rel, out, out_size, false) == SB_OK;
 }
 
 /* ============================================================
@@ -262,7 +215,7 @@ static bool file_write(const char *rel_path, const char *content, bool append) {
     char full[MAX_PATH_LEN];
     if (!safe_path(rel_path, full, sizeof(full))) return false;
     
-    ensure_dirs(full);
+    sb_mkdirs(ALLOWED_DIR, full);
     FILE *f = fopen(full, append ? "a" : "w");
     if (!f) return false;
     
@@ -287,23 +240,16 @@ static char *file_list(const char *rel_path) {
         return NULL;
     }
     
-    DIR *dir = opendir(full);
-    if (!dir) return NULL;
-    
-    char *result = malloc(4096);
-    if (!result) { closedir(dir); return NULL; }
-    result[0] = '\0';
-    size_t len = 0;
+    DirList l;
+    if (!dl_read(&l, full, NULL)) return NULL;
     
-    struct dirent *e;
-    while ((e = readdir(dir))) {
-        if (e->d_name[0] != '.') {
-            len += snprintf(result + len, 4096 - len, "%s%s\n", 
-                           e->d_name, e->d_type == DT_DIR ? "/" : "");
-        }
-    }
-    closedir(dir);
-    return result;
+    /* Big directories get the first LIST_PAGE entries and a count */
+    Buffer out = {0};
+    int n = dl_format(&l, 0, LIST_PAGE, &out);
+    if (n < l.count) buf_printf(&out, "  ... and %d more\n", l.count - n);
+    if (!out.data) buf_puts(&out, "");
+    dl_free(&l);
+    return buf_take(&out);
 }
 
 /* ============================================================
@@ -327,11 +273,11 @@ static const char *SYSTEM_PROMPT =
 "\n"
 "IMPORTANT: Return ONLY the JSON object. No explanations.";
 
+static HttpConn g_http;
+
 static bool call_ollama(char *response, size_t response_size) {
-    CURL *curl = curl_easy_init();
-    if (!curl) return false;
-    
-    Buffer buf = {0};
+    Buffer *buf = &g_response;
+    buf_reset(buf);
     
     /* Build request with JSON mode */
     cJSON *req = cJSON_CreateObject();
@@ -360,30 +306,19 @@ static bool call_ollama(char *response, size_t response_size) {
     char *post = cJSON_PrintUnformatted(req);
     cJSON_Delete(req);
     
-    curl_easy_setopt(curl, CURLOPT_URL, OLLAMA_URL);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 180L);
-    
-    struct curl_slist *h = curl_slist_append(NULL, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, h);
-    
-    CURLcode res = curl_easy_perform(curl);
+    if (!post) return false;
     
+    CURLcode res = http_conn_post_buf(&g_http, post, strlen(post), buf);
     free(post);
-    curl_slist_free_all(h);
-    curl_easy_cleanup(curl);
     
-    if (res != CURLE_OK || !buf.data) {
-        free(buf.data);
-        return false;
-    }
+    log_write("INFO", "HTTP %s connection: connect %.1f ms, first byte %.1f ms, total %.1f ms",
+              g_http.reused ? "reused" : "new", g_http.connect_time * 1000.0,
+              g_http.ttfb * 1000.0, g_http.total_time * 1000.0);
+    
+    if (res != CURLE_OK || !buf->size) return false;
     
     /* Parse Ollama response */
-    cJSON *resp = cJSON_Parse(buf.data);
-    free(buf.data);
+    cJSON *resp = cJSON_ParseWithLength(buf->data, buf->size);
     
     if (!resp) return false;
     
@@ -582,6 +517,12 @@ int main(void) {
     mkdir(ALLOWED_DIR, 0755);
     log_init();
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (!http_conn_init(&g_http, OLLAMA_URL, 180L)) {
+        log_write("ERROR", "Failed to initialize curl");
+        curl_global_cleanup();
+        log_close();
+        return 1;
+    }
     
     print_banner();
     log_write("INFO", "Started with model %s", MODEL_NAME);
@@ -664,6 +605,8 @@ int main(void) {
     }
     
     conversation_clear();
+    buf_free(&g_response);
+    http_conn_close(&g_http);
     curl_global_cleanup();
     log_close();
     printf("Goodbye!\n");
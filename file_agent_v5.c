@@ -1,9 +1,11 @@
 /*
  * file_agent_v5.c - FIXED
  *
- * Compile: gcc file_agent_v5.c cJSON.c -o file_agent -lcurl
+ * Compile: gcc file_agent_v5.c cJSON.c http_conn.c buffer.c mem_acct.c chat_request.c history.c filemap.c file_cache.c atomic_write.c dir_list.c repair.c async_log.c latency.c engine.c intent.c response_cache.c prefetch.c patch.c sandbox.c -o file_agent -lcurl -lpthread
+ * Or:      make [PROFILE=release|debug|minimal], see the Makefile
  */
 
+#define _GNU_SOURCE             /* accept4, pipe2 */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,96 +16,149 @@
 #include <dirent.h>
 #include <curl/curl.h>
 #include <stdarg.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "cJSON.h"
+#include "http_conn.h"
+#include "buffer.h"
+#include "chat_request.h"
+#include "history.h"
+#include "filemap.h"
+#include "file_cache.h"
+#include "atomic_write.h"
+#include "dir_list.h"
+#include "repair.h"
+#include "async_log.h"
+#include "latency.h"
+#include "engine.h"
+#include "intent.h"
+#include "response_cache.h"
+#include "prefetch.h"
+#include "patch.h"
+#include "sandbox.h"
+#include "mem_acct.h"
 
+#ifndef ALLOWED_DIR
 #define ALLOWED_DIR     "./sandbox"
+#endif
+#ifndef MODEL_NAME
 #define MODEL_NAME      "qwen2.5-coder:7b"
+#endif
+#ifndef OLLAMA_URL
 #define OLLAMA_URL      "http://localhost:11434/api/chat"
+#endif
+#ifndef LOG_FILE
 #define LOG_FILE        "./file_agent.log"
+#endif
+#ifndef STATS_FILE
+#define STATS_FILE      "./file_agent.stats"  /* latency tables, written on exit */
+#endif
+#ifndef MAX_CONTENT
 #define MAX_CONTENT     131072
+#endif
+#ifndef MAX_PATH_LEN
 #define MAX_PATH_LEN    1024
+#endif
+#ifndef MAX_HISTORY
 #define MAX_HISTORY     20
+#endif
+#ifndef CONTEXT_WINDOW
+#define CONTEXT_WINDOW  16384   /* bytes of a large file put in the prompt */
+#endif
+#ifndef CONTEXT_INDEX
+#define CONTEXT_INDEX   16      /* line index entries for the rest of it */
+#endif
+#ifndef FILE_CACHE_MB
+#define FILE_CACHE_MB   64      /* mapped files and listings kept for re-reads */
+#endif
+#ifndef LIST_PAGE
+#define LIST_PAGE       200     /* listing entries per page */
+#endif
+#ifndef LIST_MAX_DEPTH
+#define LIST_MAX_DEPTH  4
+#endif
+#ifndef LIST_MAX_ENTRIES
+#define LIST_MAX_ENTRIES 20000  /* walk limit for recursive listings */
+#endif
+#ifndef PREFETCH
+#define PREFETCH        1       /* warm listed and mentioned files while the model runs */
+#endif
+#ifndef PREFETCH_MAX_KB
+#define PREFETCH_MAX_KB 256     /* larger files are left alone */
+#endif
+#ifndef PREFETCH_LIST
+#define PREFETCH_LIST   8       /* files of a fresh listing to warm */
+#endif
+#ifndef WRITE_FSYNC
+#define WRITE_FSYNC     AW_FSYNC_BATCH  /* _NONE, _EACH, or _BATCH: once per command */
+#endif
+#ifndef HISTORY_TOKENS
+#define HISTORY_TOKENS  8000    /* estimated prompt budget for history */
+#endif
+#ifndef CHUNK_MAX_PARTS
+#define CHUNK_MAX_PARTS 256     /* one chunked write, up to MAX_CONTENT per part */
+#endif
+#ifndef MEM_CAP_MB
+#define MEM_CAP_MB      0       /* heap cap, evicting history to stay under it; 0 for none */
+#endif
+#ifndef CHUNK_RETRIES
+#define CHUNK_RETRIES   3       /* out-of-order parts before the write is dropped */
+#endif
 
+#ifndef CONFIRM_WRITE
 #define CONFIRM_WRITE   1
+#endif
+#ifndef CONFIRM_DELETE
 #define CONFIRM_DELETE  1
+#endif
+#ifndef CONFIRM_UI
+#define CONFIRM_UI      1   /* 0: nobody is asked; --allow approves changes as in batch mode */
+#endif
+
+/* A change is put to the user, or in an unattended session to the
+   policy; CONFIRM_* 0 skips only the former */
+#define ASKS(flag, s)   ((flag) || (s)->unattended)
+
+/* What the build profiles turn off (see the Makefile). Each is a
+   constant the compiler folds, so 0 leaves no branch in the hot path. */
+#ifndef AGENT_LOG
+#define AGENT_LOG       1   /* session log in LOG_FILE */
+#endif
+#ifndef AGENT_STATS
+#define AGENT_STATS     1   /* per-stage latency tables, see STATS */
+#endif
+
+#ifndef FAST_PATH
+#define FAST_PATH       1   /* plain list/read/delete requests skip the model, see intent.h */
+#endif
+
+#ifndef STREAM_RESPONSE
+#define STREAM_RESPONSE 1   /* "stream": true, act as soon as the command is complete */
+#endif
+#ifndef STREAM_GRACE
+#define STREAM_GRACE    8   /* lines to wait for the stats line after the command */
+#endif
+
+/* Keep the model loaded and the prompt prefix byte-stable between turns,
+   so Ollama can reuse its KV cache and only evaluate the new messages */
+#ifndef PROMPT_CACHE
+#define PROMPT_CACHE    1
+#endif
+#ifndef KEEP_ALIVE
+#define KEEP_ALIVE      "30m"
+#endif
 
 /* ============================================================
-   HTML REPAIR - FIXED VERSION
-   ============================================================
-   
-   The model outputs ? instead of < and >
-   
-   Rules:
-   1. ?/ is ALWAYS </ (start of closing tag)
-   2. ?! is ALWAYS <! (DOCTYPE or comment)
-   3. Otherwise: closing context → >, opening context → <
-*/
-static char *repair_html(const char *input) {
-    if (!input) return NULL;
-    
-    size_t len = strlen(input);
-    char *output = malloc(len + 1);
-    if (!output) return NULL;
-    
-    size_t j = 0;
-    
-    for (size_t i = 0; i < len; i++) {
-        char c = input[i];
-        
-        if (c != '?') {
-            output[j++] = c;
-            continue;
-        }
-        
-        char prev = (i > 0) ? input[i - 1] : '\0';
-        char next = (i + 1 < len) ? input[i + 1] : '\0';
-        
-        /* SPECIAL CASE: ?/ is ALWAYS the start of a closing tag </  */
-        if (next == '/') {
-            output[j++] = '<';
-            continue;
-        }
-        
-        /* SPECIAL CASE: ?! is ALWAYS start of <!DOCTYPE or <!-- */
-        if (next == '!') {
-            output[j++] = '<';
-            continue;
-        }
-        
-        /* Does next char suggest we're starting a tag? */
-        bool opening = (
-            (next >= 'a' && next <= 'z') ||
-            (next >= 'A' && next <= 'Z')
-        );
-        
-        /* Does previous char suggest we're at end of a tag? */
-        bool closing = (
-            (prev >= 'a' && prev <= 'z') ||
-            (prev >= 'A' && prev <= 'Z') ||
-            (prev >= '0' && prev <= '9') ||
-            prev == '"' ||
-            prev == '\'' ||
-            prev == '/' ||
-            prev == '-' ||
-            prev == ']'
-        );
-        
-        /* Decide based on context */
-        if (closing) {
-            output[j++] = '>';
-        } else if (opening) {
-            output[j++] = '<';
-        } else {
-            output[j++] = '?';
-        }
-    }
-    
-    output[j] = '\0';
-    return output;
-}
+   HTML REPAIR - see repair.h for the rules
+   ============================================================ */
 
 /* Test the repair function - strings split to avoid trigraph warnings */
-static void test_repair(void) {
+static int test_repair(void) {
     printf("\n=== HTML Repair Test ===\n\n");
     
     struct { const char *in; const char *expected; } tests[] = {
@@ -139,72 +194,492 @@ static void test_repair(void) {
     
     printf("Results: %d passed, %d failed\n", passed, failed);
     printf("========================\n\n");
+    return failed;
 }
 
 /* ============================================================
-   CONVERSATION HISTORY
+   INTENT MATCHING - see intent.h
    ============================================================ */
 
-typedef struct { char role[16]; char *content; } Message;
-typedef struct { Message messages[MAX_HISTORY]; int count; } Conversation;
-static Conversation g_conv = {0};
+static IntentTrie g_intents;
 
-static void conv_clear(void) {
-    for (int i = 0; i < g_conv.count; i++) free(g_conv.messages[i].content);
-    g_conv.count = 0;
+static int test_intent(void) {
+    printf("\n=== Intent Match Test ===\n\n");
+    
+    struct { const char *in; const char *expected; } tests[] = {
+        {"read notes.txt", "read notes.txt"},
+        {"Show me the file sub/a.md", "read sub/a.md"},
+        {"please cat 'my notes.txt'", "read my notes.txt"},
+        {"list", "list ."},
+        {"list files in src", "list src"},
+        {"ls sub/", "list sub/"},
+        {"delete old.log", "delete old.log"},
+        {"read a.txt and fix the typo", NULL},
+        {"show help", NULL},
+        {"write a poem to poem.txt", NULL},
+        {"list all python files", NULL},
+        {"list src folder", "list src"},
+        {"ls -la", NULL},
+        {"what is in a.txt?", NULL},
+        {NULL, NULL}
+    };
+    
+    int passed = 0, failed = 0;
+    
+    for (int i = 0; tests[i].in; i++) {
+        Intent in;
+        char got[256] = "(none)";
+        if (intent_match(&g_intents, tests[i].in, &in))
+            snprintf(got, sizeof(got), "%s %.*s", intent_action(in.kind),
+                     in.path ? (int)in.path_len : 1, in.path ? in.path : ".");
+        const char *want = tests[i].expected ? tests[i].expected : "(none)";
+        bool ok = strcmp(got, want) == 0;
+        printf("%s %-32s -> %s\n", ok ? "✓" : "✗", tests[i].in, got);
+        if (ok) passed++; else failed++;
+    }
+    
+    printf("\nResults: %d passed, %d failed\n", passed, failed);
+    printf("========================\n\n");
+    return failed;
 }
 
-static void conv_add(const char *role, const char *content) {
-    if (g_conv.count >= MAX_HISTORY) {
-        free(g_conv.messages[0].content);
-        memmove(&g_conv.messages[0], &g_conv.messages[1], sizeof(Message) * (MAX_HISTORY - 1));
-        g_conv.count--;
+/* ============================================================
+   PATCHES - see patch.h
+   ============================================================ */
+
+static int test_patch(void) {
+    printf("\n=== Patch Test ===\n\n");
+    
+    /* edits are find/replace pairs; want NULL when the patch must fail */
+    struct { const char *name, *src, *edits[4], *diff, *want; } tests[] = {
+        {"replace", "one\ntwo\nthree\n", {"two", "2"}, NULL, "one\n2\nthree\n"},
+        {"two edits", "a = 1;\nb = 2;\n", {"a = 1", "a = 10", "b = 2", "b = 20"}, NULL,
+         "a = 10;\nb = 20;\n"},
+        {"not found", "one\n", {"two", "2"}, NULL, NULL},
+        {"ambiguous", "x x\n", {"x", "y"}, NULL, NULL},
+        {"overlap", "abcdef\n", {"abc", "1", "cde", "2"}, NULL, NULL},
+        {"diff", "one\ntwo\nthree\n", {NULL}, "@@ -2,1 +2,1 @@\n-two\n+TWO\n", "one\nTWO\nthree\n"},
+        {"diff moved", "zero\none\ntwo\nthree\n", {NULL},
+         "--- a/f\n+++ b/f\n@@ -9,3 +9,3 @@\n one\n-two\n+2\n three\n", "zero\none\n2\nthree\n"},
+        {"diff insert", "one\ntwo\n", {NULL}, "@@ -2,0 +3,1 @@\n+three\n", "one\ntwo\nthree\n"},
+        {"diff no eol", "a\nb", {NULL}, "@@ -2 +2 @@\n-b\n+c\n", "a\nc"},
+        {"diff mismatch", "one\ntwo\n", {NULL}, "@@ -1,1 +1,1 @@\n-uno\n+1\n", NULL},
+        {NULL, NULL, {NULL}, NULL, NULL}
+    };
+    
+    int passed = 0, failed = 0;
+    
+    for (int i = 0; tests[i].name; i++) {
+        const char *src = tests[i].src;
+        size_t len = strlen(src);
+        Patch p;
+        patch_init(&p);
+        bool ok = true;
+        for (int j = 0; ok && j < 4 && tests[i].edits[j]; j += 2)
+            ok = patch_edit(&p, src, len, tests[i].edits[j], tests[i].edits[j + 1]);
+        if (ok && tests[i].diff) ok = patch_diff(&p, src, len, tests[i].diff);
+        
+        Buffer got = {0};
+        struct iovec iov[PATCH_MAX_IOV];
+        int n = ok ? patch_iov(&p, src, len, iov) : 0;
+        for (int j = 0; j < n; j++) buf_append(&got, iov[j].iov_base, iov[j].iov_len);
+        bool pass = tests[i].want ? ok && got.data && strcmp(got.data, tests[i].want) == 0 &&
+                                    patch_size(&p, len) == got.size
+                                  : !ok;
+        printf("%s %-14s -> %s\n", pass ? "✓" : "✗", tests[i].name, ok ? "applied" : p.err);
+        if (pass) passed++; else failed++;
+        buf_free(&got);
+        patch_free(&p);
     }
-    int idx = g_conv.count++;
-    strncpy(g_conv.messages[idx].role, role, 15);
-    g_conv.messages[idx].content = strdup(content);
+    
+    printf("\nResults: %d passed, %d failed\n", passed, failed);
+    printf("========================\n\n");
+    return failed;
 }
 
 /* ============================================================
    LOGGING
    ============================================================ */
 
-static FILE *g_log = NULL;
+/* Lines are queued and written by a background thread */
+static AsyncLog g_log = { .fd = -1 };
 
 static void log_open(void) {
-    g_log = fopen(LOG_FILE, "a");
-    if (g_log) {
+    if (AGENT_LOG && alog_open(&g_log, LOG_FILE)) {
         time_t now = time(NULL);
-        fprintf(g_log, "\n=== Session %s", ctime(&now));
+        alog_printf(&g_log, "\n=== Session %s", ctime(&now));
     }
 }
 
-static void log_close(void) { if (g_log) fclose(g_log); g_log = NULL; }
+/* Writes out whatever is still queued */
+static void log_close(void) { alog_close(&g_log); }
 
-static void logf(const char *fmt, ...) {
-    if (!g_log) return;
-    va_list args;
-    va_start(args, fmt);
-    vfprintf(g_log, fmt, args);
-    fprintf(g_log, "\n");
-    fflush(g_log);
-    va_end(args);
+/* ============================================================
+   STATS
+   ============================================================
+   
+   Every turn records the time of each stage in a histogram; `stats`
+   prints percentiles and the table is written to STATS_FILE on exit.
+*/
+
+typedef enum {
+    ST_TURN,            /* input to command done, confirmation included */
+    ST_SERIALIZE,       /* messages to JSON as they enter history */
+    ST_BUILD,           /* scatter list for the request */
+    ST_CONNECT,         /* new connections only */
+    ST_TTFB,            /* request start to first byte */
+    ST_TRANSFER,        /* first byte to last */
+    ST_PARSE,           /* command JSON */
+    ST_REPAIR,
+    ST_FILE_IO,         /* running the command and the flush, minus confirmation */
+    ST_CONFIRM,         /* waiting on the user */
+    ST_PROMPT_EVAL,     /* Ollama's own timings */
+    ST_EVAL,
+    ST_LOAD,
+    ST_PROMPT_TOKENS,   /* from here on counts, not microseconds */
+    ST_EVAL_TOKENS,
+    ST_COUNT
+} Stage;
+
+static const char *const STAGE_NAMES[ST_COUNT] = {
+    "turn", "serialize", "build", "connect", "ttfb", "transfer", "parse",
+    "repair", "file_io", "confirm", "prompt_eval", "eval", "load",
+    "prompt_tokens", "eval_tokens"
+};
+
+/* Shared by every session; the lock is held only for one update */
+static LatHist g_stats[ST_COUNT];
+static pthread_mutex_t g_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void stat_add(Stage s, uint64_t value) {
+    if (!AGENT_STATS) return;
+    pthread_mutex_lock(&g_stats_lock);
+    lat_record(&g_stats[s], value);
+    pthread_mutex_unlock(&g_stats_lock);
+}
+
+/* Start of a timed stage; no clock read at all without AGENT_STATS */
+static uint64_t stat_clock(void) {
+    return AGENT_STATS ? lat_now_us() : 0;
+}
+
+static void stat_since(Stage s, uint64_t start) {
+    if (AGENT_STATS) stat_add(s, lat_now_us() - start);
+}
+
+/* Requests answered by the intent matcher, and those sent to the model */
+static _Atomic unsigned long g_fast_hits, g_model_calls;
+
+static RespCache g_rcache;
+static bool g_rcache_on;        /* --cache */
+static Prefetcher g_prefetch;
+
+/* Under the memory cap: history messages dropped to make room, and
+   messages that did not fit even so */
+static _Atomic unsigned long g_mem_evicted, g_mem_refused;
+
+static void stats_print(FILE *f) {
+    pthread_mutex_lock(&g_stats_lock);
+    if (AGENT_STATS) {
+        fprintf(f, "Times in ms, tokens as counts:\n");
+        lat_print_header(f);
+        for (int s = 0; s < ST_COUNT; s++)
+            lat_print(f, STAGE_NAMES[s], &g_stats[s], s < ST_PROMPT_TOKENS ? 1000.0 : 1.0);
+    }
+    
+    const LatHist *et = &g_stats[ST_EVAL_TOKENS], *ev = &g_stats[ST_EVAL];
+    if (et->sum && ev->sum)
+        fprintf(f, "  eval rate: %.1f tokens/s\n", (double)et->sum * 1e6 / (double)ev->sum);
+    unsigned long hits = g_fast_hits, calls = g_model_calls;
+    if (hits + calls)
+        fprintf(f, "  fast path: %lu of %lu requests (%.0f%%) without the model\n",
+                hits, hits + calls, 100.0 * (double)hits / (double)(hits + calls));
+    pthread_mutex_unlock(&g_stats_lock);
+    if (g_rcache_on) rcache_print(&g_rcache, f);
+    pf_print(&g_prefetch, f);
+    mem_print(f);
+    if (mem_cap())
+        fprintf(f, "  cap: %lu history messages evicted, %lu refused\n",
+                (unsigned long)g_mem_evicted, (unsigned long)g_mem_refused);
+}
+
+static void stats_dump(void) {
+    if (!g_stats[ST_TURN].count) return;
+    FILE *f = fopen(STATS_FILE, "w");
+    if (!f) return;
+    time_t now = time(NULL);
+    fprintf(f, "Session ending %s", ctime(&now));
+    stats_print(f);
+    fclose(f);
 }
 
 /* ============================================================
    CURL
    ============================================================ */
 
-typedef struct { char *data; size_t size; } Buffer;
+/* Keys read from every reply, hashed once in main() */
+static unsigned g_key_action, g_key_path, g_key_content, g_key_message;
+
+static void json_keys_init(void) {
+    g_key_action = cJSON_HashKey("action");
+    g_key_path = cJSON_HashKey("path");
+    g_key_content = cJSON_HashKey("content");
+    g_key_message = cJSON_HashKey("message");
+}
+
+#define get_key(obj, name) cJSON_GetObjectItemWithHash((obj), #name, g_key_##name)
+
+/* ============================================================
+   STREAMING RESPONSE
+   ============================================================
+   
+   With "stream": true Ollama sends one JSON object per line:
+     {"message":{"role":"assistant","content":"<delta>"},"done":false}
+   
+   Deltas are echoed as they arrive and appended to `content`. A small
+   brace scanner watches the deltas so the transfer can stop soon after
+   the command object is closed, instead of waiting for "done". A few
+   more lines are read first, since the final one carries the stats.
+*/
+
+/* Timing fields of the final response object (durations in ns) */
+typedef struct {
+    bool valid;
+    long prompt_eval_count, eval_count;
+    double prompt_eval_ms, eval_ms, load_ms, total_ms;
+} OllamaStats;
+
+static double num_field(const cJSON *j, const char *key) {
+    const cJSON *v = cJSON_GetObjectItem(j, key);
+    return cJSON_IsNumber(v) ? v->valuedouble : 0;
+}
+
+/* prompt_eval_count may be missing when the whole prompt was cached */
+static void read_stats(const cJSON *j, OllamaStats *s) {
+    s->valid = cJSON_IsNumber(cJSON_GetObjectItem(j, "eval_count"));
+    s->prompt_eval_count = (long)num_field(j, "prompt_eval_count");
+    s->eval_count = (long)num_field(j, "eval_count");
+    s->prompt_eval_ms = num_field(j, "prompt_eval_duration") / 1e6;
+    s->eval_ms = num_field(j, "eval_duration") / 1e6;
+    s->load_ms = num_field(j, "load_duration") / 1e6;
+    s->total_ms = num_field(j, "total_duration") / 1e6;
+}
+
+typedef struct {
+    Buffer line;        /* partial NDJSON line carried across callbacks */
+    Buffer content;     /* concatenated message.content deltas */
+    int depth;
+    bool in_str, esc, started;
+    bool complete;      /* command object closed */
+    bool done;          /* server sent "done": true */
+    bool failed;
+    int grace;          /* lines seen since complete */
+} StreamState;
+
+/* ============================================================
+   SESSIONS
+   ============================================================
+   
+   Everything one conversation needs lives in a Session: its history,
+   request and response buffers, JSON arena, HTTP handle, writer and
+   where its output goes. Sessions share only the file cache, the stats
+   and the log, each of which takes its own lock, so any number of them
+   can run on different threads (see engine.h).
+*/
+
+/* A write arriving in numbered parts, one per turn (see chunk_write) */
+typedef struct {
+    AwStream out;               /* the temp file, open across turns */
+    char path[MAX_PATH_LEN];    /* as the model named it */
+    int next;                   /* part expected next; 0 when none is open */
+    int misses;                 /* out-of-order parts in a row */
+    bool more;                  /* the last command asked for another part */
+} ChunkWrite;
+
+typedef struct Session {
+    char name[32];              /* log tag; "" for the interactive session */
+    FILE *out;                  /* command output */
+    bool echo;                  /* print deltas as they arrive */
+    bool unattended;            /* approve changes by policy, never ask */
+    
+    History hist;               /* oldest drop out past MAX_HISTORY or HISTORY_TOKENS */
+    ChatRequest req;
+    HttpConn http;
+    StreamState stream;
+    OllamaStats ostats;
+    Buffer resp;                /* raw HTTP response body */
+    Buffer ctx;                 /* context strings built in run_cmd */
+    /* Every JSON tree in a turn is short-lived: build or parse it here, copy
+       out what is needed, then cJSON_ArenaReset() drops it in one step */
+    cJSON_Arena json;
+    AtomicWriter writer;        /* flushed after every command */
+    
+    EngineReq er;               /* the request in flight, under an engine */
+    char *reply;                /* MAX_CONTENT bytes of the last reply */
+    RcRefs refs;                /* files the conversation has touched */
+    RcKey key;                  /* of the request in flight */
+    char *cached;               /* its reply, when the response cache had one */
+    ChunkWrite chunk;
+    void *userdata;             /* the driver's, e.g. the batch job */
+} Session;
+
+static bool session_init(Session *s, const char *name, FILE *out) {
+    memset(s, 0, sizeof(*s));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->out = out;
+    s->echo = true;
+    hist_init(&s->hist, MAX_HISTORY, HISTORY_TOKENS);
+    s->hist.keep_prefix = PROMPT_CACHE;
+    cJSON_ArenaInit(&s->json, 0);
+    aw_init(&s->writer, WRITE_FSYNC);
+    s->chunk.out.fd = -1;
+    s->reply = mem_malloc(MEM_IO, MAX_CONTENT);
+    return s->reply && http_conn_init(&s->http, OLLAMA_URL, 180L);
+}
+
+static void chunk_abort(Session *s);
+
+static void session_free(Session *s) {
+    chunk_abort(s);
+    hist_clear(&s->hist);
+    chat_req_free(&s->req);
+    http_conn_close(&s->http);
+    buf_free(&s->stream.line);
+    buf_free(&s->stream.content);
+    buf_free(&s->resp);
+    buf_free(&s->ctx);
+    cJSON_ArenaFree(&s->json);
+    aw_free(&s->writer);
+    mem_free(MEM_IO, s->reply);
+    s->reply = NULL;
+    rc_refs_clear(&s->refs);
+    free(s->cached);
+    s->cached = NULL;
+}
+
+/* A fresh conversation: no history, and nothing referenced */
+static void session_clear(Session *s) {
+    chunk_abort(s);
+    hist_clear(&s->hist);
+    rc_refs_clear(&s->refs);
+}
+
+static void slog(Session *s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void slog(Session *s, const char *fmt, ...) {
+    if (!AGENT_LOG) return;
+    va_list args;
+    va_start(args, fmt);
+    alog_vline(&g_log, s->name[0] ? s->name : NULL, fmt, args);
+    va_end(args);
+}
+
+/* Under a memory cap (see mem_acct.h), drop this session's oldest
+   messages until need more bytes fit. The newest is kept: it is the
+   request the coming turn answers. False when even that is not enough;
+   when dropping every message held could not make room, none is dropped. */
+static bool mem_room(Session *s, size_t need) {
+    bool reachable = mem_live() + need <= mem_kind_live(MEM_HISTORY) + mem_cap();
+    while (reachable && !mem_fits(need) && s->hist.count > 1 && hist_drop_oldest(&s->hist))
+        g_mem_evicted++;
+    if (mem_fits(need)) return true;
+    g_mem_refused++;
+    slog(s, "MEM: no room for %zu bytes, %zu live of %zu", need, mem_live(), mem_cap());
+    return false;
+}
+
+/* A message costs its copy plus its JSON, which escaping can make longer */
+static size_t message_cost(size_t len) {
+    return 2 * len + 64;
+}
+
+/* hist_add, timed: this is where each message is serialized */
+static bool history_add(Session *s, const char *role, const char *content) {
+    if (!mem_room(s, message_cost(strlen(content)))) return false;
+    uint64_t t = stat_clock();
+    bool ok = hist_add(&s->hist, role, content);
+    stat_since(ST_SERIALIZE, t);
+    return ok;
+}
+
 
-static size_t curl_cb(void *p, size_t sz, size_t n, void *u) {
-    Buffer *b = u;
+/* Track JSON nesting in the model's output; true once the top-level
+   object or array has been closed. */
+static bool stream_scan(StreamState *st, const char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = p[i];
+        if (!st->started) {
+            if (c == '{' || c == '[') { st->started = true; st->depth = 1; }
+            continue;
+        }
+        if (st->in_str) {
+            if (st->esc) st->esc = false;
+            else if (c == '\\') st->esc = true;
+            else if (c == '"') st->in_str = false;
+        } else if (c == '"') {
+            st->in_str = true;
+        } else if (c == '{' || c == '[') {
+            st->depth++;
+        } else if ((c == '}' || c == ']') && --st->depth == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void stream_line(Session *s, const char *line, size_t len) {
+    StreamState *st = &s->stream;
+    cJSON *j = cJSON_ParseWithLengthInArena(&s->json, line, len);
+    if (!j) { cJSON_ArenaReset(&s->json); return; }
+    
+    cJSON *msg = get_key(j, message);
+    cJSON *delta = msg ? get_key(msg, content) : NULL;
+    if (st->complete) {
+        st->grace++;
+    } else if (cJSON_IsString(delta) && delta->valuestring[0]) {
+        size_t dlen = strlen(delta->valuestring);
+        if (!buf_append(&st->content, delta->valuestring, dlen)) st->failed = true;
+        if (s->echo) {
+            fwrite(delta->valuestring, 1, dlen, s->out);
+            fflush(s->out);
+        }
+        if (stream_scan(st, delta->valuestring, dlen)) st->complete = true;
+    }
+    if (cJSON_IsTrue(cJSON_GetObjectItem(j, "done"))) {
+        st->done = true;
+        read_stats(j, &s->ostats);
+    }
+    if (cJSON_GetObjectItem(j, "error")) st->failed = true;
+    cJSON_ArenaReset(&s->json);
+}
+
+static size_t stream_cb(void *p, size_t sz, size_t n, void *u) {
+    Session *s = u;
+    StreamState *st = &s->stream;
     size_t len = sz * n;
-    b->data = realloc(b->data, b->size + len + 1);
-    if (!b->data) return 0;
-    memcpy(b->data + b->size, p, len);
-    b->size += len;
-    b->data[b->size] = 0;
+    const char *data = p, *end = data + len;
+    
+    while (data < end && !st->done && !st->failed && st->grace < STREAM_GRACE) {
+        const char *nl = memchr(data, '\n', (size_t)(end - data));
+        if (!nl) {
+            if (!buf_append(&st->line, data, (size_t)(end - data))) return 0;
+            break;
+        }
+        if (st->line.size) {
+            if (!buf_append(&st->line, data, (size_t)(nl - data))) return 0;
+            stream_line(s, st->line.data, st->line.size);
+            buf_reset(&st->line);
+        } else if (nl > data) {
+            stream_line(s, data, (size_t)(nl - data));
+        }
+        data = nl + 1;
+    }
+    
+    /* Returning short aborts the transfer (CURLE_WRITE_ERROR); past the
+       grace lines the model is only padding the object with whitespace.
+       The aborted connection is not reused, which costs one local connect
+       next turn. */
+    if (st->failed || (st->complete && !st->done && st->grace >= STREAM_GRACE)) return 0;
     return len;
 }
 
@@ -212,73 +687,255 @@ static size_t curl_cb(void *p, size_t sz, size_t n, void *u) {
    FILE OPERATIONS
    ============================================================ */
 
+/* Where one command's effects go. A single command writes straight to
+   the session; each of several running at once gets its own output,
+   scratch buffer and writer, and its context is collected in followup
+   so the lot reaches the model as one message. */
+typedef struct {
+    FILE *out;
+    Buffer *ctx;                /* scratch for context strings */
+    AtomicWriter *writer;
+    Buffer *followup;           /* NULL: context goes into history as it comes */
+    uint64_t confirm_us;        /* this command's wait for the user */
+} CmdCtx;
+
+/* The text in x->ctx goes to the model */
+static bool ctx_emit(Session *s, CmdCtx *x) {
+    if (!x->followup) return history_add(s, "assistant", x->ctx->data);
+    if (x->followup->size && !buf_puts(x->followup, "\n\n")) return false;
+    return buf_append(x->followup, x->ctx->data, x->ctx->size);
+}
+
 static bool safe_path(const char *rel, char *out, size_t sz) {
-    if (!rel || !rel[0] || rel[0] == '/' || strstr(rel, "..")) return false;
-    snprintf(out, sz, "%s/%s", ALLOWED_DIR, rel);
-    return true;
+    return sb_path(ALLOWED_DIR, rel, out, sz, false) == SB_OK;
 }
 
-static void mkdirs(const char *path) {
-    char tmp[MAX_PATH_LEN];
-    strncpy(tmp, path, sizeof(tmp) - 1);
-    for (char *p = tmp + strlen(ALLOWED_DIR) + 1; *p; p++) {
-        if (*p == '/') { *p = 0; mkdir(tmp, 0755); *p = '/'; }
-    }
+/* Reads and listings go through this cache; writes and deletes below
+   drop the entries they touch. Sessions share it under g_files_lock,
+   held only while the cache and its entries' context marks are touched:
+   a command pins the entry it uses and prints from it unlocked. */
+static FileCache g_fcache;
+static pthread_mutex_t g_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void cache_log(Session *s, const char *kind, const char *path, long hits_before) {
+    slog(s, "CACHE: %s %s %s (hits=%ld misses=%ld)", kind,
+         g_fcache.hits > hits_before ? "hit" : "miss", path, g_fcache.hits, g_fcache.misses);
 }
 
-static char *file_read(const char *rel, long *sz) {
+/* Pinned; hand it back with entry_done() */
+static CacheEntry *file_read(Session *s, const char *rel) {
     char full[MAX_PATH_LEN];
     if (!safe_path(rel, full, sizeof(full))) return NULL;
-    FILE *f = fopen(full, "r");
-    if (!f) return NULL;
-    fseek(f, 0, SEEK_END);
-    *sz = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    char *buf = malloc(*sz + 1);
-    if (buf) { fread(buf, 1, *sz, f); buf[*sz] = 0; }
-    fclose(f);
-    return buf;
+    pthread_mutex_lock(&g_files_lock);
+    long hits = g_fcache.hits;
+    CacheEntry *e = fcache_file(&g_fcache, full);
+    if (e) {
+        fcache_pin(e);
+        cache_log(s, "read", rel, hits);
+    }
+    pthread_mutex_unlock(&g_files_lock);
+    return e;
+}
+
+static void entry_done(CacheEntry *e) {
+    pthread_mutex_lock(&g_files_lock);
+    fcache_unpin(&g_fcache, e);
+    pthread_mutex_unlock(&g_files_lock);
+}
+
+/* Context for a read: the whole file when it is small, otherwise the
+   first CONTEXT_WINDOW bytes on a line boundary plus an index of line
+   numbers and openings spread over the rest. Returns the bytes shown. */
+static size_t read_context(CmdCtx *x, const char *path, const FileMap *m) {
+    size_t keep = text_cut(m->data, m->size, CONTEXT_WINDOW);
+    
+    buf_reset(x->ctx);
+    buf_printf(x->ctx, "File %s:\n```\n", path);
+    buf_append(x->ctx, m->data, keep);
+    buf_puts(x->ctx, "\n```");
+    if (keep == m->size) return keep;
+    
+    /* One memchr pass over the rest: count lines, note evenly spaced ones */
+    size_t shown = text_lines(m->data, keep), line = shown;
+    size_t step = (m->size - keep) / CONTEXT_INDEX + 1, next = keep;
+    Buffer index = {0};
+    const char *p = m->data + keep, *end = m->data + m->size;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        size_t len = (size_t)((nl ? nl : end) - p);
+        line++;
+        if ((size_t)(p - m->data) >= next) {
+            buf_printf(&index, "  line %zu: %.*s\n", line, (int)(len < 60 ? len : 60), p);
+            next += step;
+        }
+        if (!nl) break;
+        p = nl + 1;
+    }
+    
+    buf_printf(x->ctx, "\n(showing lines 1-%zu of %zu, %zu of %zu bytes)\nLine index:\n%s",
+               shown, line, keep, m->size, index.data ? index.data : "");
+    buf_free(&index);
+    return keep;
 }
 
-static bool file_write(const char *rel, const char *content, bool append) {
+static bool file_write(CmdCtx *x, const char *rel, const char *content, bool append) {
     char full[MAX_PATH_LEN];
     if (!safe_path(rel, full, sizeof(full))) return false;
-    mkdirs(full);
-    FILE *f = fopen(full, append ? "a" : "w");
-    if (!f) return false;
-    fwrite(content, 1, strlen(content), f);
-    fclose(f);
-    return true;
+    /* Drop the cached view so the next read sees the new contents */
+    pthread_mutex_lock(&g_files_lock);
+    fcache_invalidate(&g_fcache, full);
+    pthread_mutex_unlock(&g_files_lock);
+    size_t len = strlen(content);
+    return append ? aw_append(x->writer, full, content, len)
+                  : aw_write(x->writer, full, content, len);
 }
 
-static bool file_delete(const char *rel) {
+static bool file_delete(CmdCtx *x, const char *rel) {
     char full[MAX_PATH_LEN];
     if (!safe_path(rel, full, sizeof(full))) return false;
-    return remove(full) == 0;
+    pthread_mutex_lock(&g_files_lock);
+    fcache_invalidate(&g_fcache, full);
+    pthread_mutex_unlock(&g_files_lock);
+    return aw_remove(x->writer, full);
 }
 
-static char *file_list(const char *rel) {
-    char full[MAX_PATH_LEN];
+static bool list_path(const char *rel, char *full, size_t sz) {
     if (!rel || !rel[0] || strcmp(rel, ".") == 0) {
-        strncpy(full, ALLOWED_DIR, sizeof(full));
-    } else if (!safe_path(rel, full, sizeof(full))) {
-        return NULL;
+        snprintf(full, sz, "%s", ALLOWED_DIR);
+        return true;
+    }
+    return safe_path(rel, full, sz);
+}
+
+/* ---- Prefetch: see prefetch.h ---- */
+
+/* On the prefetch thread: map the file into the cache ahead of the read */
+static void prefetch_warm(const char *full, void *userdata) {
+    (void)userdata;
+    pthread_mutex_lock(&g_files_lock);
+    fcache_file(&g_fcache, full);
+    pthread_mutex_unlock(&g_files_lock);
+}
+
+/* The first few small files shown on a new listing's page */
+static void prefetch_listing(const char *dir, const DirList *l, int first, int n) {
+    int hinted = 0;
+    for (int i = first; i < first + n && i < l->count && hinted < PREFETCH_LIST; i++) {
+        const DirEntry *d = &l->items[i];
+        if (d->type != DT_REG || d->size <= 0 || d->size > (off_t)PREFETCH_MAX_KB << 10) continue;
+        char full[MAX_PATH_LEN];
+        if (snprintf(full, sizeof(full), "%s/%s", dir, d->name) >= (int)sizeof(full)) continue;
+        pf_hint(&g_prefetch, full);
+        hinted++;
+    }
+}
+
+/* Words of the prompt that look like sandbox paths ("fix notes.txt") */
+static void prefetch_prompt(const char *prompt) {
+    const char *p = prompt;
+    while (*p) {
+        while (*p && strchr(" \t\r\n\"'`,;()[]{}<>", *p)) p++;
+        const char *w = p;
+        while (*p && !strchr(" \t\r\n\"'`,;()[]{}<>", *p)) p++;
+        size_t len = (size_t)(p - w);
+        while (len && strchr(".:!?", w[len - 1])) len--;
+        if (!len || len >= MAX_PATH_LEN || (!memchr(w, '.', len) && !memchr(w, '/', len))) continue;
+        
+        char rel[MAX_PATH_LEN], full[MAX_PATH_LEN + 16];
+        memcpy(rel, w, len);
+        rel[len] = 0;
+        if (safe_path(rel, full, sizeof(full))) pf_hint(&g_prefetch, full);
     }
-    DIR *d = opendir(full);
-    if (!d) return NULL;
-    char *out = malloc(4096);
-    if (!out) { closedir(d); return NULL; }
-    out[0] = 0;
-    size_t len = 0;
-    struct dirent *e;
-    while ((e = readdir(d))) {
-        if (e->d_name[0] != '.') {
-            len += snprintf(out + len, 4096 - len, "  %s%s\n",
-                           e->d_name, e->d_type == DT_DIR ? "/" : "");
+}
+
+/* The newest message, when it is the user's, is what the model is
+   working on now */
+static void prefetch_turn(Session *s) {
+    Message *m = s->hist.count ? hist_at(&s->hist, s->hist.count - 1) : NULL;
+    if (PREFETCH && m && strcmp(m->role, "user") == 0) prefetch_prompt(m->content);
+}
+
+/* One page (from 1) of a listing, with a footer when there are more;
+   stamps, when set, gets the entries on the page */
+static char *render_listing(const char *full, int depth, int page, FcStamps *stamps) {
+    DirList l;
+    DirListOpts o = DL_OPTS_DEFAULT;
+    o.max_depth = depth;
+    o.max_entries = LIST_MAX_ENTRIES;
+    if (!dl_read(&l, full, &o)) return NULL;
+    
+    Buffer b = {0};
+    int first = (page - 1) * LIST_PAGE;
+    int n = dl_format(&l, first, LIST_PAGE, &b);
+    if (PREFETCH) prefetch_listing(full, &l, first, n);
+    for (int i = first; stamps && i < first + n; i++) {
+        const DirEntry *d = &l.items[i];
+        if (!fcache_stamp(stamps, d->name, d->size, d->mtime)) {
+            /* Out of memory: no listing rather than one that cannot be checked */
+            dl_free(&l);
+            buf_free(&b);
+            return NULL;
         }
     }
-    closedir(d);
-    return out;
+    if (l.count == 0) {
+        buf_puts(&b, "  (empty)\n");
+    } else if (n == 0) {
+        buf_printf(&b, "  (no page %d: %d entries in %d pages)\n", page, l.count,
+                   (l.count + LIST_PAGE - 1) / LIST_PAGE);
+    } else if (first + n < l.count || l.truncated) {
+        buf_printf(&b, "  (entries %d-%d of %d%s; \"page\": %d lists more)\n", first + 1,
+                   first + n, l.count, l.truncated ? "+" : "", page + 1);
+    }
+    dl_free(&l);
+    return buf_take(&b);
+}
+
+/* The cached view: top level only, first page */
+static char *list_dir(const char *full, FcStamps *stamps) {
+    return render_listing(full, 0, 1, stamps);
+}
+
+/* Pinned, as from file_read() */
+static CacheEntry *file_list(Session *s, const char *rel) {
+    char full[MAX_PATH_LEN];
+    if (!list_path(rel, full, sizeof(full))) return NULL;
+    pthread_mutex_lock(&g_files_lock);
+    long hits = g_fcache.hits;
+    CacheEntry *e = fcache_dir(&g_fcache, full, list_dir);
+    if (e) {
+        fcache_pin(e);
+        cache_log(s, "list", rel && rel[0] ? rel : ".", hits);
+    }
+    pthread_mutex_unlock(&g_files_lock);
+    return e;
+}
+
+/* Deeper walks and later pages are built fresh; free the result */
+static char *file_list_page(const char *rel, int depth, int page) {
+    char full[MAX_PATH_LEN];
+    return list_path(rel, full, sizeof(full)) ? render_listing(full, depth, page, NULL) : NULL;
+}
+
+/* Content already in history unchanged is not sent twice: a short note
+   pointing back at it goes in instead */
+static bool in_context(Session *s, CmdCtx *x, CacheEntry *e, const char *what) {
+    pthread_mutex_lock(&g_files_lock);
+    bool shown = e->ctx_owner == &s->hist && hist_contains(&s->hist, e->ctx_seq);
+    pthread_mutex_unlock(&g_files_lock);
+    if (!shown) return false;
+    buf_reset(x->ctx);
+    if (buf_printf(x->ctx, "%s is unchanged since it was shown above.", what)) ctx_emit(s, x);
+    return true;
+}
+
+static void add_context(Session *s, CmdCtx *x, CacheEntry *e) {
+    /* Only a message of its own can be pointed back at later */
+    if (ctx_emit(s, x) && !x->followup) {
+        pthread_mutex_lock(&g_files_lock);
+        e->ctx_seq = s->hist.last_seq;
+        e->ctx_owner = &s->hist;
+        pthread_mutex_unlock(&g_files_lock);
+    }
 }
 
 /* ============================================================
@@ -291,10 +948,14 @@ static const char *SYS_PROMPT =
 "Format: {\"action\": \"ACTION\", \"path\": \"PATH\", \"content\": \"CONTENT\"}\n"
 "\n"
 "Actions:\n"
-"- list: List files in a directory\n"
+"- list: List files in a directory (with size and date; optional \"depth\": N to\n"
+"  include subdirectories, \"page\": N for later pages of a big directory)\n"
 "- read: READ and DISPLAY a file (DO NOT write, just read it)\n"
 "- write: Create or overwrite a file with new content\n"
 "- append: Add text to end of existing file\n"
+"- patch: Change part of an existing file without resending it: \"edits\":\n"
+"  [{\"find\": OLD, \"replace\": NEW}, ...] where each OLD occurs exactly once,\n"
+"  or a unified diff as content\n"
 "- delete: Remove a file\n"
 "\n"
 "IMPORTANT RULES:\n"
@@ -302,68 +963,217 @@ static const char *SYS_PROMPT =
 "- When user says 'create', 'write', 'make', 'save' → use action \"write\"\n"
 "- For 'read' action: content MUST be empty string \"\"\n"
 "- For 'write' action: content contains the file contents\n"
+"- To change a few lines of a file you have read, use \"patch\", not \"write\"\n"
+"\n"
+"Several steps at once: {\"actions\": [{...}, {...}]} with one object per\n"
+"step, in the order they should happen.\n"
+"\n"
+"A file longer than about 32 KB is written in parts: {\"action\": \"write\",\n"
+"\"path\": P, \"part\": 1, \"content\": FIRST_PIECE}, then part 2, 3, ... each\n"
+"when asked, with \"last\": true on the final part.\n"
 "\n"
 "Return ONLY the JSON object, no explanations.";
 
-static bool call_ollama(char *resp, size_t resp_sz) {
-    CURL *curl = curl_easy_init();
-    if (!curl) return false;
-    
-    Buffer buf = {0};
-    
-    cJSON *req = cJSON_CreateObject();
-    cJSON_AddStringToObject(req, "model", MODEL_NAME);
-    cJSON_AddBoolToObject(req, "stream", false);
-    cJSON_AddStringToObject(req, "format", "json");
-    
-    cJSON *msgs = cJSON_CreateArray();
-    cJSON *sys = cJSON_CreateObject();
-    cJSON_AddStringToObject(sys, "role", "system");
-    cJSON_AddStringToObject(sys, "content", SYS_PROMPT);
-    cJSON_AddItemToArray(msgs, sys);
-    
-    for (int i = 0; i < g_conv.count; i++) {
-        cJSON *m = cJSON_CreateObject();
-        cJSON_AddStringToObject(m, "role", g_conv.messages[i].role);
-        cJSON_AddStringToObject(m, "content", g_conv.messages[i].content);
-        cJSON_AddItemToArray(msgs, m);
+/* Request pieces that never change, serialized once at startup */
+static char *g_prefix, *g_sys_json;
+static size_t g_prefix_len, g_sys_len;
+
+static bool request_init(void) {
+    g_prefix = chat_prefix_json(MODEL_NAME, STREAM_RESPONSE, "json",
+                                PROMPT_CACHE ? KEEP_ALIVE : NULL);
+    g_sys_json = chat_message_json("system", SYS_PROMPT, &g_sys_len);
+    if (!g_prefix || !g_sys_json) return false;
+    g_prefix_len = strlen(g_prefix);
+    return true;
+}
+
+static void request_free(void) {
+    cJSON_free(g_prefix);
+    cJSON_free(g_sys_json);
+}
+
+/* With PROMPT_CACHE on, a prompt_eval_count well below the prompt size
+   means the cached prefix was reused */
+static void log_stats(Session *s, size_t prompt_bytes) {
+    if (!s->ostats.valid) return;
+    stat_add(ST_PROMPT_EVAL, (uint64_t)(s->ostats.prompt_eval_ms * 1000.0));
+    stat_add(ST_EVAL, (uint64_t)(s->ostats.eval_ms * 1000.0));
+    stat_add(ST_LOAD, (uint64_t)(s->ostats.load_ms * 1000.0));
+    stat_add(ST_PROMPT_TOKENS, (uint64_t)s->ostats.prompt_eval_count);
+    stat_add(ST_EVAL_TOKENS, (uint64_t)s->ostats.eval_count);
+    slog(s, "OLLAMA: prompt_eval_count=%ld (~%zu prompt tokens) prompt_eval=%.1fms "
+         "eval_count=%ld eval=%.1fms load=%.1fms",
+         s->ostats.prompt_eval_count, prompt_bytes / HISTORY_TOKEN_BYTES, s->ostats.prompt_eval_ms,
+         s->ostats.eval_count, s->ostats.eval_ms, s->ostats.load_ms);
+}
+
+/* Prefix, system message and history are all pre-serialized */
+static bool request_build(Session *s) {
+    uint64_t t = stat_clock();
+    ChatRequest *req = &s->req;
+    bool built = chat_req_begin(req, g_prefix, g_prefix_len) &&
+                 chat_req_add(req, g_sys_json, g_sys_len);
+    for (int i = 0; built && i < s->hist.count; i++) {
+        Message *m = hist_at(&s->hist, i);
+        built = chat_req_add(req, m->json, m->json_len);
     }
+    if (!built || !chat_req_end(req)) return false;
+    stat_since(ST_BUILD, t);
+    slog(s, "PROMPT: %d msgs, %zu bytes (~%zu tokens), %ld evicted",
+         s->hist.count, req->total, hist_tokens(&s->hist), s->hist.evicted);
+    return true;
+}
+
+static void response_reset(Session *s) {
+    s->ostats.valid = false;
+    if (STREAM_RESPONSE) {
+        /* Keep the two buffers' allocations, reset everything else */
+        StreamState *st = &s->stream;
+        Buffer line = st->line, content = st->content;
+        memset(st, 0, sizeof(*st));
+        st->line = line;
+        st->content = content;
+        buf_reset(&st->line);
+        buf_reset(&st->content);
+    } else {
+        buf_reset(&s->resp);
+    }
+}
+
+/* ---- Response cache: see response_cache.h ---- */
+
+/* Look the built request up; a hit leaves the reply in s->cached and
+   nothing needs to be sent */
+static bool cache_hit(Session *s) {
+    free(s->cached);
+    s->cached = NULL;
+    if (!g_rcache_on) { g_model_calls++; return false; }
+    uint64_t t = lat_now_us();
+    s->key = rcache_key(s->req.iov, s->req.count);
+    s->cached = rcache_get(&g_rcache, s->key);
+    slog(s, "RCACHE: %s, %zu byte request, %.2fms", s->cached ? "hit" : "miss",
+         s->key.len, (double)(lat_now_us() - t) / 1000.0);
+    if (!s->cached) g_model_calls++;
+    return s->cached != NULL;
+}
+
+static bool cache_take(Session *s, char *resp, size_t resp_sz) {
+    snprintf(resp, resp_sz, "%s", s->cached);
+    free(s->cached);
+    s->cached = NULL;
+    return true;
+}
+
+static void cache_store(Session *s, const char *reply) {
+    if (g_rcache_on) rcache_put(&g_rcache, s->key, reply, &s->refs);
+}
+
+static bool response_finish(Session *s, CURLcode res, char *resp, size_t resp_sz) {
+    StreamState *st = &s->stream;
+    /* An early stop after the command closed is not an error */
+    if (STREAM_RESPONSE && res == CURLE_WRITE_ERROR && st->complete) res = CURLE_OK;
     
-    cJSON_AddItemToObject(req, "messages", msgs);
-    
-    char *post = cJSON_PrintUnformatted(req);
-    cJSON_Delete(req);
-    
-    curl_easy_setopt(curl, CURLOPT_URL, OLLAMA_URL);
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 180L);
-    
-    struct curl_slist *h = curl_slist_append(NULL, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, h);
+    if (!s->http.reused) stat_add(ST_CONNECT, (uint64_t)(s->http.connect_time * 1e6));
+    stat_add(ST_TTFB, (uint64_t)(s->http.ttfb * 1e6));
+    stat_add(ST_TRANSFER, (uint64_t)((s->http.total_time - s->http.ttfb) * 1e6));
+    slog(s, "HTTP: %s connect=%.1fms ttfb=%.1fms total=%.1fms",
+         s->http.reused ? "reused" : "new",
+         s->http.connect_time * 1000.0, s->http.ttfb * 1000.0, s->http.total_time * 1000.0);
     
-    CURLcode res = curl_easy_perform(curl);
-    free(post);
-    curl_slist_free_all(h);
-    curl_easy_cleanup(curl);
+    if (STREAM_RESPONSE) {
+        bool ok = res == CURLE_OK && !st->failed && st->content.size;
+        if (ok) {
+            strncpy(resp, st->content.data, resp_sz - 1);
+            resp[resp_sz - 1] = 0;
+            if (st->complete && !st->done) slog(s, "STREAM: command complete, stopped early");
+            cache_store(s, resp);
+        }
+        log_stats(s, s->req.total);
+        return ok;
+    }
     
-    if (res != CURLE_OK || !buf.data) { free(buf.data); return false; }
+    if (res != CURLE_OK || !s->resp.size) return false;
     
-    cJSON *r = cJSON_Parse(buf.data);
-    free(buf.data);
-    if (!r) return false;
+    cJSON *r = cJSON_ParseWithLengthInArena(&s->json, s->resp.data, s->resp.size);
+    if (!r) { cJSON_ArenaReset(&s->json); return false; }
+    read_stats(r, &s->ostats);
+    log_stats(s, s->req.total);
     
-    cJSON *msg = cJSON_GetObjectItem(r, "message");
-    cJSON *content = msg ? cJSON_GetObjectItem(msg, "content") : NULL;
-    if (!cJSON_IsString(content)) { cJSON_Delete(r); return false; }
+    cJSON *msg = get_key(r, message);
+    cJSON *content = msg ? get_key(msg, content) : NULL;
+    if (!cJSON_IsString(content)) { cJSON_ArenaReset(&s->json); return false; }
     
     strncpy(resp, content->valuestring, resp_sz - 1);
-    cJSON_Delete(r);
+    resp[resp_sz - 1] = 0;
+    cJSON_ArenaReset(&s->json);
+    cache_store(s, resp);
+    return true;
+}
+
+static http_write_fn response_sink(Session *s, void **userdata) {
+    if (STREAM_RESPONSE) { *userdata = s; return stream_cb; }
+    *userdata = &s->resp;
+    return buf_curl_write;
+}
+
+static bool call_ollama(Session *s, char *resp, size_t resp_sz) {
+    if (!request_build(s)) return false;
+    if (cache_hit(s)) {
+        if (STREAM_RESPONSE) fprintf(s->out, "Model (cached): %s\n", s->cached);
+        return cache_take(s, resp, resp_sz);
+    }
+    prefetch_turn(s);
+    response_reset(s);
+    
+    void *ud;
+    http_write_fn cb = response_sink(s, &ud);
+    if (STREAM_RESPONSE) { fprintf(s->out, "Model: "); fflush(s->out); }
+    CURLcode res = http_conn_post_iov(&s->http, s->req.iov, s->req.count, cb, ud);
+    if (STREAM_RESPONSE) fprintf(s->out, "\n");
+    return response_finish(s, res, resp, resp_sz);
+}
+
+/* Pipelined form for batch mode: send the request now, collect the reply
+   after doing other work. The session must be left alone in between: the
+   request points into its history, and a resend reads it again. */
+static bool call_start(Session *s) {
+    if (!request_build(s)) return false;
+    if (cache_hit(s)) return true;
+    prefetch_turn(s);
+    response_reset(s);
+    void *ud;
+    http_write_fn cb = response_sink(s, &ud);
+    return http_conn_start_iov(&s->http, s->req.iov, s->req.count, cb, ud);
+}
+
+static bool call_finish(Session *s, char *resp, size_t resp_sz) {
+    if (s->cached) return cache_take(s, resp, resp_sz);
+    return response_finish(s, http_conn_finish(&s->http), resp, resp_sz);
+}
+
+/* The same through an engine: done runs on a worker thread with the
+   transfer over; collect the reply there with call_done() */
+static bool call_submit(Session *s, Engine *e, engine_fn done, void *userdata) {
+    if (!request_build(s)) return false;
+    s->er.conn = &s->http;
+    s->er.done = done;
+    s->er.userdata = userdata;
+    /* A hit still goes through a worker, so the caller's flow is the same */
+    if (cache_hit(s)) { engine_post(e, &s->er); return true; }
+    prefetch_turn(s);
+    response_reset(s);
+    void *ud;
+    http_write_fn cb = response_sink(s, &ud);
+    if (!http_conn_prepare_iov(&s->http, s->req.iov, s->req.count, cb, ud)) return false;
+    engine_submit(e, &s->er);
     return true;
 }
 
+static bool call_done(Session *s) {
+    if (s->cached) return cache_take(s, s->reply, MAX_CONTENT);
+    return response_finish(s, s->er.result, s->reply, MAX_CONTENT);
+}
+
 /* ============================================================
    COMMAND HANDLING
    ============================================================ */
@@ -371,171 +1181,1513 @@ static bool call_ollama(char *resp, size_t resp_sz) {
 typedef struct {
     char action[32];
     char path[MAX_PATH_LEN];
-    char *content;
-    char *content_fixed;
+    char *content_fixed;    /* content after HTML repair */
+    size_t repaired;        /* ? turned into < or > */
+    int depth, page;        /* list only */
+    int part;               /* write only: 1, 2, ... for a write in parts, else 0 */
+    bool last;              /* the final part */
+    char **edits;           /* patch only: find, replace, find, replace, ... */
+    int nedits;             /* pairs */
     bool valid;
 } Command;
 
-static Command parse_cmd(const char *json_str) {
-    Command cmd = {0};
-    
-    cJSON *json = cJSON_Parse(json_str);
-    if (!json) return cmd;
-    
-    cJSON *action = cJSON_GetObjectItem(json, "action");
-    cJSON *path = cJSON_GetObjectItem(json, "path");
-    cJSON *content = cJSON_GetObjectItem(json, "content");
-    
-    if (!cJSON_IsString(action)) { cJSON_Delete(json); return cmd; }
-    
-    strncpy(cmd.action, action->valuestring, sizeof(cmd.action) - 1);
-    if (cJSON_IsString(path)) strncpy(cmd.path, path->valuestring, sizeof(cmd.path) - 1);
-    
-    if (cJSON_IsString(content) && content->valuestring[0]) {
-        cmd.content = strdup(content->valuestring);
-        cmd.content_fixed = repair_html(content->valuestring);
-    } else {
-        cmd.content = strdup("");
-        cmd.content_fixed = strdup("");
+#define MAX_ACTIONS  16     /* commands taken from one reply */
+#define CMD_THREADS  4      /* of those, run at once */
+
+typedef struct {
+    Command items[MAX_ACTIONS];
+    int count;
+    int dropped;            /* past MAX_ACTIONS, not run */
+} CmdList;
+
+static char *repaired_copy(Command *cmd, const char *text) {
+    char *copy = mem_strdup(MEM_CMD, text);
+    if (copy) {
+        uint64_t t = stat_clock();
+        cmd->repaired += repair_html_inplace(copy, strlen(copy));
+        stat_since(ST_REPAIR, t);
+    }
+    return copy;
+}
+
+/* A patch's [{"find": OLD, "replace": NEW}, ...]; ill-formed pairs are dropped */
+static void cmd_edits(Command *cmd, const cJSON *edits) {
+    int n = cJSON_GetArraySize(edits);
+    if (!cJSON_IsArray(edits) || !n || !(cmd->edits = mem_calloc(MEM_CMD, (size_t)n * 2, sizeof(char *)))) return;
+    for (const cJSON *e = edits->child; e; e = e->next) {
+        cJSON *find = cJSON_GetObjectItem(e, "find");
+        cJSON *replace = cJSON_GetObjectItem(e, "replace");
+        if (!cJSON_IsString(find) || !cJSON_IsString(replace)) continue;
+        char **pair = &cmd->edits[cmd->nedits * 2];
+        if (!(pair[0] = repaired_copy(cmd, find->valuestring))) break;
+        if (!(pair[1] = repaired_copy(cmd, replace->valuestring))) { mem_free(MEM_CMD, pair[0]); pair[0] = NULL; break; }
+        cmd->nedits++;
+    }
+}
+
+/* One {action, path, content} object; false when it has no action */
+static bool cmd_from_json(const cJSON *json, Command *cmd) {
+    memset(cmd, 0, sizeof(*cmd));
+    cJSON *action = get_key(json, action);
+    cJSON *path = get_key(json, path);
+    cJSON *content = get_key(json, content);
+    
+    if (!cJSON_IsString(action)) return false;
+    
+    strncpy(cmd->action, action->valuestring, sizeof(cmd->action) - 1);
+    if (cJSON_IsString(path)) strncpy(cmd->path, path->valuestring, sizeof(cmd->path) - 1);
+    
+    cJSON *depth = cJSON_GetObjectItem(json, "depth");
+    cJSON *page = cJSON_GetObjectItem(json, "page");
+    if (cJSON_IsNumber(depth) && depth->valueint > 0)
+        cmd->depth = depth->valueint < LIST_MAX_DEPTH ? depth->valueint : LIST_MAX_DEPTH;
+    cmd->page = cJSON_IsNumber(page) && page->valueint > 1 ? page->valueint : 1;
+    cJSON *part = cJSON_GetObjectItem(json, "part");
+    if (cJSON_IsNumber(part) && part->valueint > 0) cmd->part = part->valueint;
+    cmd->last = cJSON_IsTrue(cJSON_GetObjectItem(json, "last"));
+    cmd_edits(cmd, cJSON_GetObjectItem(json, "edits"));
+    
+    if (cJSON_IsString(content) && content->valuestring[0]) {
+        cmd->content_fixed = repaired_copy(cmd, content->valuestring);
+    } else {
+        cmd->content_fixed = mem_strdup(MEM_CMD, "");
+    }
+    cmd->valid = true;
+    return true;
+}
+
+/* A reply is one command object, an array of them, or {"actions": [...]} */
+static bool parse_cmds(Session *s, const char *json_str, CmdList *l) {
+    l->count = l->dropped = 0;
+    
+    uint64_t t = stat_clock();
+    cJSON *json = cJSON_ParseInArena(&s->json, json_str);
+    stat_since(ST_PARSE, t);
+    if (!json) { cJSON_ArenaReset(&s->json); return false; }
+    
+    cJSON *list = cJSON_IsArray(json) ? json : cJSON_GetObjectItem(json, "actions");
+    if (cJSON_IsArray(list)) {
+        for (cJSON *it = list->child; it; it = it->next) {
+            if (l->count == MAX_ACTIONS) { l->dropped++; continue; }
+            if (cmd_from_json(it, &l->items[l->count])) l->count++;
+        }
+    } else if (cmd_from_json(json, &l->items[0])) {
+        l->count = 1;
     }
     
-    cJSON_Delete(json);
-    cmd.valid = true;
-    return cmd;
+    cJSON_ArenaReset(&s->json);
+    return l->count > 0;
+}
+
+static bool fast_match(const char *input, Intent *in) {
+    return FAST_PATH && intent_match(&g_intents, input, in);
+}
+
+/* A plain request straight to its command, no model turn */
+static bool fast_path(Session *s, const char *input, CmdList *l) {
+    l->count = l->dropped = 0;
+    Intent in;
+    if (!fast_match(input, &in)) return false;
+    
+    Command *cmd = &l->items[0];
+    memset(cmd, 0, sizeof(*cmd));
+    strncpy(cmd->action, intent_action(in.kind), sizeof(cmd->action) - 1);
+    if (in.path) snprintf(cmd->path, sizeof(cmd->path), "%.*s", (int)in.path_len, in.path);
+    else strcpy(cmd->path, ".");
+    cmd->page = 1;
+    cmd->content_fixed = mem_strdup(MEM_CMD, "");
+    cmd->valid = true;
+    l->count = 1;
+    g_fast_hits++;
+    slog(s, "FAST: %s %s", cmd->action, cmd->path);
+    return true;
 }
 
 static void cmd_free(Command *cmd) {
-    free(cmd->content);
-    free(cmd->content_fixed);
-    cmd->content = cmd->content_fixed = NULL;
+    mem_free(MEM_CMD, cmd->content_fixed);
+    cmd->content_fixed = NULL;
+    for (int i = 0; i < cmd->nedits * 2; i++) mem_free(MEM_CMD, cmd->edits[i]);
+    mem_free(MEM_CMD, cmd->edits);
+    cmd->edits = NULL;
+    cmd->nedits = 0;
 }
 
-static bool confirm_write(const char *action, const char *path, const char *content) {
-    size_t len = strlen(content);
+static void cmds_free(CmdList *l) {
+    for (int i = 0; i < l->count; i++) cmd_free(&l->items[i]);
+    l->count = 0;
+}
+
+/* What a batch result line or a daemon reply names as the command */
+static const char *cmds_action(const CmdList *l) {
+    return !l || !l->count ? "" : l->count > 1 ? "multi" : l->items[0].action;
+}
+
+static const char *cmds_path(const CmdList *l) {
+    return l && l->count == 1 ? l->items[0].path : "";
+}
+
+/* A y/N answer; the wait is kept out of the file I/O time */
+static bool read_yes(CmdCtx *x) {
+    uint64_t t = stat_clock();
+    char resp[16];
+    bool yes = fgets(resp, sizeof(resp), stdin) && (resp[0] == 'y' || resp[0] == 'Y');
+    x->confirm_us += stat_clock() - t;
+    return yes;
+}
+
+/* ============================================================
+   BATCH POLICY
+   ============================================================
+   
+   In an unattended session nobody is there to answer, so changes are
+   approved by matching the path against the --allow patterns (fnmatch, * also
+   spans /). With no patterns nothing may be changed.
+*/
+
+#define MAX_ALLOW 32
+
+static const char *g_allow[MAX_ALLOW];
+static int g_nallow;
+
+static bool policy_allows(const char *path) {
+    for (int i = 0; i < g_nallow; i++)
+        if (fnmatch(g_allow[i], path, 0) == 0) return true;
+    return false;
+}
+
+/* Ask the user, or in batch mode the policy */
+static bool approve(Session *s, CmdCtx *x, const char *path) {
+    if (!s->unattended) return read_yes(x);
+    bool ok = policy_allows(path);
+    fprintf(x->out, "%s by policy\n", ok ? "approved" : "denied");
+    return ok;
+}
+
+/* Boxed preview of text under a heading, then ask */
+static bool confirm_text(Session *s, CmdCtx *x, const char *path, const char *head,
+                         const char *content, const char *ask) {
+    if (s->unattended) return approve(s, x, path);
     
-    printf("\n┌─────────────────────────────────────────────────────────────────┐\n");
-    printf("│ %s: %s (%zu bytes)\n", action, path, len);
-    printf("├─────────────────────────────────────────────────────────────────┤\n");
+    fprintf(x->out, "\n┌─────────────────────────────────────────────────────────────────┐\n");
+    fprintf(x->out, "│ %s\n", head);
+    fprintf(x->out, "├─────────────────────────────────────────────────────────────────┤\n");
     
     /* Show preview */
     const char *p = content;
     int lines = 0;
     while (*p && lines < 20) {
-        printf("│ ");
+        fprintf(x->out, "│ ");
         int col = 0;
         while (*p && *p != '\n' && col < 63) {
-            putchar(*p++);
+            fputc(*p++, x->out);
             col++;
         }
         if (*p == '\n') p++;
-        printf("\n");
+        fprintf(x->out, "\n");
         lines++;
     }
-    if (*p) printf("│ ... (%zu more bytes)\n", strlen(p));
+    if (*p) fprintf(x->out, "│ ... (%zu more bytes)\n", strlen(p));
     
-    printf("└─────────────────────────────────────────────────────────────────┘\n");
-    printf("Write this content? [y/N]: ");
-    fflush(stdout);
+    fprintf(x->out, "└─────────────────────────────────────────────────────────────────┘\n");
+    fprintf(x->out, "%s [y/N]: ", ask);
+    fflush(x->out);
     
-    char resp[16];
-    if (!fgets(resp, sizeof(resp), stdin)) return false;
-    return (resp[0] == 'y' || resp[0] == 'Y');
+    return approve(s, x, path);
+}
+
+static bool confirm_write(Session *s, CmdCtx *x, const char *action, const char *path, const char *content) {
+    char head[MAX_PATH_LEN + 64];
+    snprintf(head, sizeof(head), "%s: %s (%zu bytes)", action, path, strlen(content));
+    return confirm_text(s, x, path, head, content, "Write this content?");
+}
+
+/* What a command did, reported per job in batch mode */
+typedef struct {
+    bool ok;
+    char note[192];
+} CmdResult;
+
+static void result_set(CmdResult *r, bool ok, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void result_set(CmdResult *r, bool ok, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(r->note, sizeof(r->note), fmt, args);
+    va_end(args);
+    r->ok = ok;
+}
+
+/* ---- Writes in parts ----
+   
+   {"action": "write", "path": P, "part": 1, "content": ...} opens a temp
+   file for P (see aw_stream_open) and every following part goes straight
+   into it; the part marked "last" renames it into place. Only a short
+   acknowledgement asking for the next part enters history, so a file of
+   any size never sits in the prompt or in memory as a whole. */
+
+static void chunk_abort(Session *s) {
+    ChunkWrite *c = &s->chunk;
+    if (c->next) slog(s, "CHUNK: dropped %s after %d parts", c->path, c->next - 1);
+    aw_stream_abort(&c->out);
+    c->next = c->misses = 0;
+    c->more = false;
 }
 
-static void run_cmd(Command *cmd) {
-    logf("ACTION: %s PATH: %s", cmd->action, cmd->path);
+static CmdResult chunk_write(Session *s, CmdCtx *x, Command *cmd) {
+    ChunkWrite *c = &s->chunk;
+    CmdResult r;
+    
+    if (cmd->part == 1) {
+        char full[MAX_PATH_LEN];
+        if (c->next) chunk_abort(s);
+        if (!safe_path(cmd->path, full, sizeof(full))) {
+            fprintf(x->out, "❌ Invalid path\n");
+            result_set(&r, false, "invalid path");
+            return r;
+        }
+        if (ASKS(CONFIRM_WRITE, s) && !confirm_write(s, x, "WRITE IN PARTS", cmd->path, cmd->content_fixed)) {
+            fprintf(x->out, "Cancelled\n");
+            result_set(&r, false, s->unattended ? "denied by policy" : "cancelled");
+            return r;
+        }
+        if (!aw_stream_open(x->writer, &c->out, full)) {
+            fprintf(x->out, "❌ Write failed\n");
+            result_set(&r, false, "write failed");
+            return r;
+        }
+        snprintf(c->path, sizeof(c->path), "%s", cmd->path);
+        c->next = 1;
+    } else if (!c->next || cmd->part != c->next || strcmp(cmd->path, c->path) != 0) {
+        fprintf(x->out, "❌ Part %d of %s is out of order\n", cmd->part, cmd->path);
+        if (c->next && ++c->misses <= CHUNK_RETRIES) c->more = true;
+        else chunk_abort(s);
+        result_set(&r, false, "part %d out of order", cmd->part);
+        return r;
+    }
+    c->misses = 0;
+    
+    struct iovec iov = { cmd->content_fixed, strlen(cmd->content_fixed) };
+    if (!aw_stream_writev(&c->out, &iov, 1) || (!cmd->last && c->next == CHUNK_MAX_PARTS)) {
+        fprintf(x->out, "❌ Write failed at part %d\n", cmd->part);
+        chunk_abort(s);
+        result_set(&r, false, "write failed at part %d", cmd->part);
+        return r;
+    }
+    if (!cmd->last) {
+        c->next++;
+        c->more = true;
+        fprintf(x->out, "✓ Part %d: %zu bytes, %zu so far for %s\n", cmd->part, iov.iov_len,
+                c->out.bytes, c->path);
+        result_set(&r, true, "part %d, %zu bytes so far", cmd->part, c->out.bytes);
+        return r;
+    }
+    
+    /* The last part: drop the cached view, then rename into place */
+    size_t total = c->out.bytes;
+    pthread_mutex_lock(&g_files_lock);
+    fcache_invalidate(&g_fcache, c->out.path);
+    pthread_mutex_unlock(&g_files_lock);
+    bool ok = aw_stream_commit(x->writer, &c->out);
+    c->next = 0;
+    if (ok) {
+        fprintf(x->out, "✓ Wrote %zu bytes to %s in %d parts\n", total, c->path, cmd->part);
+        slog(s, "WROTE %zu bytes to %s in %d parts", total, c->path, cmd->part);
+        result_set(&r, true, "wrote %zu bytes in %d parts", total, cmd->part);
+    } else {
+        fprintf(x->out, "❌ Write failed\n");
+        result_set(&r, false, "write failed");
+    }
+    return r;
+}
+
+/* After a model turn: true, with the request for the next part added to
+   history, when a write in parts is waiting for one */
+static bool chunk_next(Session *s) {
+    ChunkWrite *c = &s->chunk;
+    if (!c->more || !c->next) return false;
+    c->more = false;
+    char msg[MAX_PATH_LEN + 192];
+    if (c->misses)
+        snprintf(msg, sizeof(msg), "That part was out of order. Send part %d of %s next.",
+                 c->next, c->path);
+    else
+        snprintf(msg, sizeof(msg), "Part %d of %s saved (%zu bytes so far). Send part %d the "
+                 "same way, with \"last\": true on the final part.", c->next - 1, c->path,
+                 c->out.bytes, c->next);
+    slog(s, "CHUNK: %s", msg);
+    return history_add(s, "user", msg);
+}
+
+/* ---- Patches: see patch.h ---- */
+
+/* Search/replace edits and a unified diff in content, against the file
+   as it is now; only the hunks are shown for confirmation */
+static CmdResult patch_cmd(Session *s, CmdCtx *x, Command *cmd) {
+    CmdResult r;
+    char full[MAX_PATH_LEN];
+    FileMap m;
+    if (!safe_path(cmd->path, full, sizeof(full)) || !fmap_open(&m, full)) {
+        fprintf(x->out, "❌ Cannot patch %s\n", cmd->path);
+        result_set(&r, false, "cannot open");
+        return r;
+    }
+    
+    Patch p;
+    patch_init(&p);
+    bool ok = cmd->nedits || cmd->content_fixed[0];
+    if (!ok) snprintf(p.err, sizeof(p.err), "no edits");
+    for (int i = 0; ok && i < cmd->nedits; i++)
+        ok = patch_edit(&p, m.data, m.size, cmd->edits[2 * i], cmd->edits[2 * i + 1]);
+    if (ok && cmd->content_fixed[0]) ok = patch_diff(&p, m.data, m.size, cmd->content_fixed);
+    
+    Buffer preview = {0};
+    char head[MAX_PATH_LEN + 96];
+    size_t size = patch_size(&p, m.size);
+    snprintf(head, sizeof(head), "PATCH: %s (%d hunk%s, %zu → %zu bytes)", cmd->path,
+             p.count, p.count == 1 ? "" : "s", m.size, size);
+    if (!ok) {
+        fprintf(x->out, "❌ Patch failed: %s\n", p.err);
+        result_set(&r, false, "patch failed: %s", p.err);
+    } else if (!p.count) {
+        fprintf(x->out, "✓ %s already matches\n", cmd->path);
+        result_set(&r, true, "no changes");
+    } else if (!patch_preview(&p, m.data, &preview)) {
+        fprintf(x->out, "❌ Out of memory\n");
+        result_set(&r, false, "out of memory");
+    } else if (ASKS(CONFIRM_WRITE, s) && !confirm_text(s, x, cmd->path, head, preview.data, "Apply these changes?")) {
+        fprintf(x->out, "Cancelled\n");
+        result_set(&r, false, s->unattended ? "denied by policy" : "cancelled");
+    } else {
+        struct iovec iov[PATCH_MAX_IOV];
+        int n = patch_iov(&p, m.data, m.size, iov);
+        pthread_mutex_lock(&g_files_lock);
+        fcache_invalidate(&g_fcache, full);
+        pthread_mutex_unlock(&g_files_lock);
+        if (aw_writev(x->writer, full, iov, n)) {
+            fprintf(x->out, "✓ Patched %s: %d hunk%s, now %zu bytes\n", cmd->path, p.count,
+                    p.count == 1 ? "" : "s", size);
+            slog(s, "PATCHED %s: %d hunks, %zu -> %zu bytes", cmd->path, p.count, m.size, size);
+            result_set(&r, true, "patched %d hunks, %zu bytes", p.count, size);
+        } else {
+            fprintf(x->out, "❌ Write failed\n");
+            result_set(&r, false, "write failed");
+        }
+    }
+    buf_free(&preview);
+    patch_free(&p);
+    fmap_close(&m);
+    return r;
+}
+
+static CmdResult run_cmd(Session *s, CmdCtx *x, Command *cmd) {
+    CmdResult r = { false, "" };
+    slog(s, "ACTION: %s PATH: %s", cmd->action, cmd->path);
     
     if (strcmp(cmd->action, "list") == 0) {
-        char *list = file_list(cmd->path);
-        if (list) {
-            printf("\n📁 %s:\n%s", cmd->path[0] ? cmd->path : ".", list);
-            char ctx[4096];
-            snprintf(ctx, sizeof(ctx), "Files:\n%s", list);
-            conv_add("assistant", ctx);
-            free(list);
+        const char *name = cmd->path[0] ? cmd->path : ".";
+        if (cmd->depth == 0 && cmd->page == 1) {
+            CacheEntry *e = file_list(s, cmd->path);
+            if (e) {
+                fprintf(x->out, "\n📁 %s:\n%s", name, e->listing);
+                result_set(&r, true, "listed %s", name);
+                if (!in_context(s, x, e, "That listing")) {
+                    buf_reset(x->ctx);
+                    if (buf_printf(x->ctx, "Files in %s:\n%s", name, e->listing)) add_context(s, x, e);
+                }
+                entry_done(e);
+            } else {
+                fprintf(x->out, "❌ Cannot list\n");
+                result_set(&r, false, "cannot list %s", name);
+            }
         } else {
-            printf("❌ Cannot list\n");
+            char *list = file_list_page(cmd->path, cmd->depth, cmd->page);
+            if (list) {
+                fprintf(x->out, "\n📁 %s (depth %d, page %d):\n%s", name, cmd->depth, cmd->page, list);
+                result_set(&r, true, "listed %s, depth %d, page %d", name, cmd->depth, cmd->page);
+                buf_reset(x->ctx);
+                if (buf_printf(x->ctx, "Files in %s (depth %d, page %d):\n%s", name, cmd->depth,
+                               cmd->page, list))
+                    ctx_emit(s, x);
+                free(list);
+            } else {
+                fprintf(x->out, "❌ Cannot list\n");
+                result_set(&r, false, "cannot list %s", name);
+            }
         }
     }
     else if (strcmp(cmd->action, "read") == 0) {
-        long sz;
-        char *content = file_read(cmd->path, &sz);
-        if (content) {
-            printf("\n📄 %s (%ld bytes):\n", cmd->path, sz);
-            printf("────────────────────────────────────────\n");
-            printf("%s\n", content);
-            printf("────────────────────────────────────────\n");
+        CacheEntry *e = file_read(s, cmd->path);
+        if (e) {
+            const FileMap *m = &e->map;
+            fprintf(x->out, "\n📄 %s (%zu bytes):\n", cmd->path, m->size);
+            result_set(&r, true, "read %zu bytes", m->size);
+            fprintf(x->out, "────────────────────────────────────────\n");
+            fwrite(m->data, 1, m->size, x->out);
+            fprintf(x->out, "\n────────────────────────────────────────\n");
             
-            char *ctx = malloc(sz + 256);
-            if (ctx) {
-                snprintf(ctx, sz + 256, "File %s:\n```\n%s\n```", cmd->path, content);
-                conv_add("assistant", ctx);
-                free(ctx);
+            char what[MAX_PATH_LEN + 8];
+            snprintf(what, sizeof(what), "File %s", cmd->path);
+            if (in_context(s, x, e, what)) {
+                fprintf(x->out, "✓ Unchanged, already in context\n");
+            } else if (!mem_room(s, message_cost(text_cut(m->data, m->size, CONTEXT_WINDOW)))) {
+                /* Oversized for the cap: shown, but the model never gets it */
+                fprintf(x->out, "❌ Not loaded into context: over the memory cap\n");
+                result_set(&r, false, "over the memory cap");
+            } else {
+                size_t shown = read_context(x, cmd->path, m);
+                add_context(s, x, e);
+                if (shown < m->size) fprintf(x->out, "✓ Loaded first %zu KB and a line index into context\n", shown / 1024);
+                else fprintf(x->out, "✓ Loaded into context\n");
             }
-            printf("✓ Loaded into context\n");
-            free(content);
+            entry_done(e);
         } else {
-            printf("❌ Cannot read %s\n", cmd->path);
+            fprintf(x->out, "❌ Cannot read %s\n", cmd->path);
+            result_set(&r, false, "cannot read");
         }
     }
+    else if (strcmp(cmd->action, "write") == 0 && cmd->part) {
+        return chunk_write(s, x, cmd);
+    }
     else if (strcmp(cmd->action, "write") == 0) {
         if (!cmd->content_fixed || !cmd->content_fixed[0]) {
-            printf("❌ No content\n");
-            return;
+            fprintf(x->out, "❌ No content\n");
+            result_set(&r, false, "no content");
+            return r;
         }
         
         /* Show if repair happened */
-        if (strcmp(cmd->content, cmd->content_fixed) != 0) {
-            printf("\n🔧 HTML tags repaired (? → < >)\n");
+        if (cmd->repaired) {
+            fprintf(x->out, "\n🔧 HTML tags repaired (%zu ? → < >)\n", cmd->repaired);
         }
         
-        if (!CONFIRM_WRITE || confirm_write("WRITE", cmd->path, cmd->content_fixed)) {
-            if (file_write(cmd->path, cmd->content_fixed, false)) {
-                printf("✓ Wrote %zu bytes to %s\n", strlen(cmd->content_fixed), cmd->path);
-                logf("WROTE %zu bytes to %s", strlen(cmd->content_fixed), cmd->path);
+        if (!ASKS(CONFIRM_WRITE, s) || confirm_write(s, x, "WRITE", cmd->path, cmd->content_fixed)) {
+            if (file_write(x, cmd->path, cmd->content_fixed, false)) {
+                fprintf(x->out, "✓ Wrote %zu bytes to %s\n", strlen(cmd->content_fixed), cmd->path);
+                slog(s, "WROTE %zu bytes to %s", strlen(cmd->content_fixed), cmd->path);
+                result_set(&r, true, "wrote %zu bytes", strlen(cmd->content_fixed));
             } else {
-                printf("❌ Write failed\n");
+                fprintf(x->out, "❌ Write failed\n");
+                result_set(&r, false, "write failed");
             }
         } else {
-            printf("Cancelled\n");
+            fprintf(x->out, "Cancelled\n");
+            result_set(&r, false, s->unattended ? "denied by policy" : "cancelled");
         }
     }
+    else if (strcmp(cmd->action, "patch") == 0) {
+        if (cmd->repaired) fprintf(x->out, "\n🔧 HTML tags repaired (%zu ? → < >)\n", cmd->repaired);
+        return patch_cmd(s, x, cmd);
+    }
     else if (strcmp(cmd->action, "append") == 0) {
-        if (file_write(cmd->path, cmd->content_fixed, true)) {
-            printf("✓ Appended to %s\n", cmd->path);
+        /* Unattended runs gate every change, not just the prompted ones */
+        if (s->unattended && !policy_allows(cmd->path)) {
+            fprintf(x->out, "Cancelled\n");
+            result_set(&r, false, "denied by policy");
+        } else if (file_write(x, cmd->path, cmd->content_fixed, true)) {
+            fprintf(x->out, "✓ Appended to %s\n", cmd->path);
+            result_set(&r, true, "appended %zu bytes", strlen(cmd->content_fixed));
         } else {
-            printf("❌ Append failed\n");
+            fprintf(x->out, "❌ Append failed\n");
+            result_set(&r, false, "append failed");
         }
     }
     else if (strcmp(cmd->action, "delete") == 0) {
-        printf("⚠️  Delete %s? [y/N]: ", cmd->path);
-        fflush(stdout);
-        char resp[16];
-        if (fgets(resp, sizeof(resp), stdin) && (resp[0] == 'y' || resp[0] == 'Y')) {
-            if (file_delete(cmd->path)) printf("✓ Deleted\n");
-            else printf("❌ Failed\n");
+        bool ask = ASKS(CONFIRM_DELETE, s);
+        if (ask) {
+            fprintf(x->out, "⚠️  Delete %s? [y/N]: ", cmd->path);
+            fflush(x->out);
+        }
+        if (!ask || approve(s, x, cmd->path)) {
+            if (file_delete(x, cmd->path)) { fprintf(x->out, "✓ Deleted\n"); result_set(&r, true, "deleted"); }
+            else { fprintf(x->out, "❌ Failed\n"); result_set(&r, false, "delete failed"); }
         } else {
-            printf("Cancelled\n");
+            fprintf(x->out, "Cancelled\n");
+            result_set(&r, false, s->unattended ? "denied by policy" : "cancelled");
         }
     }
     else {
-        printf("❓ Unknown: %s\n", cmd->action);
+        fprintf(x->out, "❓ Unknown: %s\n", cmd->action);
+        result_set(&r, false, "unknown action");
+    }
+    return r;
+}
+
+/* ============================================================
+   SEVERAL COMMANDS PER REPLY
+   ============================================================
+   
+   A reply may carry a list of commands. Two of them must run in order
+   when either changes files and their paths overlap (the same file, or
+   one inside the other); everything else runs at once on up to
+   CMD_THREADS threads. Each command writes into its own output, shown
+   in list order when all are done, and the results plus any context
+   they produced go into history as one follow-up message.
+   
+   Interactive confirmations need the terminal in turn, so with the user
+   present a list containing writes or deletes runs in sequence.
+*/
+
+typedef struct {
+    Command *cmd;
+    CmdResult r;
+    CmdCtx x;
+    Buffer ctx, followup;
+    AtomicWriter writer;
+    char *out;
+    size_t out_len;
+    uint32_t after;         /* bit i: wait for command i */
+    bool started;
+} CmdTask;
+
+typedef struct {
+    Session *s;
+    CmdTask *t;
+    int n;
+    uint32_t done;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} CmdPlan;
+
+static bool mutates(const Command *c) {
+    return strcmp(c->action, "write") == 0 || strcmp(c->action, "append") == 0 ||
+           strcmp(c->action, "patch") == 0 || strcmp(c->action, "delete") == 0;
+}
+
+/* The same path, or one is a directory holding the other, compared as
+   sb_normalize() spells them so "./a", "a/" and "a//b" are caught too */
+static bool paths_overlap(const char *pa, const char *pb) {
+    char na[MAX_PATH_LEN], nb[MAX_PATH_LEN];
+    sb_normalize(pa, na, sizeof(na));
+    sb_normalize(pb, nb, sizeof(nb));
+    const char *a = na, *b = nb;
+    size_t la = strlen(a), lb = strlen(b);
+    if (la > lb) { const char *t = a; a = b; b = t; size_t n = la; la = lb; lb = n; }
+    return la == 0 || (strncmp(a, b, la) == 0 && (b[la] == 0 || b[la] == '/'));
+}
+
+static int test_overlap(void) {
+    printf("\n=== Path Overlap Test ===\n\n");
+    
+    struct { const char *a, *b; bool want; } tests[] = {
+        {"a.txt", "a.txt", true},
+        {"./a.txt", "a.txt", true},
+        {"sub/", "sub/a.txt", true},
+        {"a//b", "a/b", true},
+        {"sub/./a.txt", "sub", true},
+        {".", "x/y", true},
+        {"", "x", true},
+        {"a.txt", "a.txt2", false},
+        {"sub/a", "sub/b", false},
+        {"subdir/a", "sub", false},
+        {NULL, NULL, false}
+    };
+    
+    int passed = 0, failed = 0;
+    for (int i = 0; tests[i].a; i++) {
+        bool got = paths_overlap(tests[i].a, tests[i].b);
+        bool ok = got == tests[i].want;
+        printf("%s %-12s %-12s -> %s\n", ok ? "✓" : "✗", tests[i].a, tests[i].b,
+               got ? "overlap" : "independent");
+        if (ok) passed++; else failed++;
+    }
+    
+    printf("\nResults: %d passed, %d failed\n", passed, failed);
+    printf("========================\n\n");
+    return failed;
+}
+
+/* Take any command whose predecessors are done; the caller runs one of these too */
+static void *plan_worker(void *arg) {
+    CmdPlan *p = arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        int pick = -1, left = 0;
+        for (int i = 0; i < p->n && pick < 0; i++) {
+            if (p->t[i].started) continue;
+            left++;
+            if (!(p->t[i].after & ~p->done)) pick = i;
+        }
+        if (!left) break;
+        if (pick < 0) { pthread_cond_wait(&p->changed, &p->lock); continue; }
+        
+        CmdTask *t = &p->t[pick];
+        t->started = true;
+        pthread_mutex_unlock(&p->lock);
+        
+        t->r = run_cmd(p->s, &t->x, t->cmd);
+        if (!aw_flush(&t->writer)) result_set(&t->r, false, "fsync failed");
+        fclose(t->x.out);
+        
+        pthread_mutex_lock(&p->lock);
+        p->done |= 1u << pick;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void run_parallel(Session *s, CmdTask *t, int n) {
+    for (int i = 0; i < n; i++) {
+        aw_init(&t[i].writer, WRITE_FSYNC);
+        FILE *out = open_memstream(&t[i].out, &t[i].out_len);
+        t[i].x = (CmdCtx){ out ? out : fopen("/dev/null", "w"), &t[i].ctx, &t[i].writer,
+                           &t[i].followup, 0 };
+    }
+    
+    CmdPlan p = { .s = s, .t = t, .n = n };
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.changed, NULL);
+    pthread_t th[CMD_THREADS];
+    int extra = 0, want = (n < CMD_THREADS ? n : CMD_THREADS) - 1;
+    while (extra < want && pthread_create(&th[extra], NULL, plan_worker, &p) == 0) extra++;
+    plan_worker(&p);
+    for (int i = 0; i < extra; i++) pthread_join(th[i], NULL);
+    pthread_cond_destroy(&p.changed);
+    pthread_mutex_destroy(&p.lock);
+    
+    for (int i = 0; i < n; i++) {
+        fprintf(s->out, "\n[%d/%d] %s %s\n", i + 1, n, t[i].cmd->action, t[i].cmd->path);
+        size_t len = t[i].out_len;
+        while (len && t[i].out[len - 1] == '\n') len--;
+        if (len) fprintf(s->out, "%.*s\n", (int)len, t[i].out);
+        free(t[i].out);
+        aw_free(&t[i].writer);
+        buf_free(&t[i].ctx);
+    }
+}
+
+static CmdResult run_several(Session *s, CmdList *l, uint64_t *confirm_us) {
+    int n = l->count;
+    CmdTask t[MAX_ACTIONS];
+    memset(t, 0, sizeof(t));
+    bool asks = false;
+    for (int i = 0; i < n; i++) {
+        t[i].cmd = &l->items[i];
+        for (int j = 0; j < i; j++)
+            if (((mutates(t[i].cmd) || mutates(t[j].cmd)) &&
+                 paths_overlap(t[i].cmd->path, t[j].cmd->path)) ||
+                (t[i].cmd->part && t[j].cmd->part))     /* one write in parts per session */
+                t[i].after |= 1u << j;
+        asks |= mutates(t[i].cmd) && strcmp(t[i].cmd->action, "append") != 0;
+    }
+    slog(s, "MULTI: %d commands%s", n, l->dropped ? ", some dropped" : "");
+    
+    if (s->unattended || !asks) {
+        run_parallel(s, t, n);
+    } else {
+        for (int i = 0; i < n; i++) {
+            fprintf(s->out, "\n[%d/%d] %s %s\n", i + 1, n, t[i].cmd->action, t[i].cmd->path);
+            CmdCtx x = { s->out, &s->ctx, &s->writer, &t[i].followup, 0 };
+            t[i].r = run_cmd(s, &x, t[i].cmd);
+            *confirm_us += x.confirm_us;
+        }
+        if (!aw_flush(&s->writer)) fprintf(s->out, "⚠️  fsync failed\n");
+    }
+    
+    /* One follow-up message: every outcome, then whatever context came back */
+    Buffer msg = {0};
+    int ok = 0;
+    buf_printf(&msg, "Results of the %d commands:\n", n);
+    for (int i = 0; i < n; i++) {
+        buf_printf(&msg, "%d. %s %s: %s\n", i + 1, t[i].cmd->action, t[i].cmd->path, t[i].r.note);
+        if (t[i].r.ok) ok++;
+    }
+    if (l->dropped) buf_printf(&msg, "(%d more commands were not run; at most %d per reply)\n",
+                               l->dropped, MAX_ACTIONS);
+    for (int i = 0; i < n; i++) {
+        if (t[i].followup.size) {
+            buf_puts(&msg, "\n");
+            buf_append(&msg, t[i].followup.data, t[i].followup.size);
+        }
+        buf_free(&t[i].followup);
+    }
+    if (msg.data) history_add(s, "assistant", msg.data);
+    buf_free(&msg);
+    
+    CmdResult r;
+    result_set(&r, ok == n && !l->dropped, "%d of %d commands ok", ok, n + l->dropped);
+    return r;
+}
+
+/* Run a reply's commands and flush their writes */
+static CmdResult cmds_exec(Session *s, CmdList *l) {
+    uint64_t t = stat_clock(), confirm = 0;
+    s->chunk.more = false;
+    for (int i = 0; g_rcache_on && i < l->count; i++) {
+        char full[MAX_PATH_LEN + 16];
+        if (list_path(l->items[i].path, full, sizeof(full))) rc_refs_add(&s->refs, full);
+    }
+    CmdResult r;
+    if (l->count == 1) {
+        CmdCtx x = { s->out, &s->ctx, &s->writer, NULL, 0 };
+        r = run_cmd(s, &x, &l->items[0]);
+        if (!aw_flush(&s->writer)) {
+            fprintf(s->out, "⚠️  fsync failed\n");
+            result_set(&r, false, "fsync failed");
+        }
+        confirm = x.confirm_us;
+    } else {
+        r = run_several(s, l, &confirm);
+    }
+    /* Under a cap, what a big file grew the scratch to is given back */
+    if (mem_cap() && s->ctx.cap > 64 * 1024) buf_free(&s->ctx);
+    stat_add(ST_FILE_IO, stat_clock() - t - confirm);
+    if (confirm) stat_add(ST_CONFIRM, confirm);
+    return r;
+}
+
+/* ============================================================
+   BATCH MODE
+   ============================================================
+   
+   --batch FILE runs one job per line without a terminal: either a plain
+   prompt or {"id": ..., "prompt": "..."}. Jobs are independent (history
+   is cleared for each), so the next job is begun on a second session and
+   its request is already on the wire while the current job's commands
+   run; the upload finishes inside call_start() and the reply is collected
+   by call_finish(). One JSON result line per job goes to stdout,
+   everything else to stderr.
+   
+   With --sessions N above 1 the jobs are spread over N sessions driven by
+   an engine instead, and result lines come in completion order.
+*/
+
+typedef struct {
+    long line;
+    cJSON *id;                  /* string or number; NULL: use the line number */
+    char *prompt;
+} BatchJob;
+
+static FILE *g_results;
+static _Atomic long g_failed;
+
+static void job_free(BatchJob *j) {
+    cJSON_Delete(j->id);
+    mem_free(MEM_CMD, j->prompt);
+    memset(j, 0, sizeof(*j));
+}
+
+/* Next non-blank line as a job; false at end of input */
+static bool job_read(FILE *in, long *lineno, BatchJob *j) {
+    static char *line;
+    static size_t cap;
+    while (true) {
+        ssize_t n = getline(&line, &cap, in);
+        if (n < 0) { free(line); line = NULL; cap = 0; return false; }
+        (*lineno)++;
+        if (n && line[n-1] == '\n') line[--n] = 0;
+        
+        char *p = line;
+        while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+        if (!*p || *p == '#') continue;
+        
+        memset(j, 0, sizeof(*j));
+        j->line = *lineno;
+        if (*p == '{') {
+            cJSON *o = cJSON_Parse(p);
+            cJSON *pr = cJSON_GetObjectItemCaseSensitive(o, "prompt");
+            cJSON *id = cJSON_GetObjectItemCaseSensitive(o, "id");
+            if (cJSON_IsString(pr)) j->prompt = mem_strdup(MEM_CMD, pr->valuestring);
+            if (cJSON_IsString(id) || cJSON_IsNumber(id)) j->id = cJSON_Duplicate(id, 0);
+            cJSON_Delete(o);
+        } else {
+            j->prompt = mem_strdup(MEM_CMD, p);
+        }
+        return true;            /* prompt NULL: malformed line, reported as failed */
+    }
+}
+
+static void job_begin(Session *s, const BatchJob *j) {
+    session_clear(s);
+    history_add(s, "user", j->prompt);
+    slog(s, "BATCH %ld: %s", j->line, j->prompt);
+}
+
+static bool job_start(Session *s, const BatchJob *j) {
+    if (!j->prompt) return false;
+    job_begin(s, j);
+    return !fast_match(j->prompt, NULL) && call_start(s);
+}
+
+static CmdResult job_exec(Session *s, long line, CmdList *l) {
+    if (l->count == 1) fprintf(s->out, "[%ld] %s %s\n", line, l->items[0].action, l->items[0].path);
+    else fprintf(s->out, "[%ld] %d commands\n", line, l->count);
+    return cmds_exec(s, l);
+}
+
+/* The rest of a write in parts, one blocking turn per part */
+static CmdResult job_follow(Session *s, long line) {
+    CmdResult r;
+    CmdList cmds;
+    if (!call_start(s) || !call_finish(s, s->reply, MAX_CONTENT)) {
+        result_set(&r, false, "model error");
+        return r;
     }
+    slog(s, "MODEL: %s", s->reply);
+    if (!parse_cmds(s, s->reply, &cmds)) { result_set(&r, false, "parse error"); return r; }
+    r = job_exec(s, line, &cmds);
+    cmds_free(&cmds);
+    return r;
+}
+
+/* One line, in a single write so concurrent sessions never interleave */
+static void job_report(const BatchJob *j, const CmdList *cmds, const CmdResult *r, uint64_t us) {
+    cJSON *o = cJSON_CreateObject();
+    if (j->id) cJSON_AddItemToObject(o, "id", cJSON_Duplicate(j->id, 0));
+    else cJSON_AddNumberToObject(o, "id", (double)j->line);
+    cJSON_AddNumberToObject(o, "line", (double)j->line);
+    cJSON_AddBoolToObject(o, "ok", r->ok);
+    cJSON_AddStringToObject(o, "action", cmds_action(cmds));
+    cJSON_AddStringToObject(o, "path", cmds_path(cmds));
+    cJSON_AddStringToObject(o, "result", r->note);
+    cJSON_AddNumberToObject(o, "ms", (double)(us / 1000));
+    char *out = cJSON_PrintUnformatted(o);
+    if (out) { fprintf(g_results, "%s\n", out); cJSON_free(out); }
+    fflush(g_results);
+    cJSON_Delete(o);
+    stat_add(ST_TURN, us);
+    if (!r->ok) g_failed++;
+}
+
+/* Results own the real stdout; the chatter of run_cmd goes to stderr */
+static void batch_redirect(void) {
+    g_results = fdopen(dup(STDOUT_FILENO), "w");
+    fflush(stdout);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+/* Two sessions take turns: the next job is begun and its request put on
+   the wire by the one that sits idle, so the running job's commands, the
+   context they add and the files they touch stay in its own session */
+static void run_pipelined(Session *s, Session *spare, FILE *in) {
+    Session *pair[2] = { s, spare };
+    int at = 0;
+    long lineno = 0;
+    BatchJob cur, next;
+    bool have = job_read(in, &lineno, &cur);
+    bool sent = have && job_start(s, &cur);
+    uint64_t started = lat_now_us();
+    
+    while (have) {
+        Session *cs = pair[at], *ns = pair[at ^ 1];
+        CmdResult r = { false, "" };
+        CmdList cmds = {0};
+        bool parsed = false;
+        if (!cur.prompt) snprintf(r.note, sizeof(r.note), "bad job line");
+        else if (fast_path(cs, cur.prompt, &cmds)) parsed = true;
+        else if (!sent || !call_finish(cs, cs->reply, MAX_CONTENT)) snprintf(r.note, sizeof(r.note), "model error");
+        else {
+            slog(cs, "MODEL: %s", cs->reply);
+            parsed = parse_cmds(cs, cs->reply, &cmds);
+            if (!parsed) snprintf(r.note, sizeof(r.note), "parse error");
+        }
+        
+        /* Put the next request on the wire before touching files; a write
+           in parts goes on over this session's own connection */
+        bool more = job_read(in, &lineno, &next);
+        bool next_sent = more && job_start(ns, &next);
+        
+        if (parsed) r = job_exec(cs, cur.line, &cmds);
+        while (chunk_next(cs)) r = job_follow(cs, cur.line);
+        uint64_t now = lat_now_us();
+        job_report(&cur, &cmds, &r, now - started);
+        started = now;
+        
+        cmds_free(&cmds);
+        job_free(&cur);
+        cur = next;
+        have = more;
+        sent = next_sent;
+        at ^= 1;
+    }
+}
+
+/* Messages in s's history from role, or containing text if that is set */
+static int hist_count(Session *s, const char *role, const char *text) {
+    int n = 0;
+    for (int i = 0; i < s->hist.count; i++) {
+        Message *m = hist_at(&s->hist, i);
+        n += (!role || strcmp(m->role, role) == 0) && (!text || strstr(m->content, text));
+    }
+    return n;
+}
+
+/* A read job and then a list job, over the fast path so no model is
+   needed: the file read by the first must stay in the first's session */
+static int test_batch(void) {
+    printf("\n=== Batch Test ===\n\n");
+    
+    const char *text = "batch test contents";
+    const char *name = ".batch_test.txt";
+    char full[MAX_PATH_LEN], jobs[128];
+    snprintf(full, sizeof(full), "%s/%s", ALLOWED_DIR, name);
+    snprintf(jobs, sizeof(jobs), "read %s\nlist\n", name);
+    mkdir(ALLOWED_DIR, 0755);
+    FILE *f = fopen(full, "w");
+    bool made = f && fputs(text, f) >= 0;
+    if (f) fclose(f);
+    
+    FILE *in = fmemopen(jobs, strlen(jobs), "r");
+    FILE *sink = fopen("/dev/null", "w");
+    fcache_init(&g_fcache, (size_t)FILE_CACHE_MB << 20);
+    Session a, b;
+    bool init_a = session_init(&a, "", sink), init_b = session_init(&b, "", sink);
+    bool ran = FAST_PATH && made && in && sink && init_a && init_b;
+    if (ran) {
+        a.unattended = b.unattended = true;
+        g_results = sink;
+        run_pipelined(&a, &b, in);
+    }
+    
+    struct { const char *name; bool ok; } tests[] = {
+        {"jobs ran", ran},
+        {"first has its prompt", ran && hist_count(&a, "user", NULL) == 1 &&
+                                 hist_count(&a, "user", name) == 1},
+        {"first has its file", ran && hist_count(&a, NULL, text) == 1},
+        {"second has only its prompt", ran && hist_count(&b, "user", NULL) == 1 &&
+                                       strcmp(hist_at(&b.hist, 0)->content, "list") == 0},
+        {"second has no file", ran && hist_count(&b, NULL, text) == 0},
+        {NULL, false}
+    };
+    
+    int passed = 0, failed = 0;
+    for (int i = 0; tests[i].name; i++) {
+        printf("%s %s\n", tests[i].ok ? "✓" : "✗", tests[i].name);
+        if (tests[i].ok) passed++; else failed++;
+    }
+    
+    session_free(&a);
+    session_free(&b);
+    fcache_free(&g_fcache);
+    g_results = NULL;
+    if (sink) fclose(sink);
+    if (in) fclose(in);
+    unlink(full);
+    
+    printf("\nResults: %d passed, %d failed\n", passed, failed);
+    printf("========================\n\n");
+    return failed;
+}
+
+/* ---- Many sessions over one engine ---- */
+
+/* A session working through the shared job list; its output for each
+   job is collected and copied to stderr in one piece when the job ends */
+typedef struct {
+    Session s;
+    BatchJob job;
+    uint64_t started;
+    char *chat;
+    size_t chat_len;
+} BatchLane;
+
+static Engine g_engine;
+static FILE *g_jobs_in;
+static long g_jobs_line;
+static pthread_mutex_t g_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void lane_step(BatchLane *l);
+
+static void lane_end(BatchLane *l, const CmdList *cmds, const CmdResult *r) {
+    job_report(&l->job, cmds, r, lat_now_us() - l->started);
+    fclose(l->s.out);
+    fwrite(l->chat, 1, l->chat_len, stderr);
+    free(l->chat);
+    l->chat = NULL;
+    job_free(&l->job);
+}
+
+/* Runs on an engine worker once the reply is in */
+static void lane_done(EngineReq *er) {
+    BatchLane *l = er->userdata;
+    Session *s = &l->s;
+    CmdResult r = { false, "" };
+    CmdList cmds = {0};
+    if (!call_done(s)) {
+        snprintf(r.note, sizeof(r.note), "model error");
+    } else {
+        slog(s, "MODEL: %s", s->reply);
+        if (parse_cmds(s, s->reply, &cmds)) r = job_exec(s, l->job.line, &cmds);
+        else snprintf(r.note, sizeof(r.note), "parse error");
+    }
+    /* A write in parts keeps the job going with another turn */
+    if (chunk_next(s) && call_submit(s, &g_engine, lane_done, l)) {
+        cmds_free(&cmds);
+        return;
+    }
+    lane_end(l, &cmds, &r);
+    cmds_free(&cmds);
+    lane_step(l);
+}
+
+/* Take jobs until one is on its way to the model or the input is used up */
+static void lane_step(BatchLane *l) {
+    Session *s = &l->s;
+    while (true) {
+        pthread_mutex_lock(&g_jobs_lock);
+        bool have = job_read(g_jobs_in, &g_jobs_line, &l->job);
+        pthread_mutex_unlock(&g_jobs_lock);
+        if (!have) return;
+        
+        l->started = lat_now_us();
+        s->out = open_memstream(&l->chat, &l->chat_len);
+        if (!s->out) s->out = stderr;
+        if (l->job.prompt) {
+            job_begin(s, &l->job);
+            CmdList cmds;
+            if (fast_path(s, l->job.prompt, &cmds)) {
+                CmdResult r = job_exec(s, l->job.line, &cmds);
+                lane_end(l, &cmds, &r);
+                cmds_free(&cmds);
+                continue;
+            }
+            if (call_submit(s, &g_engine, lane_done, l)) return;
+        }
+        CmdResult r = { false, "" };
+        snprintf(r.note, sizeof(r.note), l->job.prompt ? "model error" : "bad job line");
+        lane_end(l, NULL, &r);
+    }
+}
+
+static bool run_sessions(FILE *in, int count, int max_in_flight) {
+    BatchLane *lanes = calloc((size_t)count, sizeof(*lanes));
+    if (!lanes || !engine_start(&g_engine, ENGINE_WORKERS, max_in_flight)) {
+        free(lanes);
+        return false;
+    }
+    g_jobs_in = in;
+    int ready = 0;
+    for (; ready < count; ready++) {
+        char name[32];
+        snprintf(name, sizeof(name), "s%d", ready + 1);
+        if (!session_init(&lanes[ready].s, name, stderr)) { session_free(&lanes[ready].s); break; }
+        lanes[ready].s.echo = false;
+        lanes[ready].s.unattended = true;
+    }
+    for (int i = 0; i < ready; i++) lane_step(&lanes[i]);
+    engine_wait(&g_engine);
+    engine_print(&g_engine, stderr);
+    engine_stop(&g_engine);
+    for (int i = 0; i < ready; i++) session_free(&lanes[i].s);
+    free(lanes);
+    return ready > 0;
+}
+
+static int run_batch(Session *s, const char *path, int sessions, int max_in_flight) {
+    FILE *in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!in) { fprintf(stderr, "❌ Cannot open %s\n", path); return 1; }
+    
+    batch_redirect();
+    s->unattended = true;
+    s->echo = false;
+    bool ok = true;
+    if (sessions > 1) {
+        ok = run_sessions(in, sessions, max_in_flight);
+    } else {
+        Session spare;
+        ok = session_init(&spare, s->name, s->out);
+        spare.unattended = true;
+        spare.echo = false;
+        if (ok) run_pipelined(s, &spare, in);
+        session_free(&spare);
+    }
+    
+    if (in != stdin) fclose(in);
+    fclose(g_results);
+    fflush(stdout);             /* the chatter, which shares stderr's fd */
+    if (g_rcache_on) rcache_print(&g_rcache, stderr);
+    if (!ok) { fprintf(stderr, "❌ Cannot start sessions\n"); return 1; }
+    return g_failed ? 2 : 0;
+}
+
+/* ============================================================
+   DAEMON MODE
+   ============================================================
+   
+   --serve SOCKET listens on a Unix socket and keeps everything warm
+   between calls: curl, the connection pool, the file cache, the log.
+   Each connection gets a session of its own that lasts as long as it
+   does. Requests and replies are one JSON object per line:
+   
+     {"action": "read", "path": "a.txt"}     run directly, no model
+     {"actions": [{...}, {...}]}             several, as a model reply may
+     {"prompt": "show me a.txt"}             one model turn
+     {"action": "stats" | "clear" | "ping"}  daemon controls
+   
+     {"ok": true, "action": "read", "path": "a.txt", "result": "read 4 bytes",
+      "output": "...", "ms": 0}
+   
+   A client's next line is read once the previous reply is out. Model
+   turns go through the engine, so slow ones never hold up the others;
+   direct commands run on the accepting thread. Changes are approved by
+   the --allow policy, as in batch mode. The socket is created mode 0600.
+*/
+
+#define MAX_CLIENTS      64
+#define CLIENT_LINE_MAX  (4 * MAX_CONTENT)
+
+typedef struct {
+    int fd;                     /* -1 for a free slot */
+    bool ready;                 /* session initialized; kept across connections */
+    _Atomic bool busy;          /* model turn out, further lines wait */
+    Session s;
+    Buffer in;                  /* received, not yet a whole line */
+    uint64_t started;
+    char *chat;                 /* this request's output; s.out writes here */
+    size_t chat_len;
+} Client;
+
+static Client g_clients[MAX_CLIENTS];
+static int g_wake[2] = { -1, -1 };      /* workers poke the poll loop through this */
+static volatile sig_atomic_t g_stop;
+
+static void on_stop(int sig) { (void)sig; g_stop = 1; }
+
+static bool send_all(int fd, const char *p, size_t len) {
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void client_reply(Client *c, const CmdList *cmds, const CmdResult *r) {
+    fclose(c->s.out);
+    c->s.out = NULL;
+    uint64_t us = lat_now_us() - c->started;
+    
+    cJSON *o = cJSON_CreateObject();
+    cJSON_AddBoolToObject(o, "ok", r->ok);
+    cJSON_AddStringToObject(o, "action", cmds_action(cmds));
+    cJSON_AddStringToObject(o, "path", cmds_path(cmds));
+    cJSON_AddStringToObject(o, "result", r->note);
+    cJSON_AddStringToObject(o, "output", c->chat ? c->chat : "");
+    cJSON_AddNumberToObject(o, "ms", (double)us / 1000.0);
+    char *line = cJSON_PrintUnformatted(o);
+    cJSON_Delete(o);
+    free(c->chat);
+    c->chat = NULL;
+    
+    if (line) {
+        size_t len = strlen(line);
+        line[len] = '\n';
+        send_all(c->fd, line, len + 1);
+        line[len] = 0;
+        cJSON_free(line);
+    }
+    stat_add(ST_TURN, us);
+}
+
+/* Runs on an engine worker once the reply is in */
+static void client_done(EngineReq *er) {
+    Client *c = er->userdata;
+    Session *s = &c->s;
+    CmdResult r = { false, "" };
+    CmdList cmds = {0};
+    if (!call_done(s)) {
+        snprintf(r.note, sizeof(r.note), "model error");
+    } else {
+        slog(s, "MODEL: %s", s->reply);
+        if (parse_cmds(s, s->reply, &cmds)) r = cmds_exec(s, &cmds);
+        else snprintf(r.note, sizeof(r.note), "parse error");
+    }
+    if (chunk_next(s) && call_submit(s, &g_engine, client_done, c)) {
+        cmds_free(&cmds);
+        return;
+    }
+    client_reply(c, &cmds, &r);
+    cmds_free(&cmds);
+    
+    c->busy = false;
+    if (write(g_wake[1], "", 1) < 0) { /* pipe full: the loop is awake anyway */ }
+}
+
+static void client_line(Client *c, const char *line, size_t len) {
+    Session *s = &c->s;
+    c->started = lat_now_us();
+    s->out = open_memstream(&c->chat, &c->chat_len);
+    if (!s->out) { c->chat = NULL; s->out = fopen("/dev/null", "w"); }
+    
+    CmdResult r = { false, "" };
+    CmdList cmds = {0};
+    cJSON *req = cJSON_ParseWithLength(line, len);
+    const cJSON *prompt = cJSON_GetObjectItemCaseSensitive(req, "prompt");
+    const cJSON *action = cJSON_GetObjectItemCaseSensitive(req, "action");
+    const char *name = cJSON_IsString(action) ? action->valuestring
+                     : cJSON_IsArray(cJSON_GetObjectItemCaseSensitive(req, "actions")) ? "" : NULL;
+    
+    if (cJSON_IsString(prompt)) {
+        history_add(s, "user", prompt->valuestring);
+        slog(s, "USER: %s", prompt->valuestring);
+        if (fast_path(s, prompt->valuestring, &cmds)) {
+            r = cmds_exec(s, &cmds);
+        } else {
+            c->busy = true;
+            if (call_submit(s, &g_engine, client_done, c)) { cJSON_Delete(req); return; }
+            c->busy = false;
+            snprintf(r.note, sizeof(r.note), "model error");
+        }
+    } else if (!name) {
+        snprintf(r.note, sizeof(r.note), "bad request: need \"prompt\", \"action\" or \"actions\"");
+    } else if (strcmp(name, "ping") == 0) {
+        result_set(&r, true, "pong");
+    } else if (strcmp(name, "clear") == 0) {
+        session_clear(s);
+        result_set(&r, true, "cleared");
+    } else if (strcmp(name, "stats") == 0) {
+        stats_print(s->out);
+        engine_print(&g_engine, s->out);
+        result_set(&r, true, "stats");
+    } else {
+        slog(s, "DIRECT: %.*s", (int)len, line);
+        if (parse_cmds(s, line, &cmds)) r = cmds_exec(s, &cmds);
+        else snprintf(r.note, sizeof(r.note), "parse error");
+        s->chunk.more = false;      /* a client sending parts itself needs no prompting */
+    }
+    cJSON_Delete(req);
+    client_reply(c, &cmds, &r);
+    cmds_free(&cmds);
+}
+
+/* Handle buffered lines until one starts a model turn */
+static void client_drain(Client *c) {
+    while (!c->busy && c->in.size) {
+        char *nl = memchr(c->in.data, '\n', c->in.size);
+        if (!nl) break;
+        *nl = 0;
+        size_t len = (size_t)(nl - c->in.data);
+        if (len) client_line(c, c->in.data, len);
+        size_t rest = c->in.size - len - 1;
+        memmove(c->in.data, nl + 1, rest);
+        c->in.size = rest;
+    }
+}
+
+static void client_close(Client *c) {
+    slog(&c->s, "DISCONNECT");
+    close(c->fd);
+    c->fd = -1;
+    buf_reset(&c->in);
+    session_clear(&c->s);
+}
+
+static void client_accept(int ls) {
+    int fd = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *c = &g_clients[i];
+        if (c->fd >= 0) continue;
+        if (!c->ready) {
+            char name[32];
+            snprintf(name, sizeof(name), "c%d", i + 1);
+            if (!session_init(&c->s, name, NULL)) { session_free(&c->s); break; }
+            c->s.echo = false;
+            c->s.unattended = true;
+            c->ready = true;
+        }
+        c->fd = fd;
+        slog(&c->s, "CONNECT");
+        return;
+    }
+    const char *full = "{\"ok\":false,\"result\":\"too many clients\"}\n";
+    send_all(fd, full, strlen(full));
+    close(fd);
+}
+
+/* Read what is there; false when the client has gone */
+static bool client_read(Client *c) {
+    if (!buf_reserve(&c->in, 65536)) return false;
+    ssize_t n = recv(c->fd, c->in.data + c->in.size, 65536, 0);
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    if (n == 0) return false;
+    c->in.size += (size_t)n;
+    if (c->in.size > CLIENT_LINE_MAX && !memchr(c->in.data, '\n', c->in.size)) {
+        const char *big = "{\"ok\":false,\"result\":\"request too long\"}\n";
+        send_all(c->fd, big, strlen(big));
+        return false;
+    }
+    return true;
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un a = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(a.sun_path)) { errno = ENAMETOOLONG; return -1; }
+    strcpy(a.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    mode_t old = umask(077);
+    bool ok = bind(fd, (struct sockaddr *)&a, sizeof(a)) == 0 && listen(fd, 64) == 0;
+    umask(old);
+    if (!ok) { close(fd); return -1; }
+    return fd;
+}
+
+static int run_daemon(const char *path, int max_in_flight) {
+    int ls = listen_unix(path);
+    if (ls < 0) { fprintf(stderr, "❌ Cannot listen on %s: %s\n", path, strerror(errno)); return 1; }
+    if (pipe2(g_wake, O_CLOEXEC | O_NONBLOCK) != 0 ||
+        !engine_start(&g_engine, ENGINE_WORKERS, max_in_flight)) {
+        fprintf(stderr, "❌ Cannot start the engine\n");
+        close(ls);
+        unlink(path);
+        return 1;
+    }
+    
+    struct sigaction sa = { .sa_handler = on_stop };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    for (int i = 0; i < MAX_CLIENTS; i++) g_clients[i].fd = -1;
+    alog_line(&g_log, NULL, "DAEMON: listening on %s", path);
+    fprintf(stderr, "Listening on %s\n", path);
+    
+    while (!g_stop) {
+        struct pollfd pf[MAX_CLIENTS + 2];
+        int who[MAX_CLIENTS + 2], n = 0;
+        pf[n++] = (struct pollfd){ .fd = ls, .events = POLLIN };
+        pf[n++] = (struct pollfd){ .fd = g_wake[0], .events = POLLIN };
+        /* Busy clients sit out: their hangup is noticed after the reply */
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (g_clients[i].fd < 0 || g_clients[i].busy) continue;
+            who[n] = i;
+            pf[n++] = (struct pollfd){ .fd = g_clients[i].fd, .events = POLLIN };
+        }
+        if (poll(pf, (nfds_t)n, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        if (pf[1].revents) { char drain[64]; while (read(g_wake[0], drain, sizeof(drain)) > 0) {} }
+        for (int k = 2; k < n; k++) {
+            Client *c = &g_clients[who[k]];
+            if (pf[k].revents && !client_read(c)) client_close(c);
+        }
+        for (int i = 0; i < MAX_CLIENTS; i++)
+            if (g_clients[i].fd >= 0 && !g_clients[i].busy) client_drain(&g_clients[i]);
+        if (pf[0].revents & POLLIN) client_accept(ls);
+    }
+    
+    fprintf(stderr, "Shutting down\n");
+    engine_wait(&g_engine);
+    engine_stop(&g_engine);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Client *c = &g_clients[i];
+        if (c->fd >= 0) client_close(c);
+        if (c->ready) session_free(&c->s);
+        buf_free(&c->in);
+    }
+    close(g_wake[0]);
+    close(g_wake[1]);
+    close(ls);
+    unlink(path);
+    return 0;
 }
 
 /* ============================================================
    MAIN
    ============================================================ */
 
+/* The terminal's own session */
+static Session g_console;
+
+/* One model turn at the console; false once the error has been shown */
+static bool console_turn(Session *s, char *response, CmdList *cmds) {
+    printf("🤔 ...\n");
+    
+    if (!call_ollama(s, response, MAX_CONTENT)) {
+        printf("❌ Model error\n\n");
+        return false;
+    }
+    
+    slog(s, "MODEL: %s", response);
+    if (!STREAM_RESPONSE) printf("Model: %s\n", response);
+    
+    if (!parse_cmds(s, response, cmds)) { printf("❌ Parse error\n\n"); return false; }
+    return true;
+}
+
+static void shutdown_all(void) {
+    stats_dump();
+    session_free(&g_console);
+    pf_stop(&g_prefetch);
+    fcache_free(&g_fcache);
+    if (g_rcache_on) rcache_close(&g_rcache);
+    request_free();
+    curl_global_cleanup();
+    log_close();
+}
+
 int main(int argc, char **argv) {
-    if (argc > 1 && strcmp(argv[1], "--test") == 0) {
-        test_repair();
-        return 0;
+    /* Before anything is parsed, so every cJSON block is counted both ways */
+    cJSON_InitHooks(&(cJSON_Hooks){ mem_json_malloc, mem_json_free });
+    
+    const char *batch = NULL, *serve = NULL, *cache = NULL;
+    int sessions = 1, max_in_flight = ENGINE_MAX_IN_FLIGHT;
+    long mem_cap_mb = MEM_CAP_MB;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--test") == 0) {
+            intent_init(&g_intents);
+            int failed = test_repair();
+            failed += test_intent();
+            failed += test_patch();
+            failed += test_overlap();
+            failed += test_batch();
+            return failed ? 1 : 0;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch = argv[++i];
+        } else if (strcmp(argv[i], "--allow") == 0 && i + 1 < argc) {
+            if (g_nallow < MAX_ALLOW) g_allow[g_nallow++] = argv[++i];
+            else i++;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve = argv[++i];
+        } else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) {
+            sessions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-in-flight") == 0 && i + 1 < argc) {
+            max_in_flight = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache = argv[++i];
+        } else if (strcmp(argv[i], "--mem-cap") == 0 && i + 1 < argc) {
+            mem_cap_mb = atol(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--test] [--batch FILE|- [--sessions N] | --serve SOCKET] "
+                            "[--max-in-flight N] [--cache DIR|-] [--mem-cap MB] [--allow GLOB]...\n", argv[0]);
+            return 1;
+        }
     }
     
     mkdir(ALLOWED_DIR, 0755);
     log_open();
     curl_global_init(CURL_GLOBAL_DEFAULT);
+    mem_set_cap(mem_cap_mb > 0 ? (size_t)mem_cap_mb << 20 : 0);
+    json_keys_init();
+    intent_init(&g_intents);
+    if (cache) {
+        g_rcache_on = rcache_open(&g_rcache, strcmp(cache, "-") == 0 ? NULL : cache);
+        if (!g_rcache_on) fprintf(stderr, "⚠️  Cannot use %s for the response cache\n", cache);
+    }
+    fcache_init(&g_fcache, (size_t)FILE_CACHE_MB << 20);
+    if (PREFETCH) pf_start(&g_prefetch, (size_t)PREFETCH_MAX_KB << 10, prefetch_warm, NULL);
+    Session *s = &g_console;
+    if (!session_init(s, "", stdout) || !request_init()) {
+        fprintf(stderr, "Cannot initialize HTTP connection\n");
+        shutdown_all();
+        return 1;
+    }
+    s->unattended = !CONFIRM_UI;
+    
+    if (batch || serve) {
+        int rc = batch ? run_batch(s, batch, sessions, max_in_flight)
+                       : run_daemon(serve, max_in_flight);
+        shutdown_all();
+        return rc;
+    }
     
     printf("\n");
     printf("╔═══════════════════════════════════════════════════════════════╗\n");
@@ -545,10 +2697,11 @@ int main(int argc, char **argv) {
     char abs[MAX_PATH_LEN];
     printf("║  Dir:   %-53s  ║\n", realpath(ALLOWED_DIR, abs) ? abs : ALLOWED_DIR);
     printf("╠═══════════════════════════════════════════════════════════════╣\n");
-    printf("║  quit | log | context | clear | help                          ║\n");
+    printf("║  quit | log | stats | context | clear | help                  ║\n");
     printf("╚═══════════════════════════════════════════════════════════════╝\n\n");
     
-    char input[2048], response[MAX_CONTENT];
+    char input[2048];
+    char *response = s->reply;
     
     while (1) {
         printf("You: ");
@@ -562,14 +2715,26 @@ int main(int argc, char **argv) {
         if (strcmp(input, "quit") == 0) break;
         if (strcmp(input, "help") == 0) {
             printf("\nlist, read <file>, create <file>, delete <file>\n");
-            printf("To edit: read first, then describe changes\n\n");
+            printf("To edit: read first, then describe changes\n");
+            printf("Plain \"list DIR\", \"read FILE\", \"delete FILE\" run without the model\n");
+            printf("Unattended: --batch FILE --allow 'GLOB' [--sessions N] (JSON results on stdout)\n");
+            printf("Daemon:     --serve SOCKET --allow 'GLOB' (JSON lines over a Unix socket)\n");
+            printf("Caching:    --cache DIR reuses replies to identical requests (- keeps them in memory)\n\n");
             continue;
         }
-        if (strcmp(input, "clear") == 0) { conv_clear(); printf("✓ Cleared\n\n"); continue; }
+        if (strcmp(input, "clear") == 0) { session_clear(s); printf("✓ Cleared\n\n"); continue; }
         if (strcmp(input, "context") == 0) {
-            printf("\n[%d msgs]\n", g_conv.count);
-            for (int i = 0; i < g_conv.count; i++)
-                printf("%s: %.50s...\n", g_conv.messages[i].role, g_conv.messages[i].content);
+            printf("\n[%d msgs, ~%zu tokens]\n", s->hist.count, hist_tokens(&s->hist));
+            for (int i = 0; i < s->hist.count; i++) {
+                Message *m = hist_at(&s->hist, i);
+                printf("%s: %.50s...\n", m->role, m->content);
+            }
+            printf("\n");
+            continue;
+        }
+        if (strcmp(input, "stats") == 0) {
+            printf("\n");
+            stats_print(stdout);
             printf("\n");
             continue;
         }
@@ -579,30 +2744,26 @@ int main(int argc, char **argv) {
             continue;
         }
         
-        conv_add("user", input);
-        logf("USER: %s", input);
-        
-        printf("🤔 ...\n");
-        
-        if (!call_ollama(response, sizeof(response))) {
-            printf("❌ Model error\n\n");
-            continue;
-        }
-        
-        logf("MODEL: %s", response);
-        printf("Model: %s\n", response);
+        uint64_t turn = stat_clock();
+        history_add(s, "user", input);
+        slog(s, "USER: %s", input);
         
-        Command cmd = parse_cmd(response);
-        if (!cmd.valid) { printf("❌ Parse error\n\n"); continue; }
+        CmdList cmds;
+        if (!fast_path(s, input, &cmds) && !console_turn(s, response, &cmds)) continue;
         
-        run_cmd(&cmd);
-        cmd_free(&cmd);
+        /* A write in parts asks for its next part without waiting for the user */
+        bool more;
+        do {
+            CmdResult r = cmds_exec(s, &cmds);
+            if (cmds.count > 1) printf("\n%s %s\n", r.ok ? "✓" : "⚠️ ", r.note);
+            cmds_free(&cmds);
+            more = chunk_next(s);
+        } while (more && console_turn(s, response, &cmds));
+        stat_since(ST_TURN, turn);
         printf("\n");
     }
     
-    conv_clear();
-    curl_global_cleanup();
-    log_close();
+    shutdown_all();
     printf("Bye!\n");
     return 0;
 }
@@ -0,0 +1,200 @@
+/*
+ * file_cache.c - LRU cache of sandbox file contents and directory listings
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_cache.h"
+
+void fcache_init(FileCache *c, size_t max_bytes) {
+    memset(c, 0, sizeof(*c));
+    c->max_bytes = max_bytes;
+}
+
+bool fcache_stamp(FcStamps *s, const char *name, off_t size, time_t mtime) {
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 32;
+        FcStamp *items = realloc(s->items, sizeof(*items) * (size_t)cap);
+        if (!items) return false;
+        s->items = items;
+        s->cap = cap;
+    }
+    char *copy = strdup(name);
+    if (!copy) return false;
+    s->items[s->count++] = (FcStamp){ copy, size, mtime };
+    return true;
+}
+
+static void stamps_free(FcStamps *s) {
+    for (int i = 0; i < s->count; i++) free(s->items[i].name);
+    free(s->items);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Every entry a listing shows still has the size and mtime it showed */
+static bool stamps_hold(const char *dir, const FcStamps *s) {
+    if (!s->count) return true;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = true;
+    for (int i = 0; ok && i < s->count; i++) {
+        const FcStamp *t = &s->items[i];
+        struct stat st;
+        ok = fstatat(fd, t->name, &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_size == t->size &&
+             st.st_mtime == t->mtime;
+    }
+    close(fd);
+    return ok;
+}
+
+/* A pinned entry only loses its path; the contents go with the last pin */
+static void drop(FileCache *c, CacheEntry *e) {
+    if (!e->path && !e->dead) return;
+    if (e->pins) {
+        free(e->path);
+        e->path = NULL;
+        e->dead = true;
+        return;
+    }
+    fmap_close(&e->map);
+    free(e->listing);
+    stamps_free(&e->stamps);
+    free(e->path);
+    c->bytes -= e->bytes;
+    memset(e, 0, sizeof(*e));
+}
+
+void fcache_free(FileCache *c) {
+    for (int i = 0; i < FCACHE_ENTRIES; i++) drop(c, &c->slots[i]);
+}
+
+static CacheEntry *find(FileCache *c, const char *path) {
+    for (int i = 0; i < FCACHE_ENTRIES; i++) {
+        if (c->slots[i].path && strcmp(c->slots[i].path, path) == 0) return &c->slots[i];
+    }
+    return NULL;
+}
+
+/* A free slot, or the least recently used one not pinned; NULL when
+   every slot is pinned */
+static CacheEntry *victim(FileCache *c) {
+    CacheEntry *v = NULL;
+    for (int i = 0; i < FCACHE_ENTRIES; i++) {
+        CacheEntry *e = &c->slots[i];
+        if (e->pins) continue;
+        if (!e->path) return e;
+        if (!v || e->used < v->used) v = e;
+    }
+    return v;
+}
+
+/* Evict until `need` more bytes fit, keeping `keep` */
+static void make_room(FileCache *c, size_t need, const CacheEntry *keep) {
+    while (c->max_bytes && c->bytes + need > c->max_bytes) {
+        CacheEntry *v = NULL;
+        for (int i = 0; i < FCACHE_ENTRIES; i++) {
+            CacheEntry *e = &c->slots[i];
+            if (e->path && !e->pins && e != keep && (!v || e->used < v->used)) v = e;
+        }
+        if (!v) break;
+        drop(c, v);
+    }
+}
+
+static bool same_file(const CacheEntry *e, const struct stat *st) {
+    return e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* Shared lookup: a valid hit, or a slot reset for reloading */
+static CacheEntry *lookup(FileCache *c, const char *path, bool dir, struct stat *st,
+                          bool *hit) {
+    *hit = false;
+    if (stat(path, st) != 0 || (dir ? !S_ISDIR(st->st_mode) : !S_ISREG(st->st_mode))) {
+        fcache_invalidate(c, path);
+        return NULL;
+    }
+
+    CacheEntry *e = find(c, path);
+    if (e && e->is_dir == dir && same_file(e, st) && (!dir || stamps_hold(path, &e->stamps))) {
+        e->used = ++c->clock;
+        c->hits++;
+        *hit = true;
+        return e;
+    }
+
+    c->misses++;
+    if (e) drop(c, e);
+    if (!e || e->dead) e = victim(c);
+    if (!e) return NULL;
+    drop(c, e);
+
+    e->path = strdup(path);
+    if (!e->path) return NULL;
+    e->is_dir = dir;
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim;
+    e->used = ++c->clock;
+    return e;
+}
+
+CacheEntry *fcache_file(FileCache *c, const char *path) {
+    struct stat st;
+    bool hit;
+    CacheEntry *e = lookup(c, path, false, &st, &hit);
+    if (!e || hit) return e;
+
+    if (!fmap_open(&e->map, path)) {
+        drop(c, e);
+        return NULL;
+    }
+    e->bytes = e->map.size;
+    make_room(c, e->bytes, e);
+    c->bytes += e->bytes;
+    return e;
+}
+
+CacheEntry *fcache_dir(FileCache *c, const char *path, fcache_list_fn list) {
+    struct stat st;
+    bool hit;
+    CacheEntry *e = lookup(c, path, true, &st, &hit);
+    if (!e || hit) return e;
+
+    e->listing = list(path, &e->stamps);
+    if (!e->listing) {
+        drop(c, e);
+        return NULL;
+    }
+    e->bytes = strlen(e->listing);
+    make_room(c, e->bytes, e);
+    c->bytes += e->bytes;
+    return e;
+}
+
+void fcache_pin(CacheEntry *e) {
+    e->pins++;
+}
+
+void fcache_unpin(FileCache *c, CacheEntry *e) {
+    if (--e->pins == 0 && e->dead) drop(c, e);
+}
+
+void fcache_invalidate(FileCache *c, const char *path) {
+    CacheEntry *e = find(c, path);
+    if (e) drop(c, e);
+
+    /* The parent's listing names this path */
+    const char *slash = strrchr(path, '/');
+    if (!slash) return;
+    size_t len = (size_t)(slash - path);
+    for (int i = 0; i < FCACHE_ENTRIES; i++) {
+        e = &c->slots[i];
+        if (e->path && e->is_dir && strlen(e->path) == len && strncmp(e->path, path, len) == 0)
+            drop(c, e);
+    }
+}
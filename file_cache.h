@@ -0,0 +1,93 @@
+/*
+ * file_cache.h - LRU cache of sandbox file contents and directory listings
+ *
+ * Files stay mapped (see filemap.h) and listings stay rendered, so asking
+ * for the same path again costs one stat(). An entry is reused only while
+ * the path still has the same inode, size and mtime; anything else
+ * reloads it. Our own writes and deletes drop entries explicitly.
+ *
+ * A listing shows each entry's size and mtime, and changing a file in
+ * place leaves its directory's mtime alone. So the renderer also records
+ * a stamp for every entry it shows, and a hit re-stats those: one
+ * fstatat() per shown entry instead of a new walk and sort.
+ *
+ * The cache itself needs a lock around every call. A caller that wants
+ * to use an entry's contents after letting go of the lock pins it first:
+ * a pinned entry is never evicted or reused, and dropping one only
+ * detaches it from its path, so its mapping or listing stays as it was
+ * until the last fcache_unpin() frees it.
+ */
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include "filemap.h"
+
+#ifndef FCACHE_ENTRIES
+#define FCACHE_ENTRIES  32
+#endif
+
+/* What a listing showed of one entry, by name relative to the directory */
+typedef struct {
+    char *name;
+    off_t size;
+    time_t mtime;
+} FcStamp;
+
+typedef struct {
+    FcStamp *items;
+    int count, cap;
+} FcStamps;
+
+typedef struct {
+    char *path;                 /* NULL for a free slot */
+    bool is_dir;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+
+    FileMap map;                /* file contents */
+    char *listing;              /* directory listing */
+    FcStamps stamps;            /* the entries it shows */
+    size_t bytes;
+
+    unsigned long used;         /* LRU clock */
+    int pins;                   /* users outside the lock */
+    bool dead;                  /* dropped while pinned: freed by the last unpin */
+    long ctx_seq;               /* history message holding this content, 0 if none */
+    const void *ctx_owner;      /* the history ctx_seq counts in */
+} CacheEntry;
+
+typedef struct {
+    CacheEntry slots[FCACHE_ENTRIES];
+    size_t bytes, max_bytes;
+    unsigned long clock;
+    long hits, misses;
+} FileCache;
+
+/* Renders a listing for a directory and stamps the entries it shows with
+   fcache_stamp(); the cache takes the malloc'd string */
+typedef char *(*fcache_list_fn)(const char *path, FcStamps *stamps);
+
+bool fcache_stamp(FcStamps *s, const char *name, off_t size, time_t mtime);
+
+void fcache_init(FileCache *c, size_t max_bytes);
+void fcache_free(FileCache *c);
+
+/* The returned entry stays valid until the next call on the cache,
+   or until fcache_unpin() once pinned */
+CacheEntry *fcache_file(FileCache *c, const char *path);
+CacheEntry *fcache_dir(FileCache *c, const char *path, fcache_list_fn list);
+
+void fcache_pin(CacheEntry *e);
+void fcache_unpin(FileCache *c, CacheEntry *e);
+
+/* Drop path and its parent directory's listing */
+void fcache_invalidate(FileCache *c, const char *path);
+
+#endif
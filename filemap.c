@@ -0,0 +1,63 @@
+/*
+ * filemap.c - Read-only file mappings
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "filemap.h"
+
+bool fmap_open(FileMap *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    m->data = "";
+    if (st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+        m->map = p;
+        m->data = p;
+        m->size = (size_t)st.st_size;
+    }
+    /* The mapping keeps its own reference to the file */
+    close(fd);
+    return true;
+}
+
+void fmap_close(FileMap *m) {
+    if (m->map) munmap(m->map, m->size);
+    memset(m, 0, sizeof(*m));
+}
+
+size_t text_lines(const char *p, size_t len) {
+    size_t n = 0;
+    const char *end = p + len;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        n++;
+        if (!nl) break;
+        p = nl + 1;
+    }
+    return n;
+}
+
+size_t text_cut(const char *p, size_t len, size_t max) {
+    if (len <= max) return len;
+    for (size_t i = max; i > 0; i--) {
+        if (p[i - 1] == '\n') return i;
+    }
+    return max;
+}
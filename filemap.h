@@ -0,0 +1,31 @@
+/*
+ * filemap.h - Read-only file mappings
+ *
+ * A mapped file is read straight from the page cache: printing it or
+ * taking a window of it costs no heap copy. The view stays valid until
+ * fmap_close(), even if the file is replaced on disk meanwhile.
+ */
+
+#ifndef FILEMAP_H
+#define FILEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    const char *data;       /* "" for an empty file */
+    size_t size;
+    void *map;              /* NULL when nothing is mapped */
+} FileMap;
+
+bool fmap_open(FileMap *m, const char *path);
+void fmap_close(FileMap *m);
+
+/* Lines in p[0..len), counting a last line without a newline */
+size_t text_lines(const char *p, size_t len);
+
+/* Longest prefix of at most max bytes that ends after a newline; max
+   itself when the first line is longer than that */
+size_t text_cut(const char *p, size_t len, size_t max);
+
+#endif
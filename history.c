@@ -0,0 +1,85 @@
+/*
+ * history.c - Conversation history as a fixed ring with a size budget
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "chat_request.h"
+#include "history.h"
+#include "mem_acct.h"
+
+void hist_init(History *h, int max_messages, size_t budget_tokens) {
+    memset(h, 0, sizeof(*h));
+    h->max_messages = max_messages > 0 && max_messages < HISTORY_SLOTS ? max_messages
+                                                                       : HISTORY_SLOTS;
+    h->budget = budget_tokens * HISTORY_TOKEN_BYTES;
+}
+
+Message *hist_at(History *h, int i) {
+    if (i < 0 || i >= h->count) return NULL;
+    return &h->ring[(h->head + i) % HISTORY_SLOTS];
+}
+
+/* Messages and their JSON count as MEM_HISTORY; see mem_acct.h */
+static void evict_oldest(History *h) {
+    Message *m = &h->ring[h->head];
+    h->bytes -= m->json_len;
+    MemKind k = mem_scope(MEM_HISTORY);
+    mem_free(MEM_HISTORY, m->content);
+    cJSON_free(m->json);
+    mem_scope(k);
+    memset(m, 0, sizeof(*m));
+    h->head = (h->head + 1) % HISTORY_SLOTS;
+    h->count--;
+}
+
+bool hist_add(History *h, const char *role, const char *content) {
+    size_t len = 0;
+    MemKind k = mem_scope(MEM_HISTORY);
+    char *json = chat_message_json(role, content, &len);
+    char *copy = mem_strdup(MEM_HISTORY, content);
+    if (!json || !copy) {
+        cJSON_free(json);
+        mem_free(MEM_HISTORY, copy);
+        mem_scope(k);
+        return false;
+    }
+
+    if (h->count >= h->max_messages || (h->budget && h->bytes + len > h->budget)) {
+        int max = h->keep_prefix ? h->max_messages / 2 : h->max_messages - 1;
+        size_t budget = h->keep_prefix ? h->budget / 2 : h->budget;
+        while (h->count > 0 && (h->count > max || (budget && h->bytes + len > budget))) {
+            evict_oldest(h);
+            h->evicted++;
+        }
+    }
+
+    Message *m = &h->ring[(h->head + h->count) % HISTORY_SLOTS];
+    strncpy(m->role, role, sizeof(m->role) - 1);
+    m->role[sizeof(m->role) - 1] = 0;
+    m->content = copy;
+    m->json = json;
+    m->json_len = len;
+    m->seq = ++h->last_seq;
+    h->count++;
+    h->bytes += len;
+    mem_scope(k);
+    return true;
+}
+
+bool hist_drop_oldest(History *h) {
+    if (!h->count) return false;
+    evict_oldest(h);
+    h->evicted++;
+    return true;
+}
+
+void hist_clear(History *h) {
+    while (h->count > 0) evict_oldest(h);
+    h->head = 0;
+}
+
+bool hist_contains(History *h, long seq) {
+    return h->count > 0 && seq >= hist_at(h, 0)->seq && seq <= h->last_seq;
+}
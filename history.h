@@ -0,0 +1,68 @@
+/*
+ * history.h - Conversation history as a fixed ring with a size budget
+ *
+ * Messages go in at the tail and the oldest fall off the head, so adding
+ * never moves the others. Each message keeps its request JSON (see
+ * chat_request.h), and the ring tracks the total of those bytes, which
+ * is what the model has to read every turn. Eviction keeps both the
+ * message count and that total under their limits.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef HISTORY_SLOTS
+#define HISTORY_SLOTS       64
+#endif
+
+/* Rough prompt size: about four bytes of JSON per token */
+#define HISTORY_TOKEN_BYTES 4
+
+typedef struct {
+    char role[16];
+    char *content;
+    char *json;             /* {"role":..,"content":..} as sent */
+    size_t json_len;
+    long seq;               /* 1, 2, ... in order of hist_add */
+} Message;
+
+typedef struct {
+    Message ring[HISTORY_SLOTS];
+    int head;               /* slot of the oldest message */
+    int count;
+    int max_messages;
+    size_t bytes;           /* sum of json_len over the ring */
+    size_t budget;          /* byte limit, 0 for none */
+    long evicted;           /* messages dropped so far */
+    long last_seq;
+    bool keep_prefix;       /* evict in bulk, see below */
+} History;
+
+/* max_messages is capped at HISTORY_SLOTS; budget_tokens 0 disables it */
+void hist_init(History *h, int max_messages, size_t budget_tokens);
+
+/* Evicts from the head until the new message fits. A message bigger
+   than the whole budget is still kept, as the only one.
+   With keep_prefix set, eviction goes down to half of both limits in one
+   go, so the turns after it only append and the prompt prefix the server
+   has cached stays byte-identical for longer. */
+bool hist_add(History *h, const char *role, const char *content);
+
+/* i = 0 is the oldest */
+Message *hist_at(History *h, int i);
+void hist_clear(History *h);
+
+/* Evict the oldest message now; false when there is none */
+bool hist_drop_oldest(History *h);
+
+/* Whether the message numbered seq is still in the ring */
+bool hist_contains(History *h, long seq);
+
+static inline size_t hist_tokens(const History *h) {
+    return h->bytes / HISTORY_TOKEN_BYTES;
+}
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * http_conn.c - Long-lived HTTP connection to the Ollama server
+ */
+
+#include <string.h>
+#include "http_conn.h"
+
+bool http_conn_init(HttpConn *c, const char *url, long timeout_secs) {
+    memset(c, 0, sizeof(*c));
+
+    c->curl = curl_easy_init();
+    if (!c->curl) return false;
+
+    /* Appending keeps the list on failure, so it is freed with the rest */
+    c->headers = curl_slist_append(NULL, "Content-Type: application/json");
+    /* Ollama answers quickly; skip the 100-continue round trip on big bodies */
+    struct curl_slist *more = c->headers ? curl_slist_append(c->headers, "Expect:") : NULL;
+    if (!more) { http_conn_close(c); return false; }
+    c->headers = more;
+
+    curl_easy_setopt(c->curl, CURLOPT_URL, url);
+    curl_easy_setopt(c->curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(c->curl, CURLOPT_HTTPHEADER, c->headers);
+    curl_easy_setopt(c->curl, CURLOPT_TIMEOUT, timeout_secs);
+    curl_easy_setopt(c->curl, CURLOPT_ERRORBUFFER, c->errbuf);
+    curl_easy_setopt(c->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(c->curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(c->curl, CURLOPT_MAXCONNECTS, 1L);
+    return true;
+}
+
+void http_conn_close(HttpConn *c) {
+    if (c->in_flight) curl_multi_remove_handle(c->multi, c->curl);
+    if (c->multi) curl_multi_cleanup(c->multi);
+    if (c->curl) curl_easy_cleanup(c->curl);
+    curl_slist_free_all(c->headers);
+    c->curl = NULL;
+    c->multi = NULL;
+    c->headers = NULL;
+    c->in_flight = false;
+}
+
+/* libcurl pulls the body through here when it is a scatter list */
+static size_t iov_read(char *dst, size_t sz, size_t n, void *userdata) {
+    HttpConn *c = userdata;
+    size_t room = sz * n, out = 0;
+
+    while (room && c->iov_idx < c->iov_count) {
+        const struct iovec *v = &c->iov[c->iov_idx];
+        size_t left = v->iov_len - c->iov_off;
+        size_t take = left < room ? left : room;
+        memcpy(dst + out, (const char *)v->iov_base + c->iov_off, take);
+        out += take;
+        room -= take;
+        c->iov_off += take;
+        if (c->iov_off == v->iov_len) { c->iov_idx++; c->iov_off = 0; }
+    }
+    return out;
+}
+
+/* libcurl rewinds the body to resend it, as on a kept-alive connection
+   the server has closed in the meantime */
+static int iov_seek(void *userdata, curl_off_t offset, int origin) {
+    HttpConn *c = userdata;
+    if (origin != SEEK_SET || offset < 0) return CURL_SEEKFUNC_CANTSEEK;
+    size_t left = (size_t)offset;
+    c->iov_idx = 0;
+    c->iov_off = 0;
+    while (c->iov_idx < c->iov_count && left >= c->iov[c->iov_idx].iov_len)
+        left -= c->iov[c->iov_idx++].iov_len;
+    if (left && c->iov_idx == c->iov_count) return CURL_SEEKFUNC_FAIL;
+    c->iov_off = left;
+    return CURL_SEEKFUNC_OK;
+}
+
+/* body == NULL means the body comes from c->iov */
+static void setup(HttpConn *c, const char *body, size_t len,
+                  http_write_fn write_cb, void *userdata) {
+    c->errbuf[0] = 0;
+    if (body) {
+        curl_easy_setopt(c->curl, CURLOPT_POSTFIELDS, body);
+        curl_easy_setopt(c->curl, CURLOPT_SEEKFUNCTION, NULL);
+    } else {
+        curl_easy_setopt(c->curl, CURLOPT_POSTFIELDS, NULL);
+        curl_easy_setopt(c->curl, CURLOPT_READFUNCTION, iov_read);
+        curl_easy_setopt(c->curl, CURLOPT_READDATA, c);
+        curl_easy_setopt(c->curl, CURLOPT_SEEKFUNCTION, iov_seek);
+        curl_easy_setopt(c->curl, CURLOPT_SEEKDATA, c);
+    }
+    curl_easy_setopt(c->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)len);
+
+    bool to_buf = (write_cb == buf_curl_write);
+    curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, userdata);
+    curl_easy_setopt(c->curl, CURLOPT_HEADERFUNCTION, to_buf ? buf_curl_header : NULL);
+    curl_easy_setopt(c->curl, CURLOPT_HEADERDATA, to_buf ? userdata : NULL);
+}
+
+static CURLcode finished(HttpConn *c, CURLcode res) {
+    long new_conns = 0;
+    curl_easy_getinfo(c->curl, CURLINFO_NUM_CONNECTS, &new_conns);
+    curl_easy_getinfo(c->curl, CURLINFO_CONNECT_TIME, &c->connect_time);
+    curl_easy_getinfo(c->curl, CURLINFO_STARTTRANSFER_TIME, &c->ttfb);
+    curl_easy_getinfo(c->curl, CURLINFO_TOTAL_TIME, &c->total_time);
+
+    c->reused = (res == CURLE_OK && new_conns == 0);
+    c->requests++;
+    if (c->reused) c->reuses++;
+    c->iov = NULL;
+    return res;
+}
+
+static CURLcode perform(HttpConn *c, const char *body, size_t len,
+                        http_write_fn write_cb, void *userdata) {
+    if (!c->curl || c->in_flight) return CURLE_FAILED_INIT;
+    setup(c, body, len, write_cb, userdata);
+    return finished(c, curl_easy_perform(c->curl));
+}
+
+CURLcode http_conn_post(HttpConn *c, const char *body, size_t len,
+                        http_write_fn write_cb, void *userdata) {
+    return perform(c, body, len, write_cb, userdata);
+}
+
+CURLcode http_conn_post_buf(HttpConn *c, const char *body, size_t len, Buffer *out) {
+    return perform(c, body, len, buf_curl_write, out);
+}
+
+static void set_iov(HttpConn *c, const struct iovec *iov, int count, size_t *total) {
+    *total = 0;
+    for (int i = 0; i < count; i++) *total += iov[i].iov_len;
+    c->iov = iov;
+    c->iov_count = count;
+    c->iov_idx = 0;
+    c->iov_off = 0;
+}
+
+CURLcode http_conn_post_iov(HttpConn *c, const struct iovec *iov, int count,
+                            http_write_fn write_cb, void *userdata) {
+    size_t total;
+    if (c->in_flight) return CURLE_FAILED_INIT;
+    set_iov(c, iov, count, &total);
+    return perform(c, NULL, total, write_cb, userdata);
+}
+
+bool http_conn_start_iov(HttpConn *c, const struct iovec *iov, int count,
+                         http_write_fn write_cb, void *userdata) {
+    if (!c->curl || c->in_flight) return false;
+    if (!c->multi && !(c->multi = curl_multi_init())) return false;
+
+    size_t total;
+    set_iov(c, iov, count, &total);
+    setup(c, NULL, total, write_cb, userdata);
+    if (curl_multi_add_handle(c->multi, c->curl) != CURLM_OK) {
+        c->iov = NULL;
+        return false;
+    }
+    c->in_flight = true;
+
+    /* Drive the transfer until the body is out; the reply comes later */
+    int running = 1;
+    while (running) {
+        if (curl_multi_perform(c->multi, &running) != CURLM_OK) break;
+        curl_off_t sent = 0;
+        curl_easy_getinfo(c->curl, CURLINFO_SIZE_UPLOAD_T, &sent);
+        if ((size_t)sent >= total) break;
+        curl_multi_poll(c->multi, NULL, 0, 100, NULL);
+    }
+    return true;
+}
+
+bool http_conn_prepare_iov(HttpConn *c, const struct iovec *iov, int count,
+                           http_write_fn write_cb, void *userdata) {
+    if (!c->curl || c->in_flight) return false;
+    size_t total;
+    set_iov(c, iov, count, &total);
+    setup(c, NULL, total, write_cb, userdata);
+    return true;
+}
+
+CURLcode http_conn_done(HttpConn *c, CURLcode res) {
+    return finished(c, res);
+}
+
+CURLcode http_conn_finish(HttpConn *c) {
+    if (!c->in_flight) return CURLE_FAILED_INIT;
+
+    int running = 1;
+    CURLcode res = CURLE_OK;
+    while (running) {
+        if (curl_multi_perform(c->multi, &running) != CURLM_OK) { res = CURLE_RECV_ERROR; break; }
+        if (running) curl_multi_poll(c->multi, NULL, 0, 1000, NULL);
+    }
+
+    CURLMsg *msg;
+    int left;
+    while ((msg = curl_multi_info_read(c->multi, &left)))
+        if (msg->msg == CURLMSG_DONE && msg->easy_handle == c->curl) res = msg->data.result;
+
+    curl_multi_remove_handle(c->multi, c->curl);
+    c->in_flight = false;
+    return finished(c, res);
+}
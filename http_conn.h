@@ -0,0 +1,79 @@
+/*
+ * http_conn.h - Long-lived HTTP connection to the Ollama server
+ *
+ * One CURL easy handle, header list and connection pool are created once
+ * after curl_global_init() and reused for every request, so consecutive
+ * turns skip the TCP connect.
+ */
+
+#ifndef HTTP_CONN_H
+#define HTTP_CONN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <curl/curl.h>
+#include "buffer.h"
+
+/* Same shape as the agents' existing curl write callbacks */
+typedef size_t (*http_write_fn)(void *ptr, size_t size, size_t nmemb, void *userdata);
+
+typedef struct {
+    CURL *curl;
+    CURLM *multi;               /* created by the first http_conn_start_iov() */
+    bool in_flight;             /* started and not yet finished */
+    struct curl_slist *headers;
+    char errbuf[CURL_ERROR_SIZE];
+
+    /* Read cursor for scatter-list bodies */
+    const struct iovec *iov;
+    int iov_count, iov_idx;
+    size_t iov_off;
+
+    /* Timings of the last request, in seconds from its start */
+    double connect_time;        /* TCP connect finished (0 if reused)  */
+    double ttfb;                /* first response byte                 */
+    double total_time;
+    bool reused;                /* no new connection was opened        */
+
+    unsigned long requests;
+    unsigned long reuses;
+} HttpConn;
+
+/* Create the handle and set options that never change between turns */
+bool http_conn_init(HttpConn *c, const char *url, long timeout_secs);
+void http_conn_close(HttpConn *c);
+
+/* POST body and deliver the response to write_cb(userdata). Timings are
+   recorded in the HttpConn when the call returns. With buf_curl_write as
+   write_cb the Buffer is also pre-sized from Content-Length. */
+CURLcode http_conn_post(HttpConn *c, const char *body, size_t len,
+                        http_write_fn write_cb, void *userdata);
+
+/* POST body and collect the whole response in out; out is appended to */
+CURLcode http_conn_post_buf(HttpConn *c, const char *body, size_t len, Buffer *out);
+
+/* POST the concatenation of iov[0..count) without joining it first. The
+   pieces must stay valid until the call returns. */
+CURLcode http_conn_post_iov(HttpConn *c, const struct iovec *iov, int count,
+                            http_write_fn write_cb, void *userdata);
+
+/* The same POST in two halves, so local work can overlap the server's:
+   start returns once the whole body has been sent, and finish waits for
+   the reply, delivering it to write_cb. The pieces must stay valid until
+   finish returns, since libcurl sends the body again when a kept-alive
+   connection turns out to be closed. The write callback may already run
+   inside start. Only one request can be in flight per connection. */
+bool http_conn_start_iov(HttpConn *c, const struct iovec *iov, int count,
+                         http_write_fn write_cb, void *userdata);
+CURLcode http_conn_finish(HttpConn *c);
+
+/* For a caller driving its own multi handle (see engine.h): prepare
+   sets the POST up without sending it, after which c->curl can be added
+   to the multi handle; done records the timings once the multi handle
+   reports the transfer finished. The pieces must stay valid until then. */
+bool http_conn_prepare_iov(HttpConn *c, const struct iovec *iov, int count,
+                           http_write_fn write_cb, void *userdata);
+CURLcode http_conn_done(HttpConn *c, CURLcode res);
+
+#endif
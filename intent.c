@@ -0,0 +1,128 @@
+/*
+ * intent.c - Plain list/read/delete requests recognized without the model
+ */
+
+#include <string.h>
+#include "intent.h"
+
+enum { W_NONE, W_POLITE, W_FILLER, W_DIR, W_LIST, W_READ, W_DELETE };
+
+static const struct { const char *text; uint8_t word; } WORDS[] = {
+    { "list", W_LIST }, { "ls", W_LIST },
+    { "read", W_READ }, { "show", W_READ }, { "display", W_READ }, { "view", W_READ },
+    { "cat", W_READ }, { "open", W_READ }, { "print", W_READ },
+    { "delete", W_DELETE }, { "remove", W_DELETE }, { "rm", W_DELETE },
+    { "please", W_POLITE },
+    { "the", W_FILLER }, { "a", W_FILLER }, { "me", W_FILLER }, { "my", W_FILLER },
+    { "file", W_FILLER }, { "files", W_FILLER }, { "contents", W_FILLER },
+    { "content", W_FILLER }, { "of", W_FILLER }, { "in", W_FILLER }, { "all", W_FILLER },
+    { "directory", W_DIR }, { "dir", W_DIR }, { "folder", W_DIR },
+    { "everything", W_FILLER }, { "here", W_FILLER }, { "current", W_FILLER },
+};
+
+static void add(IntentTrie *t, const char *s, uint8_t word) {
+    int n = 0;
+    for (; *s; s++) {
+        int c = *s - 'a';
+        if (!t->next[n][c]) {
+            if (t->count == INTENT_MAX_NODES) return;
+            t->next[n][c] = (uint8_t)t->count++;
+        }
+        n = t->next[n][c];
+    }
+    t->word[n] = word;
+}
+
+void intent_init(IntentTrie *t) {
+    memset(t, 0, sizeof(*t));
+    t->count = 1;
+    for (size_t i = 0; i < sizeof(WORDS) / sizeof(WORDS[0]); i++) add(t, WORDS[i].text, WORDS[i].word);
+}
+
+const char *intent_action(IntentKind kind) {
+    switch (kind) {
+    case INTENT_LIST:   return "list";
+    case INTENT_READ:   return "read";
+    case INTENT_DELETE: return "delete";
+    default:            return "";
+    }
+}
+
+/* The word a whole token spells, ignoring case; W_NONE if it is anything else */
+static uint8_t lookup(const IntentTrie *t, const char *p, size_t len) {
+    int n = 0;
+    for (size_t i = 0; i < len; i++) {
+        int c = p[i] | 0x20;
+        if (c < 'a' || c > 'z' || !(n = t->next[n][c - 'a'])) return W_NONE;
+    }
+    return t->word[n];
+}
+
+/* No '.' or '/': as likely an ordinary word as a path */
+static bool bare(const char *p, size_t len) {
+    return !memchr(p, '.', len) && !memchr(p, '/', len);
+}
+
+static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+bool intent_match(const IntentTrie *t, const char *input, Intent *out) {
+    const char *p = input, *end = input + strlen(input);
+    while (end > p && (is_space(end[-1]) || end[-1] == '?' || end[-1] == '!')) end--;
+
+    IntentKind kind = INTENT_NONE;
+    const char *path = NULL;
+    size_t path_len = 0;
+    bool quoted = false;
+
+    while (p < end) {
+        while (p < end && is_space(*p)) p++;
+        if (p == end) break;
+
+        const char *tok = p;
+        size_t len;
+        bool q = *p == '"' || *p == '\'' || *p == '`';
+        if (q) {
+            const char *close = memchr(p + 1, *p, (size_t)(end - p - 1));
+            if (!close || close == p + 1 || (close + 1 < end && !is_space(close[1]))) return false;
+            tok = p + 1;
+            len = (size_t)(close - tok);
+            p = close + 1;
+        } else {
+            while (p < end && !is_space(*p)) p++;
+            len = (size_t)(p - tok);
+        }
+
+        uint8_t w = q ? W_NONE : lookup(t, tok, len);
+        if (kind == INTENT_NONE) {
+            /* Only politeness may come before the verb */
+            if (w == W_POLITE) continue;
+            if (w == W_LIST) kind = INTENT_LIST;
+            else if (w == W_READ) kind = INTENT_READ;
+            else if (w == W_DELETE) kind = INTENT_DELETE;
+            else return false;
+        } else if (w == W_FILLER && path && !quoted && bare(path, path_len)) {
+            return false;       /* "list python files": a kind of file, not a name */
+        } else if (w == W_FILLER || w == W_DIR || w == W_POLITE) {
+            continue;
+        } else if (w != W_NONE || path) {
+            return false;       /* a second verb or a second path */
+        } else {
+            path = tok;
+            path_len = len;
+            quoted = q;
+        }
+    }
+
+    if (kind == INTENT_NONE) return false;
+    if (path && !quoted && *path == '-') return false;     /* "ls -la" */
+    if (kind != INTENT_LIST) {
+        if (!path) return false;
+        if (!quoted && bare(path, path_len)) return false;
+    }
+    if (out) {
+        out->kind = kind;
+        out->path = path;
+        out->path_len = path_len;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+/*
+ * intent.h - Plain list/read/delete requests recognized without the model
+ *
+ * A flat trie of verbs and filler words, built once at startup, is
+ * walked over the input a word at a time. An input matches only when
+ * it is an optional "please", one verb, any number of fillers ("the",
+ * "file", "contents of", ...) and at most one path, and nothing else:
+ * "read notes.txt", "show me the file 'my notes.txt'", "list files in
+ * src". Anything more ("read a.txt and fix the typo", "write a poem")
+ * is left to the model. Unquoted paths for read and delete must contain
+ * a '.' or '/', so "show help" is not taken for a file called help, and
+ * a plain word followed by a filler is a description, not a name
+ * ("list python files").
+ *
+ * The trie is read-only after intent_init(), so any thread may match.
+ */
+
+#ifndef INTENT_H
+#define INTENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INTENT_MAX_NODES 160
+
+typedef enum { INTENT_NONE, INTENT_LIST, INTENT_READ, INTENT_DELETE } IntentKind;
+
+typedef struct {
+    IntentKind kind;
+    const char *path;       /* into the input; NULL for a bare "list" */
+    size_t path_len;
+} Intent;
+
+typedef struct {
+    uint8_t next[INTENT_MAX_NODES][26];     /* 0: no edge (the root is never a child) */
+    uint8_t word[INTENT_MAX_NODES];         /* what a word ending here means */
+    int count;
+} IntentTrie;
+
+void intent_init(IntentTrie *t);
+
+/* Verb name for a kind: "list", "read", "delete" */
+const char *intent_action(IntentKind kind);
+
+/* True and *out filled when the whole input is one plain request */
+bool intent_match(const IntentTrie *t, const char *input, Intent *out);
+
+#endif
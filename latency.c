@@ -0,0 +1,76 @@
+/*
+ * latency.c - Monotonic timers and log-linear histograms
+ */
+
+#include <time.h>
+#include "latency.h"
+
+#define SUB  (1u << LAT_SUB_BITS)
+
+uint64_t lat_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/* Values below SUB map to themselves; above, the top LAT_SUB_BITS + 1
+   bits pick the bucket and the rest are dropped */
+static unsigned bucket_of(uint64_t v) {
+    if (v < SUB) return (unsigned)v;
+    unsigned shift = 63u - (unsigned)__builtin_clzll(v) - LAT_SUB_BITS;
+    return (shift + 1) * SUB + (unsigned)((v >> shift) & (SUB - 1));
+}
+
+/* Largest value that lands in bucket b */
+static uint64_t bucket_high(unsigned b) {
+    if (b < SUB) return b;
+    unsigned shift = b / SUB - 1;
+    uint64_t low = (uint64_t)(SUB + b % SUB) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void lat_record(LatHist *h, uint64_t v) {
+    uint64_t top = ((uint64_t)1 << LAT_MAX_BITS) - 1;
+    if (v > top) v = top;
+    if (!h->count || v < h->min) h->min = v;
+    if (v > h->max) h->max = v;
+    h->count++;
+    h->sum += v;
+    h->buckets[bucket_of(v)]++;
+}
+
+uint64_t lat_percentile(const LatHist *h, double p) {
+    if (!h->count) return 0;
+    uint64_t want = (uint64_t)(p * (double)h->count + 0.5);
+    if (want < 1) want = 1;
+    if (want >= h->count) return h->max;
+
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < LAT_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= want) {
+            uint64_t v = bucket_high(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void lat_print_header(FILE *f) {
+    fprintf(f, "  %-14s %7s %9s %9s %9s %9s %9s\n",
+            "stage", "count", "p50", "p90", "p99", "max", "mean");
+}
+
+void lat_print(FILE *f, const char *name, const LatHist *h, double scale) {
+    if (!h->count) {
+        fprintf(f, "  %-14s %7d %9s %9s %9s %9s %9s\n", name, 0, "-", "-", "-", "-", "-");
+        return;
+    }
+    fprintf(f, "  %-14s %7llu %9.2f %9.2f %9.2f %9.2f %9.2f\n", name,
+            (unsigned long long)h->count,
+            (double)lat_percentile(h, 0.50) / scale,
+            (double)lat_percentile(h, 0.90) / scale,
+            (double)lat_percentile(h, 0.99) / scale,
+            (double)h->max / scale,
+            (double)h->sum / (double)h->count / scale);
+}
@@ -0,0 +1,38 @@
+/*
+ * latency.h - Monotonic timers and log-linear histograms
+ *
+ * Values are bucketed HdrHistogram-style: exact below 16, then 16
+ * linear sub-buckets per power of two, so any percentile is within
+ * 1/16 (6.25%) of the true value while a histogram stays a fixed 2.4 KB
+ * with no allocation. Recording is a shift, a count-leading-zeros and
+ * an increment.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define LAT_SUB_BITS  4
+#define LAT_MAX_BITS  40            /* values clamp at 2^40 (12 days in us) */
+#define LAT_BUCKETS   ((LAT_MAX_BITS - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+typedef struct {
+    uint64_t count, sum, min, max;
+    uint32_t buckets[LAT_BUCKETS];
+} LatHist;
+
+/* CLOCK_MONOTONIC in microseconds */
+uint64_t lat_now_us(void);
+
+void lat_record(LatHist *h, uint64_t value);
+/* Value at or below which fraction p (0..1) of the samples fall */
+uint64_t lat_percentile(const LatHist *h, double p);
+
+/* Table rows: name, count, p50, p90, p99, max, mean, each value divided
+   by scale (1000 to show microseconds as ms) */
+void lat_print_header(FILE *f);
+void lat_print(FILE *f, const char *name, const LatHist *h, double scale);
+
+#endif
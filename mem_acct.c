@@ -0,0 +1,93 @@
+/*
+ * mem_acct.c - Live heap bytes per subsystem, with an optional cap
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <stdatomic.h>
+#include "mem_acct.h"
+
+static const char *const KIND_NAMES[MEM_KINDS] = { "history", "json", "io", "commands" };
+
+static _Atomic long g_live[MEM_KINDS], g_peak[MEM_KINDS];
+static _Atomic long g_total, g_total_peak;
+static _Atomic size_t g_cap;
+
+static _Thread_local MemKind t_scope = MEM_JSON;
+
+static void raise_peak(_Atomic long *peak, long now) {
+    long seen = atomic_load_explicit(peak, memory_order_relaxed);
+    while (now > seen && !atomic_compare_exchange_weak_explicit(peak, &seen, now, memory_order_relaxed,
+                                                                memory_order_relaxed)) {}
+}
+
+void mem_add(MemKind k, long delta) {
+    if (!delta) return;
+    long live = atomic_fetch_add_explicit(&g_live[k], delta, memory_order_relaxed) + delta;
+    long total = atomic_fetch_add_explicit(&g_total, delta, memory_order_relaxed) + delta;
+    if (delta > 0) {
+        raise_peak(&g_peak[k], live);
+        raise_peak(&g_total_peak, total);
+    }
+}
+
+void *mem_malloc(MemKind k, size_t n) {
+    void *p = malloc(n);
+    if (p) mem_add(k, (long)malloc_usable_size(p));
+    return p;
+}
+
+void *mem_calloc(MemKind k, size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (p) mem_add(k, (long)malloc_usable_size(p));
+    return p;
+}
+
+char *mem_strdup(MemKind k, const char *s) {
+    char *p = strdup(s);
+    if (p) mem_add(k, (long)malloc_usable_size(p));
+    return p;
+}
+
+void mem_free(MemKind k, void *p) {
+    if (!p) return;
+    mem_add(k, -(long)malloc_usable_size(p));
+    free(p);
+}
+
+MemKind mem_scope(MemKind k) {
+    MemKind old = t_scope;
+    t_scope = k;
+    return old;
+}
+
+void *mem_json_malloc(size_t n) { return mem_malloc(t_scope, n); }
+void mem_json_free(void *p) { mem_free(t_scope, p); }
+
+void mem_set_cap(size_t bytes) { g_cap = bytes; }
+size_t mem_cap(void) { return g_cap; }
+
+bool mem_fits(size_t extra) {
+    return !g_cap || mem_live() + extra <= g_cap;
+}
+
+size_t mem_live(void) {
+    long total = atomic_load_explicit(&g_total, memory_order_relaxed);
+    return total > 0 ? (size_t)total : 0;
+}
+
+size_t mem_kind_live(MemKind k) {
+    long live = atomic_load_explicit(&g_live[k], memory_order_relaxed);
+    return live > 0 ? (size_t)live : 0;
+}
+
+void mem_print(FILE *f) {
+    fprintf(f, "Memory: %.1f KB live, peak %.1f KB", (double)g_total / 1024.0,
+            (double)g_total_peak / 1024.0);
+    if (g_cap) fprintf(f, ", cap %.1f KB", (double)g_cap / 1024.0);
+    fprintf(f, "\n");
+    for (int k = 0; k < MEM_KINDS; k++)
+        fprintf(f, "  %-9s %9.1f KB  peak %9.1f KB\n", KIND_NAMES[k], (double)g_live[k] / 1024.0,
+                (double)g_peak[k] / 1024.0);
+}
@@ -0,0 +1,65 @@
+/*
+ * mem_acct.h - Live heap bytes per subsystem, with an optional cap
+ *
+ * Allocations made through these wrappers are counted under the kind
+ * they are for. The size counted is what malloc really handed out
+ * (malloc_usable_size), so a free subtracts exactly what was added and
+ * no header sits in front of the block. A block must be freed under the
+ * kind it was allocated for; one freed with plain free() is simply
+ * never subtracted, which overstates and never understates.
+ *
+ * cJSON allocates through mem_json_malloc/mem_json_free once they are
+ * installed with cJSON_InitHooks. Those count under the calling thread's
+ * current kind: MEM_JSON, unless mem_scope() has set another one, as
+ * the history does for its messages' JSON.
+ *
+ * The cap does not make allocations fail. Whoever is about to take on
+ * something large asks mem_fits() first and makes room or refuses.
+ * Counters are atomic, so any thread may allocate.
+ */
+
+#ifndef MEM_ACCT_H
+#define MEM_ACCT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    MEM_HISTORY,            /* messages and their JSON */
+    MEM_JSON,               /* parse trees, arenas, printed requests */
+    MEM_IO,                 /* Buffers and reply buffers */
+    MEM_CMD,                /* command contents, edits, job prompts */
+    MEM_KINDS
+} MemKind;
+
+void *mem_malloc(MemKind k, size_t n);
+void *mem_calloc(MemKind k, size_t n, size_t size);
+char *mem_strdup(MemKind k, const char *s);
+void mem_free(MemKind k, void *p);
+
+/* For owners that track their own sizes, like Buffer's capacity */
+void mem_add(MemKind k, long delta);
+
+/* The kind cJSON allocations on this thread count under; returns the
+   previous one, to be put back */
+MemKind mem_scope(MemKind k);
+
+/* cJSON_Hooks */
+void *mem_json_malloc(size_t n);
+void mem_json_free(void *p);
+
+/* 0 for no cap */
+void mem_set_cap(size_t bytes);
+size_t mem_cap(void);
+
+/* Whether extra more bytes stay under the cap */
+bool mem_fits(size_t extra);
+
+size_t mem_live(void);
+size_t mem_kind_live(MemKind k);
+
+/* Live and peak bytes per kind */
+void mem_print(FILE *f);
+
+#endif
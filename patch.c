@@ -0,0 +1,243 @@
+/*
+ * patch.c - Edits to an existing file as hunks instead of a rewrite
+ */
+
+#define _GNU_SOURCE             /* memmem */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "patch.h"
+
+void patch_init(Patch *p) {
+    memset(p, 0, sizeof(*p));
+}
+
+void patch_free(Patch *p) {
+    for (int i = 0; i < p->count; i++) buf_free(&p->hunks[i].text);
+    p->count = 0;
+}
+
+static size_t line_of(const char *src, size_t at) {
+    size_t line = 1;
+    for (const char *q = src; (q = memchr(q, '\n', (size_t)(src + at - q))); q++) line++;
+    return line;
+}
+
+static void drop_newline(Buffer *b) {
+    if (b->size && b->data[b->size - 1] == '\n') b->data[--b->size] = 0;
+}
+
+/* Takes *text. Whole lines both sides share are trimmed off first, so
+   the hunk and its preview cover only the change. */
+static bool add_hunk(Patch *p, const char *src, size_t at, size_t old_len, Buffer *text) {
+    const char *old = src + at;
+    size_t k = 0;
+    while (k < old_len && k < text->size && old[k] == text->data[k]) k++;
+    while (k && old[k - 1] != '\n') k--;
+    at += k;
+    old += k;
+    old_len -= k;
+    if (k) {
+        memmove(text->data, text->data + k, text->size - k + 1);
+        text->size -= k;
+    }
+
+    size_t m = 0;
+    while (m < old_len && m < text->size && old[old_len - m - 1] == text->data[text->size - m - 1]) m++;
+    while (m && !((m == old_len || old[old_len - m - 1] == '\n') &&
+                  (m == text->size || text->data[text->size - m - 1] == '\n'))) m--;
+    old_len -= m;
+    text->size -= m;
+    if (text->data) text->data[text->size] = 0;
+
+    if (!old_len && !text->size) {          /* nothing changes */
+        buf_free(text);
+        return true;
+    }
+    if (p->count == PATCH_MAX_HUNKS) {
+        snprintf(p->err, sizeof(p->err), "more than %d hunks", PATCH_MAX_HUNKS);
+        buf_free(text);
+        return false;
+    }
+
+    int i = p->count;
+    while (i > 0 && p->hunks[i - 1].at > at) i--;
+    const PatchHunk *prev = i > 0 ? &p->hunks[i - 1] : NULL;
+    const PatchHunk *next = i < p->count ? &p->hunks[i] : NULL;
+    if ((prev && (prev->at + prev->old_len > at || prev->at == at)) ||
+        (next && (at + old_len > next->at || next->at == at))) {
+        snprintf(p->err, sizeof(p->err), "hunks overlap at line %zu", line_of(src, at));
+        buf_free(text);
+        return false;
+    }
+    memmove(&p->hunks[i + 1], &p->hunks[i], (size_t)(p->count - i) * sizeof(*p->hunks));
+    p->hunks[i] = (PatchHunk){ .at = at, .old_len = old_len, .text = *text, .line = line_of(src, at) };
+    p->count++;
+    memset(text, 0, sizeof(*text));
+    return true;
+}
+
+/* ---- Search and replace ---- */
+
+bool patch_edit(Patch *p, const char *src, size_t len, const char *find, const char *replace) {
+    size_t flen = strlen(find);
+    if (!flen) {
+        snprintf(p->err, sizeof(p->err), "empty search text");
+        return false;
+    }
+    const char *hit = memmem(src, len, find, flen);
+    if (!hit) {
+        snprintf(p->err, sizeof(p->err), "search text not found: %.40s", find);
+        return false;
+    }
+    if (memmem(hit + 1, len - (size_t)(hit + 1 - src), find, flen)) {
+        snprintf(p->err, sizeof(p->err), "search text found more than once: %.40s", find);
+        return false;
+    }
+    Buffer text = {0};
+    if (!buf_puts(&text, replace)) {
+        snprintf(p->err, sizeof(p->err), "out of memory");
+        buf_free(&text);
+        return false;
+    }
+    return add_hunk(p, src, (size_t)(hit - src), flen, &text);
+}
+
+/* ---- Unified diff ---- */
+
+/* Where old starts: the line start matching it nearest to line want */
+static bool locate(const char *src, size_t len, const Buffer *old, size_t want, size_t *at) {
+    size_t best = SIZE_MAX, pos = 0, line = 1;
+    for (;;) {
+        size_t d = line > want ? line - want : want - line;
+        if (d < best && len - pos >= old->size && memcmp(src + pos, old->data ? old->data : "", old->size) == 0) {
+            best = d;
+            *at = pos;
+            if (!d) break;
+        }
+        if (line > want && d >= best) break;
+        const char *nl = memchr(src + pos, '\n', len - pos);
+        if (!nl) break;
+        pos = (size_t)(nl - src) + 1;
+        line++;
+    }
+    return best != SIZE_MAX;
+}
+
+/* "@@ -a[,b] +c[,d] @@"; only a matters, counts are often wrong */
+static bool hunk_header(const char *line, size_t *old_start) {
+    if (strncmp(line, "@@ -", 4) != 0) return false;
+    char *end;
+    *old_start = strtoul(line + 4, &end, 10);
+    if (*end == ',') strtoul(end + 1, &end, 10);
+    return end > line + 4 && strncmp(end, " +", 2) == 0;
+}
+
+static bool file_header(const char *line, const char *next) {
+    return strncmp(line, "diff ", 5) == 0 ||
+           (strncmp(line, "--- ", 4) == 0 && next && strncmp(next, "+++ ", 4) == 0);
+}
+
+bool patch_diff(Patch *p, const char *src, size_t len, const char *diff) {
+    const char *q = diff;
+    int hunks = 0;
+    while (*q) {
+        const char *eol = strchr(q, '\n');
+        const char *next = eol ? eol + 1 : q + strlen(q);
+        size_t start;
+        if (!hunk_header(q, &start)) { q = next; continue; }
+        q = next;
+
+        /* The body runs to the next header or the first line of any
+           other kind. Bare empty lines count as context only when more
+           of the body follows them. */
+        Buffer old = {0}, new = {0};
+        char last = ' ';
+        int blanks = 0;
+        bool ok = true;
+        while (*q && ok) {
+            eol = strchr(q, '\n');
+            next = eol ? eol + 1 : q + strlen(q);
+            size_t n = (size_t)(next - q) - (eol ? 1 : 0);
+            if (n == 0) { blanks++; q = next; continue; }
+            if (strncmp(q, "@@ ", 3) == 0 || file_header(q, *next ? next : NULL) || !strchr(" -+\\", *q)) break;
+            for (; blanks && ok; blanks--) ok = buf_puts(&old, "\n") && buf_puts(&new, "\n");
+            if (*q == '\\') {
+                if (last != '+') drop_newline(&old);
+                if (last != '-') drop_newline(&new);
+            } else {
+                if (*q != '+') ok = ok && buf_append(&old, q + 1, n - 1) && buf_puts(&old, "\n");
+                if (*q != '-') ok = ok && buf_append(&new, q + 1, n - 1) && buf_puts(&new, "\n");
+                last = *q;
+            }
+            q = next;
+        }
+
+        size_t want = old.size ? start : start + 1, at = 0, old_len = old.size;
+        if (ok && !locate(src, len, &old, want ? want : 1, &at)) {
+            /* A last line without a newline, and no "\ No newline" marker */
+            size_t n = old.size - 1;
+            ok = old.size && len && src[len - 1] != '\n' && n <= len &&
+                 (n == len || src[len - n - 1] == '\n') && memcmp(src + len - n, old.data, n) == 0;
+            if (ok) {
+                at = len - n;
+                old_len = n;
+                drop_newline(&new);
+            } else {
+                snprintf(p->err, sizeof(p->err), "hunk at line %zu does not match the file", start);
+            }
+        } else if (!ok) {
+            snprintf(p->err, sizeof(p->err), "out of memory");
+        }
+        buf_free(&old);
+        if (!ok || !add_hunk(p, src, at, old_len, &new)) {
+            buf_free(&new);
+            return false;
+        }
+        hunks++;
+    }
+    if (!hunks) snprintf(p->err, sizeof(p->err), "no hunks in diff");
+    return hunks > 0;
+}
+
+/* ---- Applying ---- */
+
+int patch_iov(const Patch *p, const char *src, size_t len, struct iovec *iov) {
+    size_t pos = 0;
+    int n = 0;
+    for (int i = 0; i < p->count; i++) {
+        const PatchHunk *h = &p->hunks[i];
+        if (h->at > pos) iov[n++] = (struct iovec){ (char *)src + pos, h->at - pos };
+        if (h->text.size) iov[n++] = (struct iovec){ h->text.data, h->text.size };
+        pos = h->at + h->old_len;
+    }
+    if (pos < len) iov[n++] = (struct iovec){ (char *)src + pos, len - pos };
+    return n;
+}
+
+size_t patch_size(const Patch *p, size_t len) {
+    for (int i = 0; i < p->count; i++) len = len - p->hunks[i].old_len + p->hunks[i].text.size;
+    return len;
+}
+
+static bool preview_lines(Buffer *out, char mark, const char *s, size_t n) {
+    const char *end = s + n;
+    while (s < end) {
+        const char *nl = memchr(s, '\n', (size_t)(end - s));
+        const char *stop = nl ? nl : end;
+        if (!buf_printf(out, "%c%.*s\n", mark, (int)(stop - s), s)) return false;
+        s = nl ? nl + 1 : end;
+    }
+    return true;
+}
+
+bool patch_preview(const Patch *p, const char *src, Buffer *out) {
+    for (int i = 0; i < p->count; i++) {
+        const PatchHunk *h = &p->hunks[i];
+        if (!buf_printf(out, "@@ line %zu @@\n", h->line) ||
+            !preview_lines(out, '-', src + h->at, h->old_len) ||
+            !preview_lines(out, '+', h->text.data, h->text.size)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * patch.h - Edits to an existing file as hunks instead of a rewrite
+ *
+ * A patch is a sorted set of non-overlapping hunks, each replacing one
+ * span of the original text. Hunks come from search/replace pairs (the
+ * search text must occur exactly once) or from a unified diff, whose
+ * hunks are found at their stated line or, failing that, at the nearest
+ * line where their old text matches. Common leading and trailing lines
+ * are trimmed off each hunk, so a hunk holds only what really changes.
+ *
+ * Nothing is copied to apply a patch: patch_iov() describes the new file
+ * as slices of the original and the hunks' texts, ready for one writev.
+ * The original must stay mapped until that write is done.
+ */
+
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include "buffer.h"
+
+#ifndef PATCH_MAX_HUNKS
+#define PATCH_MAX_HUNKS  64
+#endif
+
+/* Enough iovecs for any patch */
+#define PATCH_MAX_IOV  (2 * PATCH_MAX_HUNKS + 1)
+
+typedef struct {
+    size_t at, old_len;         /* the original bytes replaced */
+    Buffer text;                /* what replaces them */
+    size_t line;                /* 1-based line `at` is on */
+} PatchHunk;
+
+typedef struct {
+    PatchHunk hunks[PATCH_MAX_HUNKS];
+    int count;
+    char err[128];              /* why the last call failed */
+} Patch;
+
+void patch_init(Patch *p);
+void patch_free(Patch *p);
+
+/* Replace the one occurrence of find in src[0..len) */
+bool patch_edit(Patch *p, const char *src, size_t len, const char *find, const char *replace);
+
+/* Every hunk of a unified diff; file headers are skipped */
+bool patch_diff(Patch *p, const char *src, size_t len, const char *diff);
+
+/* The patched file as slices; returns the count */
+int patch_iov(const Patch *p, const char *src, size_t len, struct iovec *iov);
+
+/* Size of the patched file */
+size_t patch_size(const Patch *p, size_t len);
+
+/* The hunks as "@@ line N @@" headers and -/+ lines, for confirmation */
+bool patch_preview(const Patch *p, const char *src, Buffer *out);
+
+#endif
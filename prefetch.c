@@ -0,0 +1,101 @@
+/*
+ * prefetch.c - Warm files the model is likely to ask for next
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "prefetch.h"
+
+/* Start the read-in; false when the path is not worth it */
+static bool warm_file(Prefetcher *p, const char *path, size_t *bytes) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+              (size_t)st.st_size <= p->max_bytes;
+    if (ok) {
+        posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+        *bytes = (size_t)st.st_size;
+    }
+    close(fd);
+    return ok;
+}
+
+static void *pf_main(void *arg) {
+    Prefetcher *p = arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->count && !p->stop) pthread_cond_wait(&p->more, &p->lock);
+        if (p->stop) break;
+        char *path = p->queue[p->head];
+        p->queue[p->head] = NULL;
+        p->head = (p->head + 1) % PF_QUEUE;
+        p->count--;
+        pthread_mutex_unlock(&p->lock);
+
+        size_t bytes = 0;
+        bool ok = warm_file(p, path, &bytes);
+        if (ok && p->warm) p->warm(path, p->userdata);
+        free(path);
+
+        pthread_mutex_lock(&p->lock);
+        if (ok) { p->warmed++; p->bytes += bytes; }
+        else p->skipped++;
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+bool pf_start(Prefetcher *p, size_t max_bytes, pf_warm_fn warm, void *userdata) {
+    memset(p, 0, sizeof(*p));
+    p->max_bytes = max_bytes;
+    p->warm = warm;
+    p->userdata = userdata;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->more, NULL);
+    p->running = pthread_create(&p->thread, NULL, pf_main, p) == 0;
+    return p->running;
+}
+
+void pf_stop(Prefetcher *p) {
+    if (!p->running) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_signal(&p->more);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+    p->running = false;
+
+    for (; p->count; p->count--, p->head = (p->head + 1) % PF_QUEUE) free(p->queue[p->head]);
+    pthread_cond_destroy(&p->more);
+    pthread_mutex_destroy(&p->lock);
+}
+
+void pf_hint(Prefetcher *p, const char *path) {
+    if (!p->running) return;
+    pthread_mutex_lock(&p->lock);
+    p->hinted++;
+    bool queued = false;
+    for (int i = 0; i < p->count && !queued; i++)
+        queued = strcmp(p->queue[(p->head + i) % PF_QUEUE], path) == 0;
+    char *copy = NULL;
+    if (!queued && p->count < PF_QUEUE && (copy = strdup(path))) {
+        p->queue[(p->head + p->count) % PF_QUEUE] = copy;
+        p->count++;
+        pthread_cond_signal(&p->more);
+    } else if (!queued) {
+        p->dropped++;
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+void pf_print(Prefetcher *p, FILE *f) {
+    if (!p->running) return;
+    pthread_mutex_lock(&p->lock);
+    fprintf(f, "Prefetch: %lu hinted, %lu warmed (%llu bytes), %lu skipped, %lu dropped\n",
+            p->hinted, p->warmed, p->bytes, p->skipped, p->dropped);
+    pthread_mutex_unlock(&p->lock);
+}
@@ -0,0 +1,57 @@
+/*
+ * prefetch.h - Warm files the model is likely to ask for next
+ *
+ * While a reply is being generated the disk is idle, and the next
+ * command is usually a read of a file that was just listed or named in
+ * the prompt. pf_hint() queues such a path; a background thread opens
+ * it, and if it is a regular file of at most max_bytes asks the kernel
+ * to read it in (POSIX_FADV_WILLNEED) and then runs the hook, which can
+ * load it into a content cache. By the time the read arrives it costs
+ * a cache hit instead of a cold open and read.
+ *
+ * Hints are only hints: a full queue drops them, a path already queued
+ * is not queued twice, and pf_hint() never blocks on I/O.
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#ifndef PF_QUEUE
+#define PF_QUEUE  32
+#endif
+
+/* Runs on the prefetch thread for each file that was warmed */
+typedef void (*pf_warm_fn)(const char *path, void *userdata);
+
+typedef struct {
+    pthread_t thread;
+    bool running, stop;
+    size_t max_bytes;
+    pf_warm_fn warm;
+    void *userdata;
+
+    pthread_mutex_t lock;       /* guards the queue and the counters */
+    pthread_cond_t more;
+    char *queue[PF_QUEUE];
+    int head, count;
+
+    unsigned long hinted, dropped, warmed, skipped;
+    unsigned long long bytes;
+} Prefetcher;
+
+bool pf_start(Prefetcher *p, size_t max_bytes, pf_warm_fn warm, void *userdata);
+
+/* Drops whatever is still queued and joins the thread */
+void pf_stop(Prefetcher *p);
+
+void pf_hint(Prefetcher *p, const char *path);
+
+/* Counters on one line */
+void pf_print(Prefetcher *p, FILE *f);
+
+#endif
@@ -0,0 +1,96 @@
+/*
+ * repair.c - Turn the model's ? placeholders back into < and >
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "repair.h"
+
+/* Byte classes for the bytes around a ? */
+#define R_TAG    1      /* letter: a tag name may start here */
+#define R_END    2      /* may end a tag: alnum, quote, / - ] */
+#define R_START  4      /* / or ! right after ? always opens */
+
+static const unsigned char r_class[256] = {
+    ['a' ... 'z'] = R_TAG | R_END,
+    ['A' ... 'Z'] = R_TAG | R_END,
+    ['0' ... '9'] = R_END,
+    ['"'] = R_END, ['\''] = R_END, ['-'] = R_END, [']'] = R_END,
+    ['/'] = R_END | R_START,
+    ['!'] = R_START,
+};
+
+static char r_decide(unsigned char prev, unsigned char next) {
+    if (r_class[next] & R_START) return '<';
+    if (r_class[prev] & R_END) return '>';
+    if (r_class[next] & R_TAG) return '<';
+    return '?';
+}
+
+/* Repair s[0..len) in place, given the bytes just outside it (0 for
+   none). The look-behind may read a ? already rewritten to < or >; like
+   ? itself neither has a class, so the decision is the same. */
+static size_t repair_span(char *s, size_t len, unsigned char before, unsigned char after) {
+    char *p = s, *end = s + len;
+    size_t n = 0;
+    while (p < end && (p = memchr(p, '?', (size_t)(end - p)))) {
+        unsigned char prev = p > s ? (unsigned char)p[-1] : before;
+        unsigned char next = p + 1 < end ? (unsigned char)p[1] : after;
+        char c = r_decide(prev, next);
+        if (c != '?') { *p = c; n++; }
+        p++;
+    }
+    return n;
+}
+
+char *repair_html(const char *input) {
+    if (!input) return NULL;
+    size_t len = strlen(input);
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, input, len + 1);
+    repair_span(out, len, 0, 0);
+    return out;
+}
+
+size_t repair_html_inplace(char *s, size_t len) {
+    return repair_span(s, len, 0, 0);
+}
+
+void repair_stream_init(RepairStream *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+size_t repair_stream(RepairStream *s, const char *in, size_t len, char *out) {
+    if (!len) return 0;
+    char *o = out;
+
+    if (s->pending) {
+        char c = r_decide(s->prev, (unsigned char)in[0]);
+        if (c != '?') s->repaired++;
+        *o++ = c;
+        s->prev = '?';
+        s->pending = false;
+    }
+
+    /* Hold back a trailing ? until its next byte is known */
+    size_t body = len;
+    if (in[len - 1] == '?') {
+        body--;
+        s->pending = true;
+    }
+    memcpy(o, in, body);
+    s->repaired += repair_span(o, body, s->prev, s->pending ? '?' : 0);
+    if (body) s->prev = (unsigned char)in[body - 1];
+    return (size_t)(o - out) + body;
+}
+
+size_t repair_stream_end(RepairStream *s, char *out) {
+    if (!s->pending) return 0;
+    char c = r_decide(s->prev, 0);
+    if (c != '?') s->repaired++;
+    out[0] = c;
+    s->pending = false;
+    s->prev = '?';
+    return 1;
+}
@@ -0,0 +1,43 @@
+/*
+ * repair.h - Turn the model's ? placeholders back into < and >
+ *
+ * The model writes ? for both angle brackets. Each ? is decided from
+ * the byte before and the byte after it:
+ *   1. ?/ and ?! always open a tag (</, <!DOCTYPE, <!--)
+ *   2. after a tag name, a quote, / - or ] it closes one
+ *   3. before a letter it opens one
+ *   4. anything else stays a ?
+ * The scan jumps from ? to ? with memchr, so clean text is only looked at
+ * by the vectorised libc search.
+ */
+
+#ifndef REPAIR_H
+#define REPAIR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Repaired copy of a NUL-terminated string; free() it */
+char *repair_html(const char *input);
+
+/* Repair s[0..len) in place; returns the number of ? rewritten */
+size_t repair_html_inplace(char *s, size_t len);
+
+/* Incremental repair of text that arrives in pieces. A trailing ? is held
+   back until the next chunk shows what follows it, and the last byte seen
+   is kept as the look-behind for the next chunk, so any split gives the
+   same result as repairing the whole text at once. */
+typedef struct {
+    unsigned char prev;     /* byte before the next unread one, 0 at start */
+    bool pending;           /* a ? is held back */
+    size_t repaired;        /* ? rewritten so far */
+} RepairStream;
+
+void repair_stream_init(RepairStream *s);
+/* Repair len bytes into out, which needs room for len + 1 and must not
+   overlap in; returns the bytes written */
+size_t repair_stream(RepairStream *s, const char *in, size_t len, char *out);
+/* Resolve a held-back ? at the end of the text; writes at most one byte */
+size_t repair_stream_end(RepairStream *s, char *out);
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * response_cache.c - Model replies kept for byte-identical requests
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "response_cache.h"
+#include "atomic_write.h"
+#include "buffer.h"
+
+#define FORMAT_TAG  "rcache1"
+
+/* Two unrelated byte-at-a-time lanes (FNV-1a and a multiply-rotate),
+   each finished with the murmur3 avalanche */
+static uint64_t fmix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    return h ^ (h >> 33);
+}
+
+RcKey rcache_key(const struct iovec *iov, int count) {
+    RcKey k = { 0xcbf29ce484222325ULL, 0x243f6a8885a308d3ULL, 0 };
+    for (int i = 0; i < count; i++) {
+        const unsigned char *p = iov[i].iov_base;
+        for (size_t j = 0; j < iov[i].iov_len; j++) {
+            k.h1 = (k.h1 ^ p[j]) * 0x100000001b3ULL;
+            k.h2 = (((k.h2 << 23) | (k.h2 >> 41)) ^ p[j]) * 0x9e3779b97f4a7c15ULL;
+        }
+        k.len += iov[i].iov_len;
+    }
+    k.h1 = fmix(k.h1);
+    k.h2 = fmix(k.h2 ^ k.len);
+    return k;
+}
+
+static bool key_eq(RcKey a, RcKey b) {
+    return a.h1 == b.h1 && a.h2 == b.h2 && a.len == b.len;
+}
+
+/* ---- Referenced files ---- */
+
+bool rc_refs_add(RcRefs *r, const char *path) {
+    for (int i = 0; i < r->count; i++)
+        if (strcmp(r->paths[i], path) == 0) return true;
+    if (r->count == r->cap) {
+        int cap = r->cap ? r->cap * 2 : 8;
+        char **p = realloc(r->paths, (size_t)cap * sizeof(*p));
+        if (!p) return false;
+        r->paths = p;
+        r->cap = cap;
+    }
+    if (!(r->paths[r->count] = strdup(path))) return false;
+    r->count++;
+    return true;
+}
+
+void rc_refs_clear(RcRefs *r) {
+    for (int i = 0; i < r->count; i++) free(r->paths[i]);
+    free(r->paths);
+    memset(r, 0, sizeof(*r));
+}
+
+static void snapshot(RcFile *f) {
+    struct stat st;
+    f->exists = stat(f->path, &st) == 0;
+    if (!f->exists) return;
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+    f->size = st.st_size;
+    f->mtime = st.st_mtim;
+}
+
+static bool unchanged(const RcFile *f) {
+    RcFile now = { .path = f->path };
+    snapshot(&now);
+    if (now.exists != f->exists) return false;
+    return !f->exists || (now.dev == f->dev && now.ino == f->ino && now.size == f->size &&
+                          now.mtime.tv_sec == f->mtime.tv_sec &&
+                          now.mtime.tv_nsec == f->mtime.tv_nsec);
+}
+
+static bool fresh(const RcEntry *e) {
+    for (int i = 0; i < e->nfiles; i++)
+        if (!unchanged(&e->files[i])) return false;
+    return true;
+}
+
+static void entry_free(RcEntry *e) {
+    for (int i = 0; i < e->nfiles; i++) free(e->files[i].path);
+    free(e->files);
+    free(e->content);
+    memset(e, 0, sizeof(*e));
+}
+
+/* ---- Memory ---- */
+
+static RcEntry *find(RespCache *c, RcKey key) {
+    for (int i = 0; i < RCACHE_ENTRIES; i++)
+        if (c->slots[i].content && key_eq(c->slots[i].key, key)) return &c->slots[i];
+    return NULL;
+}
+
+/* Takes ownership of e's contents; call with the lock held */
+static void insert(RespCache *c, RcEntry *e) {
+    RcEntry *slot = find(c, e->key);
+    for (int i = 0; !slot && i < RCACHE_ENTRIES; i++)
+        if (!c->slots[i].content) slot = &c->slots[i];
+    if (!slot) {
+        slot = &c->slots[0];
+        for (int i = 1; i < RCACHE_ENTRIES; i++)
+            if (c->slots[i].used < slot->used) slot = &c->slots[i];
+    }
+    entry_free(slot);
+    *slot = *e;
+    slot->used = ++c->clock;
+}
+
+/* ---- Disk: a header line, one line per file, then the reply ---- */
+
+static void disk_name(const RespCache *c, RcKey key, char *out, size_t sz) {
+    snprintf(out, sz, "%s/%016" PRIx64 "%016" PRIx64 "-%zu", c->dir, key.h1, key.h2, key.len);
+}
+
+static char *slurp(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    char *data = NULL;
+    if (fstat(fd, &st) == 0 && (data = malloc((size_t)st.st_size + 1))) {
+        size_t got = 0;
+        ssize_t n;
+        while (got < (size_t)st.st_size && (n = read(fd, data + got, (size_t)st.st_size - got)) > 0)
+            got += (size_t)n;
+        data[got] = 0;
+        *len = got;
+    }
+    close(fd);
+    return data;
+}
+
+static bool disk_load(const RespCache *c, RcKey key, RcEntry *e) {
+    char path[1024];
+    disk_name(c, key, path, sizeof(path));
+    size_t len;
+    char *data = slurp(path, &len);
+    if (!data) return false;
+
+    memset(e, 0, sizeof(*e));
+    e->key = key;
+    int nfiles, used;
+    size_t content_len;
+    char *p = data;
+    /* %n right after the last number: a trailing space in the format
+       would also eat whitespace the reply or a path starts with */
+    bool ok = sscanf(p, FORMAT_TAG " %d %zu%n", &nfiles, &content_len, &used) == 2 &&
+              p[used] == '\n' && nfiles >= 0 && nfiles < 4096 &&
+              (e->files = calloc((size_t)nfiles + 1, sizeof(*e->files)));
+    p += ok ? used + 1 : 0;
+    for (int i = 0; ok && i < nfiles; i++) {
+        RcFile *f = &e->files[i];
+        int exists;
+        unsigned long long dev, ino;
+        long long size, sec;
+        long nsec;
+        char *nl = strchr(p, '\n');
+        ok = nl && sscanf(p, "%d %llu %llu %lld %lld %ld%n", &exists, &dev, &ino, &size,
+                          &sec, &nsec, &used) == 6 && p[used] == ' ' && p + used < nl;
+        if (!ok) break;
+        f->path = strndup(p + used + 1, (size_t)(nl - p - used - 1));
+        f->exists = exists;
+        f->dev = (dev_t)dev;
+        f->ino = (ino_t)ino;
+        f->size = (off_t)size;
+        f->mtime.tv_sec = (time_t)sec;
+        f->mtime.tv_nsec = nsec;
+        e->nfiles++;
+        ok = f->path != NULL;
+        p = nl + 1;
+    }
+    ok = ok && (size_t)(p - data) + content_len == len && (e->content = strndup(p, content_len));
+    free(data);
+    if (!ok) entry_free(e);
+    return ok;
+}
+
+static void disk_store(const RespCache *c, const RcEntry *e) {
+    Buffer hdr = {0};
+    bool ok = buf_printf(&hdr, FORMAT_TAG " %d %zu\n", e->nfiles, strlen(e->content));
+    for (int i = 0; ok && i < e->nfiles; i++) {
+        const RcFile *f = &e->files[i];
+        if (strchr(f->path, '\n')) ok = false;
+        else ok = buf_printf(&hdr, "%d %llu %llu %lld %lld %ld %s\n", f->exists,
+                             (unsigned long long)f->dev, (unsigned long long)f->ino,
+                             (long long)f->size, (long long)f->mtime.tv_sec,
+                             (long)f->mtime.tv_nsec, f->path);
+    }
+    if (ok) {
+        char path[1024];
+        disk_name(c, e->key, path, sizeof(path));
+        struct iovec iov[2] = {
+            { hdr.data, hdr.size },
+            { e->content, strlen(e->content) },
+        };
+        AtomicWriter w;
+        aw_init(&w, AW_FSYNC_NONE);
+        aw_writev(&w, path, iov, 2);
+        aw_free(&w);
+    }
+    buf_free(&hdr);
+}
+
+static void disk_drop(const RespCache *c, RcKey key) {
+    char path[1024];
+    disk_name(c, key, path, sizeof(path));
+    unlink(path);
+}
+
+/* ---- API ---- */
+
+bool rcache_open(RespCache *c, const char *dir) {
+    memset(c, 0, sizeof(*c));
+    pthread_mutex_init(&c->lock, NULL);
+    if (!dir) return true;
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) return false;
+    return (c->dir = strdup(dir)) != NULL;
+}
+
+void rcache_close(RespCache *c) {
+    for (int i = 0; i < RCACHE_ENTRIES; i++) entry_free(&c->slots[i]);
+    free(c->dir);
+    c->dir = NULL;
+    pthread_mutex_destroy(&c->lock);
+}
+
+char *rcache_get(RespCache *c, RcKey key) {
+    pthread_mutex_lock(&c->lock);
+    RcEntry *e = find(c, key);
+    if (e) {
+        char *out = NULL;
+        if (fresh(e)) {
+            e->used = ++c->clock;
+            out = strdup(e->content);
+            c->hits++;
+        } else {
+            entry_free(e);
+            if (c->dir) disk_drop(c, key);
+            c->stale++;
+        }
+        pthread_mutex_unlock(&c->lock);
+        return out;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    /* Not in memory: the file, read and checked without the lock */
+    RcEntry loaded;
+    char *out = NULL;
+    bool found = c->dir && disk_load(c, key, &loaded);
+    bool ok = found && fresh(&loaded) && (out = strdup(loaded.content));
+    if (found && !ok) {
+        disk_drop(c, key);
+        entry_free(&loaded);
+    }
+
+    pthread_mutex_lock(&c->lock);
+    if (ok) {
+        insert(c, &loaded);
+        c->hits++;
+        c->disk_hits++;
+    } else {
+        if (found) c->stale++;
+        c->misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return out;
+}
+
+void rcache_put(RespCache *c, RcKey key, const char *content, const RcRefs *refs) {
+    RcEntry e = { .key = key };
+    int n = refs ? refs->count : 0;
+    if (!(e.content = strdup(content)) || (n && !(e.files = calloc((size_t)n, sizeof(*e.files))))) {
+        entry_free(&e);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!(e.files[i].path = strdup(refs->paths[i]))) { entry_free(&e); return; }
+        e.nfiles++;
+        snapshot(&e.files[i]);
+    }
+    /* Written before the entry is handed to the table, which may evict it */
+    if (c->dir) disk_store(c, &e);
+
+    pthread_mutex_lock(&c->lock);
+    insert(c, &e);
+    c->stores++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void rcache_print(RespCache *c, FILE *f) {
+    pthread_mutex_lock(&c->lock);
+    int live = 0;
+    for (int i = 0; i < RCACHE_ENTRIES; i++) live += c->slots[i].content != NULL;
+    unsigned long asked = c->hits + c->misses;
+    fprintf(f, "Response cache: %lu hits (%lu from disk), %lu misses, %lu stale, %lu stored, "
+               "%d in memory%s%s, hit rate %.0f%%\n",
+            c->hits, c->disk_hits, c->misses, c->stale, c->stores, live,
+            c->dir ? ", dir " : "", c->dir ? c->dir : "",
+            asked ? 100.0 * (double)c->hits / (double)asked : 0.0);
+    pthread_mutex_unlock(&c->lock);
+}
@@ -0,0 +1,90 @@
+/*
+ * response_cache.h - Model replies kept for byte-identical requests
+ *
+ * The key is a 128-bit hash of the whole request body (model, options,
+ * system prompt and every history message, exactly as sent) plus its
+ * length. The value is the reply's message content. Entries live in a
+ * small LRU in memory and, when a directory is given, one file each on
+ * disk, so a rerun of the same jobs answers from the cache without a
+ * single HTTP round trip.
+ *
+ * A reply can only be as fresh as the files its conversation looked at,
+ * so every entry also records the inode, size and mtime of the files
+ * the session referenced. If any of them has changed (or appeared, or
+ * gone) when the entry is looked up, the entry is dropped and the
+ * lookup is a miss.
+ *
+ * All calls take the cache's lock and may come from any thread.
+ */
+
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifndef RCACHE_ENTRIES
+#define RCACHE_ENTRIES  64
+#endif
+
+typedef struct {
+    uint64_t h1, h2;
+    size_t len;                 /* request body bytes */
+} RcKey;
+
+/* Paths a conversation has referenced; kept per session */
+typedef struct {
+    char **paths;
+    int count, cap;
+} RcRefs;
+
+typedef struct {
+    char *path;
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} RcFile;
+
+typedef struct {
+    RcKey key;
+    char *content;              /* NULL for a free slot */
+    RcFile *files;
+    int nfiles;
+    unsigned long used;         /* LRU clock */
+} RcEntry;
+
+typedef struct {
+    RcEntry slots[RCACHE_ENTRIES];
+    char *dir;                  /* on-disk copies; NULL keeps them in memory only */
+    pthread_mutex_t lock;
+    unsigned long clock;
+    unsigned long hits, disk_hits, misses, stale, stores;
+} RespCache;
+
+RcKey rcache_key(const struct iovec *iov, int count);
+
+/* dir is created if missing; NULL for memory only */
+bool rcache_open(RespCache *c, const char *dir);
+void rcache_close(RespCache *c);
+
+/* A malloc'd copy of the reply, or NULL on a miss */
+char *rcache_get(RespCache *c, RcKey key);
+
+/* Remember the reply along with the current state of refs' files */
+void rcache_put(RespCache *c, RcKey key, const char *content, const RcRefs *refs);
+
+/* Counters on one line */
+void rcache_print(RespCache *c, FILE *f);
+
+bool rc_refs_add(RcRefs *r, const char *path);     /* ignores duplicates */
+void rc_refs_clear(RcRefs *r);
+
+#endif
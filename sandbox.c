@@ -0,0 +1,69 @@
+/*
+ * sandbox.c - Mapping the model's relative paths into the sandbox
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "sandbox.h"
+
+SbStatus sb_path(const char *root, const char *rel, char *out, size_t sz, bool resolve) {
+    if (!rel || !rel[0]) return SB_EMPTY;
+    if (rel[0] == '/') return SB_ABSOLUTE;
+    if (strstr(rel, "..")) return SB_TRAVERSAL;
+    int n = snprintf(out, sz, "%s/%s", root, rel);
+    if (n < 0 || (size_t)n >= sz) return SB_TOO_LONG;
+    if (!resolve) return SB_OK;
+
+    /* A file that does not exist yet has only the lexical checks */
+    char root_real[PATH_MAX], full_real[PATH_MAX];
+    if (!realpath(root, root_real) || !realpath(out, full_real)) return SB_OK;
+    size_t len = strlen(root_real);
+    if (strncmp(full_real, root_real, len) != 0 || (full_real[len] && full_real[len] != '/'))
+        return SB_ESCAPES;
+    return SB_OK;
+}
+
+void sb_normalize(const char *rel, char *out, size_t sz) {
+    size_t n = 0;
+    if (!sz) return;
+    while (*rel) {
+        while (*rel == '/') rel++;
+        size_t len = strcspn(rel, "/");
+        bool keep = len && !(len == 1 && rel[0] == '.');
+        if (keep && n + (n > 0) + len < sz) {
+            if (n) out[n++] = '/';
+            memcpy(out + n, rel, len);
+            n += len;
+        }
+        rel += len;
+    }
+    out[n] = 0;
+}
+
+const char *sb_reason(SbStatus st) {
+    switch (st) {
+        case SB_OK:        return "Path accepted";
+        case SB_EMPTY:     return "Empty path rejected";
+        case SB_ABSOLUTE:  return "Absolute path rejected";
+        case SB_TRAVERSAL: return "Path traversal blocked";
+        case SB_TOO_LONG:  return "Path too long";
+        case SB_ESCAPES:   return "Resolved path escapes sandbox";
+    }
+    return "Path rejected";
+}
+
+void sb_mkdirs(const char *root, const char *full) {
+    char tmp[PATH_MAX];
+    size_t skip = strlen(root) + 1;
+    if (snprintf(tmp, sizeof(tmp), "%s", full) >= (int)sizeof(tmp) || strlen(tmp) < skip) return;
+    for (char *p = tmp + skip; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(tmp, 0755);
+            *p = '/';
+        }
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * sandbox.h - Mapping the model's relative paths into the sandbox
+ *
+ * Every agent accepts paths only below one directory. A path is refused
+ * when it is empty, absolute or contains "..", or when root/path does
+ * not fit the caller's buffer. With resolve set, a path that already
+ * exists is also put through realpath() and refused if it ends up
+ * outside the resolved root, which catches symlinks pointing out; that
+ * costs two realpath() calls, so hot paths leave it off and rely on the
+ * lexical checks.
+ */
+
+#ifndef SANDBOX_H
+#define SANDBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    SB_OK,
+    SB_EMPTY,
+    SB_ABSOLUTE,
+    SB_TRAVERSAL,
+    SB_TOO_LONG,
+    SB_ESCAPES,             /* resolve only: a link out of the sandbox */
+} SbStatus;
+
+/* root/rel into out */
+SbStatus sb_path(const char *root, const char *rel, char *out, size_t sz, bool resolve);
+
+/* rel as one spelling of the place it names: no "." segments, no empty
+   ones from repeated or trailing slashes, "" for the root itself. Two
+   paths that sb_path() maps to the same file normalize the same. */
+void sb_normalize(const char *rel, char *out, size_t sz);
+
+/* "Absolute path rejected" and so on, for logs */
+const char *sb_reason(SbStatus st);
+
+/* Create the directories between root and the file full names */
+void sb_mkdirs(const char *root, const char *full);
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * test_audit.c - Standalone test for the audit log's backward tail reader
+ * Compile: gcc test_audit.c audit_log.c cJSON.c buffer.c mem_acct.c -o test_audit
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "audit_log.h"
+
+static int passed = 0, failed = 0;
+
+static void check(bool ok, const char *name) {
+    printf("%s %s\n", ok ? "✓" : "✗", name);
+    if (ok) passed++; else failed++;
+}
+
+static char g_log[64];
+
+/* The paths of the records audit_tail() hands over, joined by spaces */
+typedef struct { char text[4096]; int count; } Seen;
+
+static void collect(const cJSON *rec, void *userdata) {
+    Seen *s = userdata;
+    const cJSON *p = cJSON_GetObjectItemCaseSensitive(rec, "path");
+    size_t len = strlen(s->text);
+    snprintf(s->text + len, sizeof(s->text) - len, "%s%s", s->count ? " " : "",
+             cJSON_IsString(p) ? p->valuestring : "?");
+    s->count++;
+}
+
+static const char *tail(int count, const char *action, const char *part) {
+    static Seen s;
+    memset(&s, 0, sizeof(s));
+    audit_tail(g_log, count, action, part, collect, &s);
+    return s.text;
+}
+
+/* A record in the writer's format; pad makes it that much longer */
+static void put(FILE *f, const char *action, const char *path, size_t pad) {
+    fprintf(f, "{\"ts\":\"2024-01-01 12:00:00\",\"action\":\"%s\",\"path\":\"%s\","
+               "\"confirmed\":false,\"result\":\"%*s\"}\n", action, path, (int)pad, "");
+}
+
+static void rotated(char *out, size_t sz, int k) {
+    if (k) snprintf(out, sz, "%s.%d", g_log, k);
+    else snprintf(out, sz, "%s", g_log);
+}
+
+static void remove_all(void) {
+    char name[80];
+    for (int k = 0; k <= AUDIT_KEEP + 1; k++) {
+        rotated(name, sizeof(name), k);
+        unlink(name);
+    }
+}
+
+static void test_write(void) {
+    printf("\n--- write and tail ---\n");
+    remove_all();
+    AuditLog a;
+    bool ok = audit_open(&a, g_log);
+    const char *paths[] = { "a.txt", "b.txt", "c.txt", "d.txt" };
+    for (int i = 0; ok && i < 4; i++) {
+        AuditRecord r = { i & 1 ? "read" : "write", paths[i], "ok", "in \"quoted\"\n", NULL, i == 2 };
+        ok = audit_write(&a, &r);
+    }
+    audit_close(&a);
+    check(ok && a.records == 4, "records written");
+    check(strcmp(tail(3, NULL, NULL), "b.txt c.txt d.txt") == 0, "newest three, oldest first");
+    check(strcmp(tail(10, NULL, NULL), "a.txt b.txt c.txt d.txt") == 0, "fewer than asked");
+    check(strcmp(tail(0, NULL, NULL), "") == 0, "count 0");
+}
+
+/* Checks that the "f<n>" paths come in one unbroken ascending run */
+typedef struct { int next, count; bool ok; } Run;
+
+static void in_order(const cJSON *rec, void *userdata) {
+    Run *r = userdata;
+    const cJSON *p = cJSON_GetObjectItemCaseSensitive(rec, "path");
+    int n = cJSON_IsString(p) && p->valuestring[0] == 'f' ? atoi(p->valuestring + 1) : -1;
+    if (r->count++ == 0) r->next = n;
+    if (n != r->next++) r->ok = false;
+}
+
+static void test_blocks(void) {
+    printf("\n--- block edges ---\n");
+    remove_all();
+
+    /* ~1000-byte records: every 64 KB block edge falls inside one */
+    FILE *f = fopen(g_log, "w");
+    for (int i = 0; f && i < 300; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%d", i);
+        put(f, "write", name, 900);
+    }
+    if (f) fclose(f);
+    Run r = { 0, 0, true };
+    int n = audit_tail(g_log, 200, NULL, NULL, in_order, &r);
+    check(n == 200 && r.count == 200 && r.ok && r.next == 300, "200 records across block edges");
+    r = (Run){ 0, 0, true };
+    n = audit_tail(g_log, 1000, NULL, NULL, in_order, &r);
+    check(n == 300 && r.ok && r.next == 300, "whole file");
+    check(strcmp(tail(1, NULL, NULL), "f299") == 0, "last record");
+
+    /* One record longer than several blocks */
+    f = fopen(g_log, "a");
+    if (f) { put(f, "write", "huge", 3 * 65536); put(f, "read", "after", 0); fclose(f); }
+    check(strcmp(tail(3, NULL, NULL), "f299 huge after") == 0, "record bigger than a block");
+}
+
+static void test_torn(void) {
+    printf("\n--- torn last line ---\n");
+    remove_all();
+    FILE *f = fopen(g_log, "w");
+    if (f) {
+        put(f, "write", "one", 0);
+        put(f, "read", "two", 0);
+        fputs("{\"ts\":\"2024-01-01 12:00:01\",\"action\":\"wri", f);
+        fclose(f);
+    }
+    check(strcmp(tail(1, NULL, NULL), "two") == 0, "torn line skipped");
+    check(strcmp(tail(5, NULL, NULL), "one two") == 0, "the rest intact");
+
+    f = fopen(g_log, "a");
+    if (f) { fputs("\n", f); put(f, "delete", "three", 0); fclose(f); }
+    check(strcmp(tail(5, NULL, NULL), "one two three") == 0, "torn line in the middle");
+}
+
+static void test_filters(void) {
+    printf("\n--- filters ---\n");
+    remove_all();
+    FILE *f = fopen(g_log, "w");
+    if (f) {
+        put(f, "write", "src/a.c", 0);
+        put(f, "read", "src/a.c", 0);
+        put(f, "write", "notes.txt", 0);
+        put(f, "read", "src/b.c", 0);
+        put(f, "writer", "x", 0);          /* action only contains "write" */
+        fclose(f);
+    }
+    check(strcmp(tail(10, "write", NULL), "src/a.c notes.txt") == 0, "action");
+    check(strcmp(tail(10, NULL, "src/"), "src/a.c src/a.c src/b.c") == 0, "path part");
+    check(strcmp(tail(10, "read", "a.c"), "src/a.c") == 0, "both");
+    check(strcmp(tail(1, "write", NULL), "notes.txt") == 0, "newest match only");
+    check(strcmp(tail(10, "delete", NULL), "") == 0, "no match");
+}
+
+static void test_rotation(void) {
+    printf("\n--- rotated files ---\n");
+    remove_all();
+    char name[80];
+    for (int k = 0; k <= AUDIT_KEEP + 1; k++) {
+        rotated(name, sizeof(name), k);
+        FILE *f = fopen(name, "w");
+        for (int i = 0; f && i < 2; i++) {
+            char path[32];
+            snprintf(path, sizeof(path), "r%d.%d", k, i);
+            put(f, i ? "read" : "write", path, 0);
+        }
+        if (f) fclose(f);
+    }
+    check(strcmp(tail(2, NULL, NULL), "r0.0 r0.1") == 0, "current file first");
+    check(strcmp(tail(3, NULL, NULL), "r1.1 r0.0 r0.1") == 0, "into .1");
+    check(strcmp(tail(20, "read", NULL), "r3.1 r2.1 r1.1 r0.1") == 0, "filter across files");
+    check(strstr(tail(20, NULL, NULL), "r4.") == NULL, "nothing past .AUDIT_KEEP");
+
+    rotated(name, sizeof(name), 2);
+    unlink(name);
+    check(strcmp(tail(20, "write", NULL), "r3.0 r1.0 r0.0") == 0, "a missing file is skipped");
+    remove_all();
+}
+
+static void test_show(void) {
+    printf("\n--- logs command ---\n");
+    remove_all();
+    FILE *f = fopen(g_log, "w");
+    if (f) {
+        put(f, "write", "src/a.c", 0);
+        put(f, "read", "src/a.c", 0);
+        put(f, "read", "notes.txt", 0);
+        fclose(f);
+    }
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    char args[] = " 5 read src/ ";
+    audit_show(g_log, args, out);
+    fclose(out);
+    check(text && strstr(text, "] read   src/a.c") && !strstr(text, "write") &&
+          !strstr(text, "notes.txt"), "count, action and path");
+    free(text);
+
+    out = open_memstream(&text, &len);
+    char none[] = "delete";
+    audit_show(g_log, none, out);
+    fclose(out);
+    check(text && strstr(text, "No matching entries."), "no match");
+    free(text);
+    remove_all();
+}
+
+int main(void) {
+    printf("\n=== Audit Log Test ===\n");
+    snprintf(g_log, sizeof(g_log), "/tmp/test_audit.%ld.jsonl", (long)getpid());
+
+    test_write();
+    test_blocks();
+    test_torn();
+    test_filters();
+    test_rotation();
+    test_show();
+
+    printf("\nResults: %d passed, %d failed\n", passed, failed);
+    printf("==================\n\n");
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * test_cjson.c - Standalone test for the cJSON additions used by the agents
+ * Compile: gcc test_cjson.c cJSON.c -o test_cjson
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "cJSON.h"
+
+static int passed = 0, failed = 0;
+
+static void check(bool ok, const char *name) {
+    printf("%s %s\n", ok ? "✓" : "✗", name);
+    if (ok) passed++; else failed++;
+}
+
+static const char *OLLAMA_REPLY =
+    "{\"model\":\"qwen2.5-coder:7b\",\"created_at\":\"2024-01-01T00:00:00Z\","
+    "\"message\":{\"role\":\"assistant\",\"content\":\"{\\\"action\\\": \\\"read\\\", "
+    "\\\"path\\\": \\\"notes.txt\\\", \\\"content\\\": \\\"\\\"}\"},"
+    "\"done\":true,\"total_duration\":123456,\"eval_count\":17}";
+
+static void test_arena(void) {
+    printf("\n--- arena ---\n");
+    cJSON_Arena arena;
+    cJSON_ArenaInit(&arena, 256);   /* small blocks to force chaining */
+
+    for (int round = 0; round < 3; round++) {
+        cJSON *r = cJSON_ParseInArena(&arena, OLLAMA_REPLY);
+        cJSON *msg = cJSON_GetObjectItem(r, "message");
+        cJSON *content = cJSON_GetObjectItem(msg, "content");
+        bool ok = r && (r->type & cJSON_InArena) && cJSON_IsString(content) &&
+                  strstr(content->valuestring, "notes.txt") != NULL;
+        check(ok, round == 0 ? "parse in arena" : "parse in arena after reset");
+        cJSON_Delete(r);            /* no-op for arena trees */
+        cJSON_ArenaReset(&arena);
+    }
+
+    cJSON_Arena *prev = cJSON_SetArena(&arena);
+    cJSON *req = cJSON_CreateObject();
+    cJSON_AddStringToObject(req, "model", "m");
+    cJSON_AddBoolToObject(req, "stream", 0);
+    cJSON *msgs = cJSON_AddArrayToObject(req, "messages");
+    for (int i = 0; i < 50; i++) {
+        cJSON *m = cJSON_CreateObject();
+        cJSON_AddStringToObject(m, "role", "user");
+        cJSON_AddStringToObject(m, "content", "hello \"world\"\n");
+        cJSON_AddItemToArray(msgs, m);
+    }
+    char *out = cJSON_PrintUnformatted(req);
+    cJSON_SetArena(prev);
+    check(out && strncmp(out, "{\"model\":\"m\",\"stream\":false,\"messages\":[{\"role\":\"user\","
+                         "\"content\":\"hello \\\"world\\\"\\n\"}", 70) == 0,
+          "build in arena and print");
+    check(cJSON_GetArraySize(msgs) == 50, "arena array size");
+    cJSON_free(out);
+
+    /* Heap and arena trees side by side */
+    cJSON *heap = cJSON_Parse("{\"a\":[1,2,3]}");
+    check(heap && !(heap->type & cJSON_InArena), "heap parse unaffected");
+    cJSON_Delete(heap);
+
+    cJSON_ArenaFree(&arena);
+}
+
+/* The original byte-at-a-time escaper, as the reference for the fast path */
+static void ref_escape(const char *str, char *out) {
+    *out++ = '"';
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        unsigned char c = *p;
+        if (c == '"') { *out++ = '\\'; *out++ = '"'; }
+        else if (c == '\\') { *out++ = '\\'; *out++ = '\\'; }
+        else if (c == '\b') { *out++ = '\\'; *out++ = 'b'; }
+        else if (c == '\f') { *out++ = '\\'; *out++ = 'f'; }
+        else if (c == '\n') { *out++ = '\\'; *out++ = 'n'; }
+        else if (c == '\r') { *out++ = '\\'; *out++ = 'r'; }
+        else if (c == '\t') { *out++ = '\\'; *out++ = 't'; }
+        else if (c < 32) { sprintf(out, "\\u%04x", c); out += 6; }
+        else *out++ = c;
+    }
+    *out++ = '"';
+    *out = 0;
+}
+
+static void test_strings(void) {
+    printf("\n--- string scanning ---\n");
+    static const char specials[] = "\"\\\b\f\n\r\t\x01\x1f";
+    char src[200], want[1300];
+    bool print_ok = true, round_ok = true;
+
+    /* Every special byte at every offset across two vector widths,
+       with high-bit bytes in the clean runs */
+    for (size_t k = 0; k < sizeof(specials) - 1; k++) {
+        for (size_t pos = 0; pos < 70; pos++) {
+            size_t n = 0;
+            for (; n < pos; n++) src[n] = (n % 7 == 3) ? (char)0xC3 : (char)('a' + n % 26);
+            src[n++] = specials[k];
+            for (size_t j = 0; j < 40; j++) src[n++] = (char)('A' + j % 26);
+            src[n] = 0;
+
+            cJSON *str = cJSON_CreateString(src);
+            char *out = cJSON_PrintUnformatted(str);
+            ref_escape(src, want);
+            if (!out || strcmp(out, want) != 0) print_ok = false;
+
+            cJSON *back = out ? cJSON_Parse(out) : NULL;
+            /* The parser maps \uXXXX to '?'; the first seven specials have short escapes */
+            bool short_esc = k < 7;
+            if (short_esc && (!cJSON_IsString(back) || strcmp(back->valuestring, src) != 0))
+                round_ok = false;
+            cJSON_Delete(back);
+            cJSON_free(out);
+            cJSON_Delete(str);
+        }
+    }
+    check(print_ok, "print matches byte-wise escaper");
+    check(round_ok, "print/parse round trip");
+
+    /* A long clean run with a trailing escape, parsed from a sized buffer */
+    static char big[70000];
+    memset(big, 'x', sizeof(big));
+    big[0] = '"';
+    memcpy(big + sizeof(big) - 5, "\\n\"", 4);
+    big[sizeof(big) - 1] = 0;
+    cJSON *b = cJSON_ParseWithLength(big, sizeof(big) - 1);
+    size_t blen = b && b->valuestring ? strlen(b->valuestring) : 0;
+    check(blen == sizeof(big) - 5 - 1 + 1 && b->valuestring[blen - 1] == '\n', "long string parse");
+    cJSON_Delete(b);
+
+    cJSON *u = cJSON_Parse("\"a\\u0041b\\/c\"");
+    check(u && strcmp(u->valuestring, "a?b/c") == 0, "escapes between runs");
+    cJSON_Delete(u);
+
+    check(cJSON_Parse("\"abcdefghijklmnopqrstuvwxyz0123456789") == NULL, "unterminated string");
+}
+
+static void test_index(void) {
+    printf("\n--- lookup index ---\n");
+    char key[32];
+    cJSON *obj = cJSON_CreateObject();
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "Key%d", i);
+        cJSON_AddNumberToObject(obj, key, i);
+    }
+    cJSON_AddNumberToObject(obj, "key5", -1);      /* same key, other case */
+
+    bool ok = true;
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        cJSON *v = cJSON_GetObjectItem(obj, key);
+        if (!v || v->valueint != i) ok = false;
+    }
+    check(ok && obj->index, "indexed case-insensitive lookup");
+    check(cJSON_GetObjectItem(obj, "key5")->valueint == 5, "first duplicate wins");
+    check(cJSON_GetObjectItemCaseSensitive(obj, "key5")->valueint == -1 &&
+          cJSON_GetObjectItemCaseSensitive(obj, "KEY5") == NULL, "case-sensitive lookup");
+    check(cJSON_GetObjectItem(obj, "missing") == NULL, "missing key");
+
+    cJSON_AddStringToObject(obj, "action", "read");
+    check(obj->index == NULL, "append invalidates index");
+    unsigned h = cJSON_HashKey("action");
+    cJSON *a = cJSON_GetObjectItemWithHash(obj, "ACTION", h);
+    check(cJSON_IsString(a) && strcmp(a->valuestring, "read") == 0, "lookup with precomputed hash");
+    check(cJSON_GetArraySize(obj) == 102, "size from index");
+    cJSON_Delete(obj);
+
+    cJSON *arr = cJSON_CreateArray();
+    for (int i = 0; i < 1000; i++) cJSON_AddItemToArray(arr, cJSON_CreateNumber(i));
+    ok = true;
+    for (int i = 999; i >= 0; i--) {
+        cJSON *v = cJSON_GetArrayItem(arr, i);
+        if (!v || v->valueint != i) ok = false;
+    }
+    check(ok && cJSON_GetArrayItem(arr, 1000) == NULL, "indexed array access");
+    cJSON_Delete(arr);
+
+    /* Arena containers index into their own arena, whichever is active */
+    cJSON_Arena arena, other;
+    cJSON_ArenaInit(&arena, 0);
+    cJSON_ArenaInit(&other, 0);
+    cJSON_Arena *prev = cJSON_SetArena(&arena);
+    cJSON *big = cJSON_CreateObject();
+    for (int i = 0; i < 40; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        cJSON_AddBoolToObject(big, key, i & 1);
+    }
+    check(cJSON_IsTrue(cJSON_GetObjectItem(big, "k39")) && big->index, "arena index");
+    cJSON_SetArena(prev);
+    check(cJSON_IsFalse(cJSON_GetObjectItem(big, "k38")), "arena lookup after switch");
+    cJSON_ArenaReset(&arena);
+
+    char text[1024] = "{";
+    for (int i = 0; i < 40; i++)
+        snprintf(text + strlen(text), sizeof(text) - strlen(text), "%s\"k%d\":%d", i ? "," : "", i, i);
+    strcat(text, "}");
+    cJSON *parsed = cJSON_ParseInArena(&arena, text);
+    cJSON *v = cJSON_GetObjectItem(parsed, "k20");
+    check(v && v->valueint == 20 && parsed->index, "arena index after parse returns");
+
+    /* Built while another arena is active; freeing that one leaves it intact */
+    cJSON_InvalidateIndex(parsed);
+    prev = cJSON_SetArena(&other);
+    v = cJSON_GetObjectItem(parsed, "k30");
+    cJSON_SetArena(prev);
+    cJSON_ArenaFree(&other);
+    v = cJSON_GetObjectItem(parsed, "k31");
+    check(v && v->valueint == 31 && cJSON_GetArrayItem(parsed, 39)->valueint == 39,
+          "arena index under another arena");
+    cJSON_ArenaFree(&arena);
+}
+
+static void test_append(void) {
+    printf("\n--- append ---\n");
+    cJSON *arr = cJSON_CreateArray();
+    for (int i = 0; i < 5; i++) cJSON_AddItemToArray(arr, cJSON_CreateNumber(i));
+    check(arr->child->prev && arr->child->prev->valueint == 4 &&
+          arr->child->prev->next == NULL, "head prev is the tail");
+
+    cJSON *batch[3];
+    for (int i = 0; i < 3; i++) batch[i] = cJSON_CreateNumber(5 + i);
+    check(cJSON_AddItemsToArray(arr, batch, 3), "bulk append");
+    cJSON_AddItemToArray(arr, cJSON_CreateNumber(8));
+    char *out = cJSON_PrintUnformatted(arr);
+    check(out && strcmp(out, "[0,1,2,3,4,5,6,7,8]") == 0, "order after mixed appends");
+    cJSON_free(out);
+
+    /* Walking back from the tail reaches the head */
+    int n = 0;
+    for (cJSON *c = arr->child->prev; c != arr->child; c = c->prev) n++;
+    check(n == 8, "prev links intact");
+
+    cJSON *bad[2] = { cJSON_CreateNull(), NULL };
+    check(!cJSON_AddItemsToArray(arr, bad, 2) && cJSON_GetArraySize(arr) == 9,
+          "bulk append rejects NULL");
+    cJSON_Delete(bad[0]);
+    cJSON_Delete(arr);
+
+    cJSON *empty = cJSON_CreateArray();
+    cJSON *one[1] = { cJSON_CreateString("x") };
+    check(cJSON_AddItemsToArray(empty, one, 1) && empty->child->prev == one[0],
+          "bulk append to empty array");
+    cJSON_Delete(empty);
+
+    cJSON *parsed = cJSON_Parse("{\"a\":1,\"b\":[1,2]}");
+    cJSON_AddNumberToObject(parsed, "c", 3);
+    out = cJSON_PrintUnformatted(parsed);
+    check(out && strcmp(out, "{\"a\":1,\"b\":[1,2],\"c\":3}") == 0, "append to parsed object");
+    cJSON_free(out);
+    cJSON_Delete(parsed);
+}
+
+int main(void) {
+    printf("\n=== cJSON Test ===\n");
+
+    test_arena();
+    test_strings();
+    test_index();
+    test_append();
+
+    printf("\nResults: %d passed, %d failed\n", passed, failed);
+    printf("==================\n\n");
+    return failed > 0 ? 1 : 0;
+}
@@ -1,75 +1,30 @@
 /*
  * test_repair.c - Standalone test for HTML repair function
- * Compile: gcc test_repair.c -o test_repair
+ * Compile: gcc test_repair.c repair.c -o test_repair
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include "repair.h"
 
-static char *repair_html(const char *input) {
-    if (!input) return NULL;
-    
-    size_t len = strlen(input);
-    char *output = malloc(len + 1);
-    if (!output) return NULL;
-    
-    size_t j = 0;
-    
-    for (size_t i = 0; i < len; i++) {
-        char c = input[i];
-        
-        if (c != '?') {
-            output[j++] = c;
-            continue;
-        }
-        
-        char prev = (i > 0) ? input[i - 1] : '\0';
-        char next = (i + 1 < len) ? input[i + 1] : '\0';
-        
-        /* SPECIAL CASE: ?/ is ALWAYS the start of a closing tag </  */
-        if (next == '/') {
-            output[j++] = '<';
-            continue;
-        }
-        
-        /* SPECIAL CASE: ?! is ALWAYS start of <!DOCTYPE or <!-- */
-        if (next == '!') {
-            output[j++] = '<';
-            continue;
-        }
-        
-        /* Does next char suggest we're starting a tag? */
-        bool opening = (
-            (next >= 'a' && next <= 'z') ||
-            (next >= 'A' && next <= 'Z')
-        );
-        
-        /* Does previous char suggest we're at end of a tag? */
-        bool closing = (
-            (prev >= 'a' && prev <= 'z') ||
-            (prev >= 'A' && prev <= 'Z') ||
-            (prev >= '0' && prev <= '9') ||
-            prev == '"' ||
-            prev == '\'' ||
-            prev == '/' ||
-            prev == '-' ||
-            prev == ']'
-        );
-        
-        /* Decide based on context */
-        if (closing) {
-            output[j++] = '>';
-        } else if (opening) {
-            output[j++] = '<';
-        } else {
-            output[j++] = '?';
-        }
+/* Feed s to the streaming form in pieces of `step` bytes, the first one
+   `first` bytes long */
+static char *repair_chunked(const char *s, size_t first, size_t step) {
+    size_t len = strlen(s), j = 0;
+    char *out = malloc(len + 2);
+    RepairStream rs;
+    repair_stream_init(&rs);
+    for (size_t i = 0; i < len; ) {
+        size_t n = i == 0 ? first : step;
+        if (n > len - i) n = len - i;
+        j += repair_stream(&rs, s + i, n, out + j);
+        i += n;
     }
-    
-    output[j] = '\0';
-    return output;
+    j += repair_stream_end(&rs, out + j);
+    out[j] = '\0';
+    return out;
 }
 
 int main(void) {
@@ -88,6 +43,8 @@ int main(void) {
         {"?a href=\"#\"?Link?/a?", "<a href=\"#\">Link</a>"},
         {"?!-- comment --?", "<!-- comment -->"},
         {"?script?alert('hi');?/script?", "<script>alert('hi');</script>"},
+        {"x = y ? 1 : 2 ?? 3", "x = y ? 1 : 2 ?? 3"},
+        {"?", "?"},
         {NULL, NULL}
     };
     
@@ -106,6 +63,30 @@ int main(void) {
         free(result);
     }
     
+    /* Every split point and every chunk size must match the one-shot result */
+    bool split_ok = true, inplace_ok = true;
+    for (int i = 0; tests[i].in; i++) {
+        size_t len = strlen(tests[i].in);
+        for (size_t first = 1; first <= len; first++) {
+            for (size_t step = 1; step <= 3; step++) {
+                char *r = repair_chunked(tests[i].in, first, step);
+                if (strcmp(r, tests[i].expected) != 0) {
+                    printf("  split %zu/%zu of test %d: %s\n", first, step, i + 1, r);
+                    split_ok = false;
+                }
+                free(r);
+            }
+        }
+        char *copy = strdup(tests[i].in);
+        repair_html_inplace(copy, len);
+        if (strcmp(copy, tests[i].expected) != 0) inplace_ok = false;
+        free(copy);
+    }
+    printf("%s Streaming repair matches at every split\n", split_ok ? "✓" : "✗");
+    printf("%s In-place repair matches\n\n", inplace_ok ? "✓" : "✗");
+    if (split_ok) passed++; else failed++;
+    if (inplace_ok) passed++; else failed++;
+    
     printf("Results: %d passed, %d failed\n", passed, failed);
     printf("========================\n\n");
     